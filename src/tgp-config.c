@@ -0,0 +1,339 @@
+/*
+ * Thunar Git Plugin - Configuration Implementation
+ * Copyright (C) 2025 MiniMax Agent
+ *
+ * Settings are read once at startup from a key file:
+ *
+ *   [Discovery]
+ *   CeilingDirectories=/mnt;/media
+ *
+ *   [Status]
+ *   CacheTTL=30
+ *   NetworkCacheTTL=300
+ *   PruneIgnoredDirectories=true
+ *   CollapseUntrackedDirectories=true
+ *
+ *   [Watch]
+ *   MaxWatches=1024
+ *   PollInterval=10
+ *
+ *   [Executor]
+ *   ReadHandles=2
+ *
+ *   [Repository /home/me/src/project]
+ *   CollapseUntrackedDirectories=false
+ *
+ * Ceiling directories from GIT_CEILING_DIRECTORIES are honoured as well.
+ */
+
+#include "tgp-config.h"
+#include <git2.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
+
+/* Filesystem magic numbers, see statfs(2) */
+#define NFS_SUPER_MAGIC    0x6969
+#define SMB_SUPER_MAGIC    0x517b
+#define SMB2_MAGIC_NUMBER  0xfe534d42
+#define CIFS_MAGIC_NUMBER  0xff534d42
+#define FUSE_SUPER_MAGIC   0x65735546
+#define AFS_SUPER_MAGIC    0x5346414f
+#define CODA_SUPER_MAGIC   0x73757245
+#define NCP_SUPER_MAGIC    0x564c
+#define V9FS_MAGIC         0x01021997
+#define CEPH_SUPER_MAGIC   0x00c36400
+
+static gchar **ceiling_dirs = NULL;
+static gchar *ceiling_dirs_joined = NULL;
+static guint status_ttl = TGP_CONFIG_DEFAULT_STATUS_TTL;
+static guint network_status_ttl = TGP_CONFIG_DEFAULT_NETWORK_STATUS_TTL;
+static guint watch_budget = TGP_CONFIG_DEFAULT_WATCH_BUDGET;
+static guint poll_interval = TGP_CONFIG_DEFAULT_POLL_INTERVAL;
+static guint read_handles = TGP_CONFIG_DEFAULT_READ_HANDLES;
+static TgpRepoOptions default_repo_options = TGP_CONFIG_DEFAULT_REPO_OPTIONS;
+static GHashTable *repo_options = NULL;   /* workdir -> TgpRepoOptions */
+
+#define REPOSITORY_GROUP_PREFIX "Repository "
+
+static gchar*
+config_normalize_dir(const gchar *dir)
+{
+    gchar *normalized = g_strdup(dir);
+    gsize len = strlen(normalized);
+
+    while (len > 1 && normalized[len - 1] == '/')
+        normalized[--len] = '\0';
+
+    return normalized;
+}
+
+static void
+config_add_ceiling_dir(GPtrArray *dirs, const gchar *dir)
+{
+    if (!dir || !g_path_is_absolute(dir))
+        return;
+
+    g_ptr_array_add(dirs, config_normalize_dir(dir));
+}
+
+static TgpRepoOptions
+config_get_repo_option(GKeyFile *key_file, const gchar *group, const gchar *key,
+                       TgpRepoOptions option, TgpRepoOptions options)
+{
+    GError *error = NULL;
+    gboolean value = g_key_file_get_boolean(key_file, group, key, &error);
+
+    if (error)
+    {
+        g_error_free(error);
+        return options;
+    }
+
+    return value ? (options | option) : (options & ~option);
+}
+
+static TgpRepoOptions
+config_get_repo_options(GKeyFile *key_file, const gchar *group, TgpRepoOptions options)
+{
+    options = config_get_repo_option(key_file, group, "PruneIgnoredDirectories",
+                                     TGP_REPO_PRUNE_IGNORED_DIRS, options);
+    return config_get_repo_option(key_file, group, "CollapseUntrackedDirectories",
+                                  TGP_REPO_COLLAPSE_UNTRACKED_DIRS, options);
+}
+
+static void
+config_load_repositories(GKeyFile *key_file)
+{
+    gchar **groups = g_key_file_get_groups(key_file, NULL);
+
+    for (guint i = 0; groups[i]; i++)
+    {
+        const gchar *dir;
+
+        if (!g_str_has_prefix(groups[i], REPOSITORY_GROUP_PREFIX))
+            continue;
+
+        dir = groups[i] + strlen(REPOSITORY_GROUP_PREFIX);
+        if (!g_path_is_absolute(dir))
+            continue;
+
+        g_hash_table_replace(repo_options, config_normalize_dir(dir),
+                             GUINT_TO_POINTER(config_get_repo_options(key_file, groups[i],
+                                                                      default_repo_options)));
+    }
+
+    g_strfreev(groups);
+}
+
+static guint
+config_get_positive(GKeyFile *key_file, const gchar *group, const gchar *key, guint fallback)
+{
+    GError *error = NULL;
+    gint value = g_key_file_get_integer(key_file, group, key, &error);
+
+    if (error)
+    {
+        g_error_free(error);
+        return fallback;
+    }
+
+    return value > 0 ? (guint)value : fallback;
+}
+
+/* Like config_get_positive(), with 0 allowed to turn a feature off */
+static guint
+config_get_count(GKeyFile *key_file, const gchar *group, const gchar *key, guint fallback)
+{
+    GError *error = NULL;
+    gint value = g_key_file_get_integer(key_file, group, key, &error);
+
+    if (error)
+    {
+        g_error_free(error);
+        return fallback;
+    }
+
+    return value >= 0 ? (guint)value : fallback;
+}
+
+void
+tgp_config_init(void)
+{
+    GKeyFile *key_file;
+    GPtrArray *dirs;
+    gchar *config_path;
+    const gchar *env;
+
+    if (ceiling_dirs)
+        return;
+
+    dirs = g_ptr_array_new();
+    repo_options = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    config_path = g_build_filename(g_get_user_config_dir(), "thunar-git-plugin",
+                                   "thunar-git-plugin.rc", NULL);
+    key_file = g_key_file_new();
+
+    if (g_key_file_load_from_file(key_file, config_path, G_KEY_FILE_NONE, NULL))
+    {
+        gchar **list = g_key_file_get_string_list(key_file, "Discovery",
+                                                  "CeilingDirectories", NULL, NULL);
+
+        for (guint i = 0; list && list[i]; i++)
+            config_add_ceiling_dir(dirs, list[i]);
+        g_strfreev(list);
+
+        status_ttl = config_get_positive(key_file, "Status", "CacheTTL",
+                                         TGP_CONFIG_DEFAULT_STATUS_TTL);
+        network_status_ttl = config_get_positive(key_file, "Status", "NetworkCacheTTL",
+                                                 TGP_CONFIG_DEFAULT_NETWORK_STATUS_TTL);
+        watch_budget = config_get_positive(key_file, "Watch", "MaxWatches",
+                                           TGP_CONFIG_DEFAULT_WATCH_BUDGET);
+        poll_interval = config_get_positive(key_file, "Watch", "PollInterval",
+                                            TGP_CONFIG_DEFAULT_POLL_INTERVAL);
+        read_handles = config_get_count(key_file, "Executor", "ReadHandles",
+                                        TGP_CONFIG_DEFAULT_READ_HANDLES);
+
+        default_repo_options = config_get_repo_options(key_file, "Status",
+                                                       TGP_CONFIG_DEFAULT_REPO_OPTIONS);
+        config_load_repositories(key_file);
+    }
+
+    g_key_file_free(key_file);
+    g_free(config_path);
+
+    env = g_getenv("GIT_CEILING_DIRECTORIES");
+    if (env)
+    {
+        gchar **list = g_strsplit(env, ":", -1);
+
+        for (guint i = 0; list[i]; i++)
+            config_add_ceiling_dir(dirs, list[i]);
+        g_strfreev(list);
+    }
+
+    g_ptr_array_add(dirs, NULL);
+    ceiling_dirs = (gchar **)g_ptr_array_free(dirs, FALSE);
+
+    if (ceiling_dirs[0])
+    {
+        gchar separator[2] = { GIT_PATH_LIST_SEPARATOR, '\0' };
+        ceiling_dirs_joined = g_strjoinv(separator, ceiling_dirs);
+    }
+}
+
+void
+tgp_config_shutdown(void)
+{
+    g_strfreev(ceiling_dirs);
+    g_free(ceiling_dirs_joined);
+    ceiling_dirs = NULL;
+    ceiling_dirs_joined = NULL;
+
+    if (repo_options)
+    {
+        g_hash_table_destroy(repo_options);
+        repo_options = NULL;
+    }
+    default_repo_options = TGP_CONFIG_DEFAULT_REPO_OPTIONS;
+    watch_budget = TGP_CONFIG_DEFAULT_WATCH_BUDGET;
+    poll_interval = TGP_CONFIG_DEFAULT_POLL_INTERVAL;
+    read_handles = TGP_CONFIG_DEFAULT_READ_HANDLES;
+}
+
+const gchar*
+tgp_config_get_ceiling_dirs(void)
+{
+    return ceiling_dirs_joined;
+}
+
+gboolean
+tgp_config_is_ceiling_dir(const gchar *path)
+{
+    for (guint i = 0; ceiling_dirs && ceiling_dirs[i]; i++)
+    {
+        if (strcmp(ceiling_dirs[i], path) == 0)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/*
+ * Whether path lives on a network or FUSE filesystem, where every stat is
+ * a round trip and recursive walks on the GTK thread are not acceptable.
+ */
+gboolean
+tgp_config_is_network_path(const gchar *path)
+{
+#ifdef __linux__
+    struct statfs buf;
+
+    if (!path || statfs(path, &buf) != 0)
+        return FALSE;
+
+    switch ((guint32)buf.f_type)
+    {
+        case NFS_SUPER_MAGIC:
+        case SMB_SUPER_MAGIC:
+        case SMB2_MAGIC_NUMBER:
+        case CIFS_MAGIC_NUMBER:
+        case FUSE_SUPER_MAGIC:
+        case AFS_SUPER_MAGIC:
+        case CODA_SUPER_MAGIC:
+        case NCP_SUPER_MAGIC:
+        case V9FS_MAGIC:
+        case CEPH_SUPER_MAGIC:
+            return TRUE;
+        default:
+            return FALSE;
+    }
+#else
+    (void)path;
+    return FALSE;
+#endif
+}
+
+guint
+tgp_config_get_status_ttl(gboolean network)
+{
+    return network ? network_status_ttl : status_ttl;
+}
+
+guint
+tgp_config_get_watch_budget(void)
+{
+    return watch_budget;
+}
+
+guint
+tgp_config_get_poll_interval(void)
+{
+    return poll_interval;
+}
+
+guint
+tgp_config_get_read_handles(void)
+{
+    return read_handles;
+}
+
+TgpRepoOptions
+tgp_config_get_repo_options(const gchar *workdir)
+{
+    gpointer options;
+    gchar *key;
+
+    if (!workdir || !repo_options || g_hash_table_size(repo_options) == 0)
+        return default_repo_options;
+
+    key = config_normalize_dir(workdir);
+    if (!g_hash_table_lookup_extended(repo_options, key, NULL, &options))
+        options = GUINT_TO_POINTER(default_repo_options);
+    g_free(key);
+
+    return GPOINTER_TO_UINT(options);
+}
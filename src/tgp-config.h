@@ -0,0 +1,57 @@
+/*
+ * Thunar Git Plugin - Configuration
+ * Copyright (C) 2025 MiniMax Agent
+ */
+
+#ifndef __TGP_CONFIG_H__
+#define __TGP_CONFIG_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Seconds a status table is reused before the next walk */
+#define TGP_CONFIG_DEFAULT_STATUS_TTL          30
+#define TGP_CONFIG_DEFAULT_NETWORK_STATUS_TTL  300
+
+/* Directory watches (inotify) and the polling beyond them */
+#define TGP_CONFIG_DEFAULT_WATCH_BUDGET        1024
+#define TGP_CONFIG_DEFAULT_POLL_INTERVAL       10
+
+/* Extra read-only repository handles for parallel status work, 0 for none */
+#define TGP_CONFIG_DEFAULT_READ_HANDLES        2
+
+/* How status walks treat directories, per repository */
+typedef enum {
+    TGP_REPO_PRUNE_IGNORED_DIRS      = 1 << 0,  /* One record, never descended */
+    TGP_REPO_COLLAPSE_UNTRACKED_DIRS = 1 << 1   /* One record until opened */
+} TgpRepoOptions;
+
+#define TGP_CONFIG_DEFAULT_REPO_OPTIONS (TGP_REPO_PRUNE_IGNORED_DIRS | \
+                                         TGP_REPO_COLLAPSE_UNTRACKED_DIRS)
+
+/* Initialize/cleanup; reads ~/.config/thunar-git-plugin/thunar-git-plugin.rc */
+void         tgp_config_init(void);
+void         tgp_config_shutdown(void);
+
+/* Discovery stops below these, GIT_PATH_LIST_SEPARATOR-joined; NULL for none */
+const gchar* tgp_config_get_ceiling_dirs(void);
+gboolean     tgp_config_is_ceiling_dir(const gchar *path);
+
+/* Network and FUSE mounts get the conservative mode */
+gboolean     tgp_config_is_network_path(const gchar *path);
+guint        tgp_config_get_status_ttl(gboolean network);
+
+/* Most directories watched at once, and seconds between polls of the rest */
+guint        tgp_config_get_watch_budget(void);
+guint        tgp_config_get_poll_interval(void);
+
+/* Cloned handles read-only work may fan out across, per repository */
+guint        tgp_config_get_read_handles(void);
+
+/* [Repository <workdir>] overrides of the [Status] defaults */
+TgpRepoOptions tgp_config_get_repo_options(const gchar *workdir);
+
+G_END_DECLS
+
+#endif /* __TGP_CONFIG_H__ */
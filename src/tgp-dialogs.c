@@ -6,6 +6,9 @@
 #include "tgp-dialogs.h"
 #include "tgp-git-utils.h"
 #include "tgp-credentials.h"
+#include "tgp-index-session.h"
+#include "tgp-job.h"
+#include "tgp-plugin.h"
 #include <string.h>
 
 void
@@ -34,6 +37,26 @@ tgp_show_error_dialog(GtkWindow *parent, const gchar *title, const gchar *messag
     gtk_widget_destroy(dialog);
 }
 
+/*
+ * Mutations started from a dialog run as background jobs, in order with
+ * the other work on the repository's executor queue; the GTK thread never
+ * waits for that queue.
+ */
+typedef struct {
+    gchar    *remote;
+    gchar    *branch;
+    gboolean  pull;
+} DialogRemoteJob;
+
+static void
+dialog_remote_job_free(gpointer data)
+{
+    DialogRemoteJob *ctx = data;
+    g_free(ctx->remote);
+    g_free(ctx->branch);
+    g_free(ctx);
+}
+
 /* Login Dialog */
 gboolean
 tgp_show_login_dialog(GtkWindow *parent, const gchar *host,
@@ -193,6 +216,49 @@ tgp_commit_unref_file_info(GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *
     return FALSE;
 }
 
+typedef struct {
+    gchar     *message;
+    GList     *files;
+    GPtrArray *touched;
+} CommitJob;
+
+static void
+commit_job_free(gpointer data)
+{
+    CommitJob *ctx = data;
+    g_ptr_array_unref(ctx->touched);
+    g_list_free_full(ctx->files, g_free);
+    g_free(ctx->message);
+    g_free(ctx);
+}
+
+static gboolean
+commit_job_run(TgpJob *job, git_repository *repo, gpointer user_data, GError **error)
+{
+    CommitJob *ctx = user_data;
+
+    tgp_job_set_progress(job, -1, "Committing...");
+    if (!tgp_git_commit(repo, ctx->message, ctx->files, ctx->touched, error))
+        return FALSE;
+
+    tgp_plugin_update_emblems_when_flushed(repo, ctx->touched);
+    return TRUE;
+}
+
+static void
+commit_job_done(TgpJob *job, gboolean success, const GError *error, gpointer user_data)
+{
+    (void)job;
+    (void)user_data;
+
+    if (success)
+        tgp_show_info_dialog(NULL, "Commit Successful",
+                            "Changes have been committed successfully.");
+    else
+        tgp_show_error_dialog(NULL, "Commit Failed",
+                             error ? error->message : "Unknown error");
+}
+
 void
 tgp_show_commit_dialog(GtkWindow *parent, const gchar *repo_path, GList *files)
 {
@@ -347,8 +413,17 @@ tgp_show_commit_dialog(GtkWindow *parent, const gchar *repo_path, GList *files)
 
                 if (include && file_info)
                 {
-                    selected_files = g_list_append(selected_files, g_object_ref(file_info));
-                    has_selection = TRUE;
+                    /* tgp_git_commit() takes paths, not the file infos */
+                    GFile *location = thunarx_file_info_get_location(file_info);
+                    gchar *path = location ? g_file_get_path(location) : NULL;
+
+                    if (location)
+                        g_object_unref(location);
+                    if (path)
+                    {
+                        selected_files = g_list_append(selected_files, path);
+                        has_selection = TRUE;
+                    }
                 }
 
                 valid = gtk_tree_model_iter_next(model, &iter_files);
@@ -357,23 +432,14 @@ tgp_show_commit_dialog(GtkWindow *parent, const gchar *repo_path, GList *files)
 
         if (commit_message && strlen(commit_message) > 0 && has_selection)
         {
-            git_repository *repo = tgp_git_open_repository(repo_path);
-            if (repo)
-            {
-                GError *error = NULL;
-                if (tgp_git_commit(repo, commit_message, selected_files, &error))
-                {
-                    tgp_show_info_dialog(parent, "Commit Successful",
-                                        "Changes have been committed successfully.");
-                }
-                else
-                {
-                    tgp_show_error_dialog(parent, "Commit Failed",
-                                         error ? error->message : "Unknown error");
-                    if (error) g_error_free(error);
-                }
-                git_repository_free(repo);
-            }
+            CommitJob *ctx = g_new0(CommitJob, 1);
+
+            ctx->message = g_steal_pointer(&commit_message);
+            ctx->files = g_steal_pointer(&selected_files);
+            ctx->touched = g_ptr_array_new_with_free_func(g_free);
+
+            tgp_job_run(parent, "Committing", repo_path,
+                        commit_job_run, commit_job_done, ctx, commit_job_free);
         }
         else if (!commit_message || strlen(commit_message) == 0)
         {
@@ -386,7 +452,7 @@ tgp_show_commit_dialog(GtkWindow *parent, const gchar *repo_path, GList *files)
                                  "Select at least one file to include in the commit.");
         }
 
-        g_list_free_full(selected_files, g_object_unref);
+        g_list_free_full(selected_files, g_free);
         g_free(commit_message);
     }
 
@@ -477,6 +543,61 @@ tgp_show_clone_dialog(GtkWindow *parent, const gchar *target_path)
     gtk_widget_destroy(dialog);
 }
 
+static gboolean
+dialog_remote_job_run(TgpJob *job, git_repository *repo, gpointer user_data, GError **error)
+{
+    DialogRemoteJob *ctx = user_data;
+    GPtrArray *touched;
+    gboolean success;
+
+    if (!ctx->pull)
+    {
+        tgp_job_set_progress(job, -1, "Pushing...");
+        return tgp_git_push(repo, ctx->remote, ctx->branch, error);
+    }
+
+    tgp_job_set_progress(job, -1, "Pulling...");
+    touched = g_ptr_array_new_with_free_func(g_free);
+    success = tgp_git_pull(repo, ctx->remote, ctx->branch, touched, error);
+
+    /* A failed merge may still have rewritten files */
+    tgp_plugin_update_emblems_when_flushed(repo, touched);
+    g_ptr_array_unref(touched);
+    return success;
+}
+
+static void
+dialog_remote_job_done(TgpJob *job, gboolean success, const GError *error, gpointer user_data)
+{
+    DialogRemoteJob *ctx = user_data;
+
+    (void)job;
+
+    if (success && ctx->pull)
+        tgp_show_info_dialog(NULL, "Pull Successful",
+                            "Changes have been pulled from remote.");
+    else if (success)
+        tgp_show_info_dialog(NULL, "Push Successful",
+                            "Changes have been pushed to remote.");
+    else
+        tgp_show_error_dialog(NULL, ctx->pull ? "Pull Failed" : "Push Failed",
+                             error ? error->message : "Unknown error");
+}
+
+static void
+dialog_remote_job_start(GtkWindow *parent, const gchar *repo_path,
+                        GtkWidget *remote_combo, GtkWidget *branch_entry, gboolean pull)
+{
+    DialogRemoteJob *ctx = g_new0(DialogRemoteJob, 1);
+
+    ctx->remote = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(remote_combo));
+    ctx->branch = g_strdup(gtk_entry_get_text(GTK_ENTRY(branch_entry)));
+    ctx->pull = pull;
+
+    tgp_job_run(parent, pull ? "Pulling" : "Pushing", repo_path,
+                dialog_remote_job_run, dialog_remote_job_done, ctx, dialog_remote_job_free);
+}
+
 /* Push Dialog */
 void
 tgp_show_push_dialog(GtkWindow *parent, const gchar *repo_path)
@@ -539,28 +660,7 @@ tgp_show_push_dialog(GtkWindow *parent, const gchar *repo_path)
     response = gtk_dialog_run(GTK_DIALOG(dialog));
     
     if (response == GTK_RESPONSE_ACCEPT)
-    {
-        const gchar *remote = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(remote_combo));
-        const gchar *branch = gtk_entry_get_text(GTK_ENTRY(branch_entry));
-        
-        git_repository *repo = tgp_git_open_repository(repo_path);
-        if (repo)
-        {
-            GError *error = NULL;
-            if (tgp_git_push(repo, remote, branch, &error))
-            {
-                tgp_show_info_dialog(parent, "Push Successful", 
-                                    "Changes have been pushed to remote.");
-            }
-            else
-            {
-                tgp_show_error_dialog(parent, "Push Failed", 
-                                     error ? error->message : "Unknown error");
-                if (error) g_error_free(error);
-            }
-            git_repository_free(repo);
-        }
-    }
+        dialog_remote_job_start(parent, repo_path, remote_combo, branch_entry, FALSE);
     
     gtk_widget_destroy(dialog);
 }
@@ -627,28 +727,7 @@ tgp_show_pull_dialog(GtkWindow *parent, const gchar *repo_path)
     response = gtk_dialog_run(GTK_DIALOG(dialog));
     
     if (response == GTK_RESPONSE_ACCEPT)
-    {
-        const gchar *remote = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(remote_combo));
-        const gchar *branch = gtk_entry_get_text(GTK_ENTRY(branch_entry));
-        
-        git_repository *repo = tgp_git_open_repository(repo_path);
-        if (repo)
-        {
-            GError *error = NULL;
-            if (tgp_git_pull(repo, remote, branch, &error))
-            {
-                tgp_show_info_dialog(parent, "Pull Successful", 
-                                    "Changes have been pulled from remote.");
-            }
-            else
-            {
-                tgp_show_error_dialog(parent, "Pull Failed", 
-                                     error ? error->message : "Unknown error");
-                if (error) g_error_free(error);
-            }
-            git_repository_free(repo);
-        }
-    }
+        dialog_remote_job_start(parent, repo_path, remote_combo, branch_entry, TRUE);
     
     gtk_widget_destroy(dialog);
 }
@@ -801,6 +880,100 @@ tgp_show_diff_dialog(GtkWindow *parent, const gchar *repo_path, const gchar *fil
 }
 
 /* Branch Dialog */
+typedef struct {
+    GtkWidget    *tree_view;
+    GtkListStore *store;
+    const gchar  *repo_path;
+} BranchDialogData;
+
+typedef struct {
+    gchar        *branch;
+    GtkListStore *store;
+} BranchCheckoutJob;
+
+static void
+branch_checkout_job_free(gpointer data)
+{
+    BranchCheckoutJob *ctx = data;
+    g_object_unref(ctx->store);
+    g_free(ctx->branch);
+    g_free(ctx);
+}
+
+static gboolean
+branch_checkout_job_run(TgpJob *job, git_repository *repo, gpointer user_data, GError **error)
+{
+    BranchCheckoutJob *ctx = user_data;
+
+    return tgp_git_checkout_branch(repo, ctx->branch,
+                                   tgp_job_checkout_notify, tgp_job_checkout_progress,
+                                   job, error);
+}
+
+static void
+branch_checkout_job_done(TgpJob *job, gboolean success, const GError *error, gpointer user_data)
+{
+    BranchCheckoutJob *ctx = user_data;
+    GtkTreeModel *model = GTK_TREE_MODEL(ctx->store);
+    GtkTreeIter iter;
+    gboolean valid;
+
+    (void)job;
+
+    if (!success)
+    {
+        tgp_show_error_dialog(NULL, "Checkout Failed",
+                             error ? error->message : "Unknown error");
+        return;
+    }
+
+    /* Move the "Current" marker to the branch we switched to */
+    valid = gtk_tree_model_get_iter_first(model, &iter);
+    while (valid)
+    {
+        gchar *name = NULL;
+        gboolean is_current;
+
+        gtk_tree_model_get(model, &iter, 1, &name, -1);
+        is_current = (g_strcmp0(name, ctx->branch) == 0);
+        gtk_list_store_set(ctx->store, &iter,
+                           0, is_current,
+                           2, is_current ? "Current" : "Local",
+                           -1);
+        g_free(name);
+
+        valid = gtk_tree_model_iter_next(model, &iter);
+    }
+}
+
+static void
+branch_checkout_clicked(GtkButton *button, gpointer user_data)
+{
+    BranchDialogData *data = user_data;
+    GtkTreeSelection *selection;
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    BranchCheckoutJob *ctx;
+    gchar *branch = NULL;
+
+    selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(data->tree_view));
+    if (!gtk_tree_selection_get_selected(selection, &model, &iter))
+        return;
+
+    gtk_tree_model_get(model, &iter, 1, &branch, -1);
+    if (!branch)
+        return;
+
+    ctx = g_new0(BranchCheckoutJob, 1);
+    ctx->branch = branch;
+    ctx->store = g_object_ref(data->store);
+
+    tgp_job_run(GTK_WINDOW(gtk_widget_get_toplevel(GTK_WIDGET(button))),
+                "Switching Branch", data->repo_path,
+                branch_checkout_job_run, branch_checkout_job_done,
+                ctx, branch_checkout_job_free);
+}
+
 void
 tgp_show_branch_dialog(GtkWindow *parent, const gchar *repo_path)
 {
@@ -815,6 +988,7 @@ tgp_show_branch_dialog(GtkWindow *parent, const gchar *repo_path)
     git_reference *branch_ref;
     git_branch_t branch_type;
     gchar *current_branch;
+    BranchDialogData data;
     
     dialog = gtk_dialog_new_with_buttons("Branch Manager",
                                           parent,
@@ -904,6 +1078,11 @@ tgp_show_branch_dialog(GtkWindow *parent, const gchar *repo_path)
     
     gtk_grid_attach(GTK_GRID(grid), button_box, 0, 1, 1, 1);
     
+    data.tree_view = tree_view;
+    data.store = store;
+    data.repo_path = repo_path;
+    g_signal_connect(checkout_button, "clicked", G_CALLBACK(branch_checkout_clicked), &data);
+    
     g_free(current_branch);
     
     gtk_widget_show_all(dialog);
@@ -912,22 +1091,310 @@ tgp_show_branch_dialog(GtkWindow *parent, const gchar *repo_path)
 }
 
 /* Stash Dialog */
+enum {
+    STASH_COL_INDEX,
+    STASH_COL_MESSAGE,
+    STASH_COL_ID,
+    STASH_N_COLS
+};
+
+/*
+ * Outlives the dialog while a diff task or stash job is still running;
+ * closed tells late results that there is nothing left to update.
+ */
+typedef struct {
+    gint          ref_count;
+    gboolean      closed;
+    gchar        *repo_path;
+    GtkWidget    *tree_view;
+    GtkWidget    *entry;
+    GtkWidget    *text_view;
+    GtkListStore *store;
+    guint         diff_generation;
+} StashDialog;
+
+typedef struct {
+    StashDialog *dlg;
+    guint        generation;
+    git_oid      id;
+} StashDiffTask;
+
+typedef struct {
+    StashDialog *dlg;
+    gboolean     pop;
+    gsize        index;
+    gchar       *message;
+} StashJob;
+
+static StashDialog*
+stash_dialog_ref(StashDialog *dlg)
+{
+    g_atomic_int_inc(&dlg->ref_count);
+    return dlg;
+}
+
+static gboolean
+stash_dialog_free(gpointer data)
+{
+    StashDialog *dlg = data;
+
+    g_object_unref(dlg->store);
+    g_free(dlg->repo_path);
+    g_free(dlg);
+    return G_SOURCE_REMOVE;
+}
+
+/* Task data is dropped on whichever thread finishes last; GTK objects go on the main loop */
+static void
+stash_dialog_unref(StashDialog *dlg)
+{
+    if (g_atomic_int_dec_and_test(&dlg->ref_count))
+        g_main_context_invoke(NULL, stash_dialog_free, dlg);
+}
+
+static void
+stash_dialog_set_diff(StashDialog *dlg, const gchar *text)
+{
+    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(dlg->text_view));
+    gtk_text_buffer_set_text(buffer, text ? text : "", -1);
+}
+
+static void
+stash_dialog_reload(StashDialog *dlg)
+{
+    git_repository *repo;
+    TgpStashList *list;
+    GtkTreeIter iter;
+
+    gtk_list_store_clear(dlg->store);
+    dlg->diff_generation++;
+    stash_dialog_set_diff(dlg, NULL);
+
+    repo = tgp_git_open_repository(dlg->repo_path);
+    if (!repo)
+        return;
+
+    list = tgp_git_get_stashes(repo);
+    for (guint i = 0; i < list->entries->len; i++)
+    {
+        TgpStashEntry *entry = &g_array_index(list->entries, TgpStashEntry, i);
+        gchar id[GIT_OID_HEXSZ + 1];
+
+        git_oid_tostr(id, sizeof(id), &entry->id);
+        gtk_list_store_append(dlg->store, &iter);
+        gtk_list_store_set(dlg->store, &iter,
+                           STASH_COL_INDEX, (guint)entry->index,
+                           STASH_COL_MESSAGE, tgp_stash_list_get_message(list, i),
+                           STASH_COL_ID, id,
+                           -1);
+    }
+
+    tgp_stash_list_free(list);
+    git_repository_free(repo);
+}
+
+static void
+stash_diff_task_free(gpointer data)
+{
+    StashDiffTask *ctx = data;
+    stash_dialog_unref(ctx->dlg);
+    g_free(ctx);
+}
+
+static void
+stash_diff_thread(GTask *task, gpointer source_object, gpointer task_data,
+                  GCancellable *cancellable)
+{
+    StashDiffTask *ctx = task_data;
+    git_repository *repo;
+    gchar *diff = NULL;
+
+    (void)source_object;
+    (void)cancellable;
+
+    repo = tgp_git_open_repository(ctx->dlg->repo_path);
+    if (repo)
+    {
+        diff = tgp_git_get_stash_diff(repo, &ctx->id);
+        git_repository_free(repo);
+    }
+
+    g_task_return_pointer(task, diff, g_free);
+}
+
+static void
+stash_diff_ready(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+    StashDiffTask *ctx = g_task_get_task_data(G_TASK(result));
+    gchar *diff;
+
+    (void)source_object;
+    (void)user_data;
+
+    diff = g_task_propagate_pointer(G_TASK(result), NULL);
+
+    /* Drop results for a row that is no longer selected */
+    if (!ctx->dlg->closed && ctx->generation == ctx->dlg->diff_generation)
+        stash_dialog_set_diff(ctx->dlg, diff ? diff : "No changes in this stash.");
+
+    g_free(diff);
+}
+
+static void
+stash_selection_changed(GtkTreeSelection *selection, gpointer user_data)
+{
+    StashDialog *dlg = user_data;
+    StashDiffTask *ctx;
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gchar *id = NULL;
+    GTask *task;
+
+    if (dlg->closed)
+        return;
+
+    dlg->diff_generation++;
+
+    if (!gtk_tree_selection_get_selected(selection, &model, &iter))
+    {
+        stash_dialog_set_diff(dlg, NULL);
+        return;
+    }
+
+    gtk_tree_model_get(model, &iter, STASH_COL_ID, &id, -1);
+
+    ctx = g_new0(StashDiffTask, 1);
+    ctx->dlg = stash_dialog_ref(dlg);
+    ctx->generation = dlg->diff_generation;
+    if (!id || git_oid_fromstr(&ctx->id, id) != 0)
+    {
+        stash_diff_task_free(ctx);
+        g_free(id);
+        return;
+    }
+    g_free(id);
+
+    stash_dialog_set_diff(dlg, "Loading...");
+
+    task = g_task_new(NULL, NULL, stash_diff_ready, NULL);
+    g_task_set_task_data(task, ctx, stash_diff_task_free);
+    g_task_run_in_thread(task, stash_diff_thread);
+    g_object_unref(task);
+}
+
+static void
+stash_job_free(gpointer data)
+{
+    StashJob *ctx = data;
+    stash_dialog_unref(ctx->dlg);
+    g_free(ctx->message);
+    g_free(ctx);
+}
+
+static gboolean
+stash_job_run(TgpJob *job, git_repository *repo, gpointer user_data, GError **error)
+{
+    StashJob *ctx = user_data;
+
+    if (ctx->pop)
+        return tgp_git_stash_pop(repo, ctx->index,
+                                 tgp_job_checkout_notify, tgp_job_checkout_progress,
+                                 job, error);
+
+    tgp_job_set_progress(job, -1, "Saving changes...");
+    return tgp_git_stash(repo, ctx->message, tgp_job_checkout_notify, job, error);
+}
+
+static void
+stash_job_done(TgpJob *job, gboolean success, const GError *error, gpointer user_data)
+{
+    StashJob *ctx = user_data;
+
+    (void)job;
+
+    if (!success)
+    {
+        tgp_show_error_dialog(NULL, ctx->pop ? "Stash Pop Failed" : "Stash Failed",
+                             error ? error->message : "Unknown error");
+        return;
+    }
+
+    if (ctx->dlg->closed)
+        return;
+
+    if (!ctx->pop)
+        gtk_entry_set_text(GTK_ENTRY(ctx->dlg->entry), "");
+    stash_dialog_reload(ctx->dlg);
+}
+
+static void
+stash_start_job(StashDialog *dlg, GtkWidget *button, StashJob *ctx)
+{
+    ctx->dlg = stash_dialog_ref(dlg);
+
+    tgp_job_run(GTK_WINDOW(gtk_widget_get_toplevel(button)),
+                ctx->pop ? "Applying Stash" : "Stashing Changes", dlg->repo_path,
+                stash_job_run, stash_job_done,
+                ctx, stash_job_free);
+}
+
+static void
+stash_save_clicked(GtkButton *button, gpointer user_data)
+{
+    StashDialog *dlg = user_data;
+    const gchar *message = gtk_entry_get_text(GTK_ENTRY(dlg->entry));
+    StashJob *ctx = g_new0(StashJob, 1);
+
+    ctx->message = (message && *message) ? g_strdup(message) : NULL;
+    stash_start_job(dlg, GTK_WIDGET(button), ctx);
+}
+
+static void
+stash_pop_clicked(GtkButton *button, gpointer user_data)
+{
+    StashDialog *dlg = user_data;
+    GtkTreeSelection *selection;
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    StashJob *ctx;
+    guint index;
+
+    selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(dlg->tree_view));
+    if (!gtk_tree_selection_get_selected(selection, &model, &iter))
+        return;
+
+    gtk_tree_model_get(model, &iter, STASH_COL_INDEX, &index, -1);
+
+    ctx = g_new0(StashJob, 1);
+    ctx->pop = TRUE;
+    ctx->index = index;
+    stash_start_job(dlg, GTK_WIDGET(button), ctx);
+}
+
 void
 tgp_show_stash_dialog(GtkWindow *parent, const gchar *repo_path)
 {
-    GtkWidget *dialog, *content_area, *grid, *label, *entry;
-    gint response;
+    GtkWidget *dialog, *content_area, *grid, *label, *scroll, *paned;
+    GtkWidget *save_button, *pop_button, *button_box;
+    GtkCellRenderer *renderer;
+    GtkTreeViewColumn *column;
+    GtkTreeSelection *selection;
+    StashDialog *dlg;
     
     dialog = gtk_dialog_new_with_buttons("Stash Changes",
                                           parent,
                                           GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
-                                          "_Cancel", GTK_RESPONSE_CANCEL,
-                                          "_Stash", GTK_RESPONSE_ACCEPT,
+                                          "_Close", GTK_RESPONSE_CLOSE,
                                           NULL);
     
-    gtk_window_set_default_size(GTK_WINDOW(dialog), 400, 150);
+    gtk_window_set_default_size(GTK_WINDOW(dialog), 700, 500);
     content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
     
+    dlg = g_new0(StashDialog, 1);
+    dlg->ref_count = 1;
+    dlg->repo_path = g_strdup(repo_path);
+    dlg->store = gtk_list_store_new(STASH_N_COLS, G_TYPE_UINT, G_TYPE_STRING, G_TYPE_STRING);
+    
     grid = gtk_grid_new();
     gtk_grid_set_row_spacing(GTK_GRID(grid), 10);
     gtk_grid_set_column_spacing(GTK_GRID(grid), 10);
@@ -938,52 +1405,521 @@ tgp_show_stash_dialog(GtkWindow *parent, const gchar *repo_path)
     gtk_widget_set_halign(label, GTK_ALIGN_START);
     gtk_grid_attach(GTK_GRID(grid), label, 0, 0, 1, 1);
     
-    entry = gtk_entry_new();
-    gtk_entry_set_placeholder_text(GTK_ENTRY(entry), "Optional stash message");
-    gtk_grid_attach(GTK_GRID(grid), entry, 0, 1, 1, 1);
-    gtk_widget_set_hexpand(entry, TRUE);
+    dlg->entry = gtk_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(dlg->entry), "Optional stash message");
+    gtk_widget_set_hexpand(dlg->entry, TRUE);
+    gtk_grid_attach(GTK_GRID(grid), dlg->entry, 1, 0, 1, 1);
     
-    gtk_widget_show_all(dialog);
+    save_button = gtk_button_new_with_label("Stash");
+    gtk_grid_attach(GTK_GRID(grid), save_button, 2, 0, 1, 1);
     
-    response = gtk_dialog_run(GTK_DIALOG(dialog));
+    paned = gtk_paned_new(GTK_ORIENTATION_VERTICAL);
+    gtk_widget_set_vexpand(paned, TRUE);
+    gtk_grid_attach(GTK_GRID(grid), paned, 0, 1, 3, 1);
     
-    if (response == GTK_RESPONSE_ACCEPT)
+    /* Stash list */
+    scroll = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scroll),
+                                   GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_widget_set_size_request(scroll, -1, 150);
+    gtk_paned_pack1(GTK_PANED(paned), scroll, TRUE, FALSE);
+    
+    dlg->tree_view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(dlg->store));
+    gtk_container_add(GTK_CONTAINER(scroll), dlg->tree_view);
+    
+    renderer = gtk_cell_renderer_text_new();
+    column = gtk_tree_view_column_new_with_attributes("#", renderer,
+                                                       "text", STASH_COL_INDEX, NULL);
+    gtk_tree_view_append_column(GTK_TREE_VIEW(dlg->tree_view), column);
+    
+    renderer = gtk_cell_renderer_text_new();
+    column = gtk_tree_view_column_new_with_attributes("Message", renderer,
+                                                       "text", STASH_COL_MESSAGE, NULL);
+    gtk_tree_view_column_set_expand(column, TRUE);
+    gtk_tree_view_append_column(GTK_TREE_VIEW(dlg->tree_view), column);
+    
+    /* Diff of the selected stash */
+    scroll = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scroll),
+                                   GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_paned_pack2(GTK_PANED(paned), scroll, TRUE, FALSE);
+    
+    dlg->text_view = gtk_text_view_new();
+    gtk_text_view_set_editable(GTK_TEXT_VIEW(dlg->text_view), FALSE);
+    gtk_text_view_set_monospace(GTK_TEXT_VIEW(dlg->text_view), TRUE);
+    gtk_container_add(GTK_CONTAINER(scroll), dlg->text_view);
+    
+    button_box = gtk_button_box_new(GTK_ORIENTATION_HORIZONTAL);
+    gtk_button_box_set_layout(GTK_BUTTON_BOX(button_box), GTK_BUTTONBOX_START);
+    pop_button = gtk_button_new_with_label("Pop Selected");
+    gtk_container_add(GTK_CONTAINER(button_box), pop_button);
+    gtk_grid_attach(GTK_GRID(grid), button_box, 0, 2, 3, 1);
+    
+    stash_dialog_reload(dlg);
+    
+    selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(dlg->tree_view));
+    g_signal_connect(selection, "changed", G_CALLBACK(stash_selection_changed), dlg);
+    g_signal_connect(save_button, "clicked", G_CALLBACK(stash_save_clicked), dlg);
+    g_signal_connect(pop_button, "clicked", G_CALLBACK(stash_pop_clicked), dlg);
+    
+    gtk_widget_show_all(dialog);
+    gtk_dialog_run(GTK_DIALOG(dialog));
+    
+    dlg->closed = TRUE;
+    gtk_widget_destroy(dialog);
+    stash_dialog_unref(dlg);
+}
+
+/* Conflict Resolution Dialog */
+#define CONFLICT_RENDER_CHUNK (64 * 1024)
+
+enum {
+    CONFLICT_COL_PATH,
+    CONFLICT_COL_STATUS,
+    CONFLICT_COL_INDEX,
+    CONFLICT_N_COLS
+};
+
+/*
+ * Conflicts are listed straight from the index; a file's blobs are only
+ * loaded and merged on a worker when its row is selected, and the result
+ * is inserted into the text view a chunk at a time from an idle source.
+ */
+typedef struct {
+    gint            ref_count;
+    gboolean        closed;
+    gboolean        resolving;      /* A resolve job is running */
+    gchar          *repo_path;
+    git_repository *repo;
+    GArray         *conflicts;      /* TgpConflict */
+    GtkListStore   *store;
+    GtkWidget      *tree_view;
+    GtkWidget      *text_view;
+    GtkWidget      *status_label;
+    GPtrArray      *resolved;       /* Relative paths, for the emblem refresh */
+
+    guint           generation;
+    gint            selected;       /* Index into conflicts, -1 for none */
+    TgpMergeResult *merge;
+    guint           render_source;
+    guint           render_hunk;
+} ConflictDialog;
+
+typedef struct {
+    ConflictDialog        *dlg;
+    guint                  generation;
+    TgpConflict            conflict;
+    git_merge_file_favor_t favor;
+} ConflictMergeTask;
+
+static ConflictDialog*
+conflict_dialog_ref(ConflictDialog *dlg)
+{
+    g_atomic_int_inc(&dlg->ref_count);
+    return dlg;
+}
+
+static gboolean
+conflict_dialog_free(gpointer data)
+{
+    ConflictDialog *dlg = data;
+
+    tgp_merge_result_free(dlg->merge);
+    g_ptr_array_unref(dlg->resolved);
+    g_array_unref(dlg->conflicts);
+    g_object_unref(dlg->store);
+    if (dlg->repo)
+        git_repository_free(dlg->repo);
+    g_free(dlg->repo_path);
+    g_free(dlg);
+    return G_SOURCE_REMOVE;
+}
+
+/* Like the stash dialog: the last reference may be dropped by a merge task's thread */
+static void
+conflict_dialog_unref(ConflictDialog *dlg)
+{
+    if (g_atomic_int_dec_and_test(&dlg->ref_count))
+        g_main_context_invoke(NULL, conflict_dialog_free, dlg);
+}
+
+static void
+conflict_dialog_reset_view(ConflictDialog *dlg, const gchar *text)
+{
+    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(dlg->text_view));
+
+    if (dlg->render_source)
     {
-        const gchar *message = gtk_entry_get_text(GTK_ENTRY(entry));
-        git_repository *repo = tgp_git_open_repository(repo_path);
-        
-        if (repo)
+        g_source_remove(dlg->render_source);
+        dlg->render_source = 0;
+    }
+    tgp_merge_result_free(dlg->merge);
+    dlg->merge = NULL;
+    dlg->render_hunk = 0;
+
+    gtk_text_buffer_set_text(buffer, text ? text : "", -1);
+    gtk_text_view_set_editable(GTK_TEXT_VIEW(dlg->text_view), FALSE);
+}
+
+static gboolean
+conflict_render_idle(gpointer user_data)
+{
+    ConflictDialog *dlg = user_data;
+    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(dlg->text_view));
+    GArray *hunks = dlg->merge->hunks;
+    gsize budget = CONFLICT_RENDER_CHUNK;
+    GtkTextIter end;
+
+    while (dlg->render_hunk < hunks->len && budget > 0)
+    {
+        TgpMergeHunk *hunk = &g_array_index(hunks, TgpMergeHunk, dlg->render_hunk++);
+
+        gtk_text_buffer_get_end_iter(buffer, &end);
+        if (hunk->conflict)
+            gtk_text_buffer_insert_with_tags_by_name(buffer, &end,
+                                                     dlg->merge->content + hunk->offset,
+                                                     hunk->length, "conflict", NULL);
+        else
+            gtk_text_buffer_insert(buffer, &end,
+                                   dlg->merge->content + hunk->offset, hunk->length);
+
+        budget = hunk->length < budget ? budget - hunk->length : 0;
+    }
+
+    if (dlg->render_hunk < hunks->len)
+        return G_SOURCE_CONTINUE;
+
+    dlg->render_source = 0;
+    gtk_text_view_set_editable(GTK_TEXT_VIEW(dlg->text_view), TRUE);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+conflict_merge_task_free(gpointer data)
+{
+    ConflictMergeTask *ctx = data;
+    conflict_dialog_unref(ctx->dlg);
+    g_free(ctx->conflict.path);
+    g_free(ctx);
+}
+
+static void
+conflict_merge_thread(GTask *task, gpointer source_object, gpointer task_data,
+                      GCancellable *cancellable)
+{
+    ConflictMergeTask *ctx = task_data;
+    git_repository *repo;
+    TgpMergeResult *result;
+    GError *error = NULL;
+
+    (void)source_object;
+    (void)cancellable;
+
+    repo = tgp_git_open_repository(ctx->dlg->repo_path);
+    if (!repo)
+    {
+        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                                "Unable to open repository");
+        return;
+    }
+
+    result = tgp_git_merge_conflict(repo, &ctx->conflict, ctx->favor, &error);
+    git_repository_free(repo);
+
+    if (result)
+        g_task_return_pointer(task, result, (GDestroyNotify)tgp_merge_result_free);
+    else
+        g_task_return_error(task, error);
+}
+
+static void
+conflict_merge_ready(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+    ConflictMergeTask *ctx = g_task_get_task_data(G_TASK(result));
+    ConflictDialog *dlg = ctx->dlg;
+    TgpMergeResult *merge;
+    GError *error = NULL;
+    guint n_conflicts = 0;
+    gchar *status;
+
+    (void)source_object;
+    (void)user_data;
+
+    merge = g_task_propagate_pointer(G_TASK(result), &error);
+
+    if (dlg->closed || ctx->generation != dlg->generation)
+    {
+        tgp_merge_result_free(merge);
+        g_clear_error(&error);
+        return;
+    }
+
+    if (!merge)
+    {
+        conflict_dialog_reset_view(dlg, NULL);
+        gtk_label_set_text(GTK_LABEL(dlg->status_label),
+                           error ? error->message : "Merge failed");
+        g_clear_error(&error);
+        return;
+    }
+
+    conflict_dialog_reset_view(dlg, NULL);
+
+    if (merge->deleted)
+    {
+        gtk_text_buffer_set_text(gtk_text_view_get_buffer(GTK_TEXT_VIEW(dlg->text_view)),
+                                 "This side deleted the file.", -1);
+        gtk_label_set_text(GTK_LABEL(dlg->status_label),
+                           "Mark Resolved deletes the file.");
+        dlg->merge = merge;
+        return;
+    }
+
+    /* The text view only takes UTF-8; other content can still be kept whole */
+    if (!g_utf8_validate(merge->content, merge->length, NULL))
+    {
+        gtk_text_buffer_set_text(gtk_text_view_get_buffer(GTK_TEXT_VIEW(dlg->text_view)),
+                                 "This file cannot be shown as text.", -1);
+        gtk_label_set_text(GTK_LABEL(dlg->status_label),
+                           "Binary content; Mark Resolved keeps the chosen side.");
+        dlg->merge = merge;
+        return;
+    }
+
+    for (guint i = 0; i < merge->hunks->len; i++)
+        if (g_array_index(merge->hunks, TgpMergeHunk, i).conflict)
+            n_conflicts++;
+
+    status = merge->automergeable
+        ? g_strdup("Merged cleanly; review and mark as resolved.")
+        : g_strdup_printf("%u conflicting hunk%s; edit the result below.",
+                          n_conflicts, n_conflicts == 1 ? "" : "s");
+    gtk_label_set_text(GTK_LABEL(dlg->status_label), status);
+    g_free(status);
+
+    dlg->merge = merge;
+    dlg->render_source = g_idle_add(conflict_render_idle, dlg);
+}
+
+static void
+conflict_dialog_load(ConflictDialog *dlg, git_merge_file_favor_t favor)
+{
+    ConflictMergeTask *ctx;
+    TgpConflict *conflict;
+    GTask *task;
+
+    dlg->generation++;
+
+    if (dlg->selected < 0)
+    {
+        conflict_dialog_reset_view(dlg, NULL);
+        gtk_label_set_text(GTK_LABEL(dlg->status_label), "Select a file to resolve.");
+        return;
+    }
+
+    conflict = &g_array_index(dlg->conflicts, TgpConflict, dlg->selected);
+
+    ctx = g_new0(ConflictMergeTask, 1);
+    ctx->dlg = conflict_dialog_ref(dlg);
+    ctx->generation = dlg->generation;
+    ctx->conflict = *conflict;
+    ctx->conflict.path = g_strdup(conflict->path);
+    ctx->favor = favor;
+
+    conflict_dialog_reset_view(dlg, NULL);
+    gtk_label_set_text(GTK_LABEL(dlg->status_label), "Merging...");
+
+    task = g_task_new(NULL, NULL, conflict_merge_ready, NULL);
+    g_task_set_task_data(task, ctx, conflict_merge_task_free);
+    g_task_run_in_thread(task, conflict_merge_thread);
+    g_object_unref(task);
+}
+
+static void
+conflict_selection_changed(GtkTreeSelection *selection, gpointer user_data)
+{
+    ConflictDialog *dlg = user_data;
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gint index = -1;
+
+    if (dlg->closed)
+        return;
+
+    if (gtk_tree_selection_get_selected(selection, &model, &iter))
+        gtk_tree_model_get(model, &iter, CONFLICT_COL_INDEX, &index, -1);
+
+    dlg->selected = index;
+    conflict_dialog_load(dlg, GIT_MERGE_FILE_FAVOR_NORMAL);
+}
+
+static void
+conflict_use_ours_clicked(GtkButton *button, gpointer user_data)
+{
+    (void)button;
+    conflict_dialog_load(user_data, GIT_MERGE_FILE_FAVOR_OURS);
+}
+
+static void
+conflict_use_theirs_clicked(GtkButton *button, gpointer user_data)
+{
+    (void)button;
+    conflict_dialog_load(user_data, GIT_MERGE_FILE_FAVOR_THEIRS);
+}
+
+typedef struct {
+    ConflictDialog *dlg;
+    gint            index;      /* Into dlg->conflicts */
+    gchar          *path;
+    gchar          *content;    /* NULL to resolve by deleting the file */
+    gsize           length;
+    GPtrArray      *resolved;
+} ConflictResolveJob;
+
+static void
+conflict_resolve_job_free(gpointer data)
+{
+    ConflictResolveJob *ctx = data;
+    conflict_dialog_unref(ctx->dlg);
+    g_ptr_array_unref(ctx->resolved);
+    g_free(ctx->content);
+    g_free(ctx->path);
+    g_free(ctx);
+}
+
+static gboolean
+conflict_resolve_job_run(TgpJob *job, git_repository *repo, gpointer user_data, GError **error)
+{
+    ConflictResolveJob *ctx = user_data;
+
+    (void)job;
+
+    if (ctx->content)
+        return tgp_git_resolve_conflict(repo, ctx->path, ctx->content, ctx->length,
+                                        ctx->resolved, error);
+
+    return tgp_git_resolve_conflict_by_deletion(repo, ctx->path, ctx->resolved, error);
+}
+
+static void
+conflict_resolve_job_done(TgpJob *job, gboolean success, const GError *error, gpointer user_data)
+{
+    ConflictResolveJob *ctx = user_data;
+    ConflictDialog *dlg = ctx->dlg;
+    GtkTreeModel *model = GTK_TREE_MODEL(dlg->store);
+    GtkTreeIter iter;
+    gboolean valid;
+
+    (void)job;
+
+    dlg->resolving = FALSE;
+
+    if (!success)
+    {
+        tgp_show_error_dialog(NULL, "Resolve Failed",
+                             error ? error->message : "Unknown error");
+        return;
+    }
+
+    /* Closed meanwhile: its emblem refresh has been queued already */
+    if (dlg->closed)
+    {
+        if (dlg->repo)
+            tgp_plugin_update_emblems_when_flushed(dlg->repo, ctx->resolved);
+        return;
+    }
+
+    for (guint i = 0; i < ctx->resolved->len; i++)
+        g_ptr_array_add(dlg->resolved, g_strdup(g_ptr_array_index(ctx->resolved, i)));
+
+    valid = gtk_tree_model_get_iter_first(model, &iter);
+    while (valid)
+    {
+        gint index = -1;
+
+        gtk_tree_model_get(model, &iter, CONFLICT_COL_INDEX, &index, -1);
+        if (index == ctx->index)
         {
-            GError *error = NULL;
-            if (tgp_git_stash(repo, message && strlen(message) > 0 ? message : NULL, &error))
-            {
-                tgp_show_info_dialog(parent, "Stash Successful", 
-                                    "Changes have been stashed.");
-            }
-            else
-            {
-                tgp_show_error_dialog(parent, "Stash Failed", 
-                                     error ? error->message : "Unknown error");
-                if (error) g_error_free(error);
-            }
-            git_repository_free(repo);
+            gtk_list_store_set(dlg->store, &iter, CONFLICT_COL_STATUS, "Resolved", -1);
+            break;
         }
+        valid = gtk_tree_model_iter_next(model, &iter);
     }
-    
-    gtk_widget_destroy(dialog);
+
+    if (dlg->selected == ctx->index)
+        gtk_label_set_text(GTK_LABEL(dlg->status_label), "Resolved.");
+}
+
+static void
+conflict_resolve_clicked(GtkButton *button, gpointer user_data)
+{
+    ConflictDialog *dlg = user_data;
+    GtkWindow *window = GTK_WINDOW(gtk_widget_get_toplevel(GTK_WIDGET(button)));
+    ConflictResolveJob *ctx;
+    TgpConflict *conflict;
+    const gchar *content;
+    gchar *text = NULL;
+    gsize length;
+
+    if (dlg->selected < 0 || !dlg->merge || dlg->render_source || dlg->resolving)
+        return;
+
+    conflict = &g_array_index(dlg->conflicts, TgpConflict, dlg->selected);
+
+    if (gtk_text_view_get_editable(GTK_TEXT_VIEW(dlg->text_view)))
+    {
+        GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(dlg->text_view));
+        GtkTextIter start, end;
+
+        gtk_text_buffer_get_bounds(buffer, &start, &end);
+        content = text = gtk_text_buffer_get_text(buffer, &start, &end, FALSE);
+        length = strlen(text);
+    }
+    else
+    {
+        content = dlg->merge->content;
+        length = dlg->merge->length;
+    }
+
+    if (!dlg->merge->deleted && strstr(content, "<<<<<<< ") && strstr(content, ">>>>>>> "))
+    {
+        tgp_show_error_dialog(window, "Unresolved Conflicts",
+                             "The result still contains conflict markers.");
+        g_free(text);
+        return;
+    }
+
+    ctx = g_new0(ConflictResolveJob, 1);
+    ctx->dlg = conflict_dialog_ref(dlg);
+    ctx->index = dlg->selected;
+    ctx->path = g_strdup(conflict->path);
+    if (!dlg->merge->deleted)
+    {
+        ctx->content = g_malloc(length + 1);
+        memcpy(ctx->content, content, length);
+        ctx->content[length] = '\0';
+    }
+    ctx->length = length;
+    ctx->resolved = g_ptr_array_new_with_free_func(g_free);
+    g_free(text);
+
+    dlg->resolving = TRUE;
+    gtk_label_set_text(GTK_LABEL(dlg->status_label), "Resolving...");
+
+    tgp_job_run(window, "Resolving Conflict", dlg->repo_path,
+                conflict_resolve_job_run, conflict_resolve_job_done,
+                ctx, conflict_resolve_job_free);
 }
 
-/* Conflict Resolution Dialog */
 void
 tgp_show_conflict_dialog(GtkWindow *parent, const gchar *repo_path)
 {
-    GtkWidget *dialog, *content_area, *scroll, *tree_view;
-    GtkListStore *store;
+    GtkWidget *dialog, *content_area, *scroll, *paned, *box, *button_box, *button;
     GtkTreeIter iter;
     GtkCellRenderer *renderer;
     GtkTreeViewColumn *column;
-    git_repository *repo;
-    git_index *index;
+    GtkTextBuffer *buffer;
+    ConflictDialog *dlg;
     
     dialog = gtk_dialog_new_with_buttons("Resolve Conflicts",
                                           parent,
@@ -991,59 +1927,115 @@ tgp_show_conflict_dialog(GtkWindow *parent, const gchar *repo_path)
                                           "_Close", GTK_RESPONSE_CLOSE,
                                           NULL);
     
-    gtk_window_set_default_size(GTK_WINDOW(dialog), 600, 400);
+    gtk_window_set_default_size(GTK_WINDOW(dialog), 900, 600);
     content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
     
-    store = gtk_list_store_new(2, G_TYPE_STRING, G_TYPE_STRING);
+    dlg = g_new0(ConflictDialog, 1);
+    dlg->ref_count = 1;
+    dlg->selected = -1;
+    dlg->repo_path = g_strdup(repo_path);
+    dlg->resolved = g_ptr_array_new_with_free_func(g_free);
+    dlg->store = gtk_list_store_new(CONFLICT_N_COLS, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INT);
     
-    repo = tgp_git_open_repository(repo_path);
-    if (repo)
+    dlg->repo = tgp_git_open_repository(repo_path);
+    if (dlg->repo)
+        dlg->conflicts = tgp_git_get_conflicts(dlg->repo);
+    else
+        dlg->conflicts = g_array_new(FALSE, TRUE, sizeof(TgpConflict));
+    
+    for (guint i = 0; i < dlg->conflicts->len; i++)
     {
-        if (git_repository_index(&index, repo) == 0)
-        {
-            git_index_conflict_iterator *conflict_iter;
-            const git_index_entry *ancestor, *our, *their;
-            
-            if (git_index_conflict_iterator_new(&conflict_iter, index) == 0)
-            {
-                while (git_index_conflict_next(&ancestor, &our, &their, conflict_iter) == 0)
-                {
-                    const gchar *path = our ? our->path : (their ? their->path : "unknown");
-                    
-                    gtk_list_store_append(store, &iter);
-                    gtk_list_store_set(store, &iter,
-                                      0, path,
-                                      1, "Conflicted",
-                                      -1);
-                }
-                git_index_conflict_iterator_free(conflict_iter);
-            }
-            git_index_free(index);
-        }
-        git_repository_free(repo);
+        gtk_list_store_append(dlg->store, &iter);
+        gtk_list_store_set(dlg->store, &iter,
+                          CONFLICT_COL_PATH, g_array_index(dlg->conflicts, TgpConflict, i).path,
+                          CONFLICT_COL_STATUS, "Conflicted",
+                          CONFLICT_COL_INDEX, (gint)i,
+                          -1);
     }
     
-    tree_view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(store));
-    g_object_unref(store);
+    paned = gtk_paned_new(GTK_ORIENTATION_HORIZONTAL);
+    gtk_container_set_border_width(GTK_CONTAINER(paned), 10);
+    gtk_widget_set_vexpand(paned, TRUE);
+    gtk_container_add(GTK_CONTAINER(content_area), paned);
+    
+    /* Conflicted files */
+    dlg->tree_view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(dlg->store));
     
     renderer = gtk_cell_renderer_text_new();
-    column = gtk_tree_view_column_new_with_attributes("File", renderer, "text", 0, NULL);
-    gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view), column);
+    column = gtk_tree_view_column_new_with_attributes("File", renderer,
+                                                       "text", CONFLICT_COL_PATH, NULL);
+    gtk_tree_view_column_set_expand(column, TRUE);
+    gtk_tree_view_append_column(GTK_TREE_VIEW(dlg->tree_view), column);
     
     renderer = gtk_cell_renderer_text_new();
-    column = gtk_tree_view_column_new_with_attributes("Status", renderer, "text", 1, NULL);
-    gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view), column);
+    column = gtk_tree_view_column_new_with_attributes("Status", renderer,
+                                                       "text", CONFLICT_COL_STATUS, NULL);
+    gtk_tree_view_append_column(GTK_TREE_VIEW(dlg->tree_view), column);
     
     scroll = gtk_scrolled_window_new(NULL, NULL);
     gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scroll),
                                     GTK_POLICY_AUTOMATIC,
                                     GTK_POLICY_AUTOMATIC);
-    gtk_container_add(GTK_CONTAINER(scroll), tree_view);
-    gtk_container_add(GTK_CONTAINER(content_area), scroll);
+    gtk_widget_set_size_request(scroll, 250, -1);
+    gtk_container_add(GTK_CONTAINER(scroll), dlg->tree_view);
+    gtk_paned_pack1(GTK_PANED(paned), scroll, FALSE, FALSE);
+    
+    /* Merge result of the selected file */
+    box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
+    gtk_paned_pack2(GTK_PANED(paned), box, TRUE, FALSE);
+    
+    dlg->status_label = gtk_label_new("Select a file to resolve.");
+    gtk_widget_set_halign(dlg->status_label, GTK_ALIGN_START);
+    gtk_box_pack_start(GTK_BOX(box), dlg->status_label, FALSE, FALSE, 0);
+    
+    dlg->text_view = gtk_text_view_new();
+    gtk_text_view_set_editable(GTK_TEXT_VIEW(dlg->text_view), FALSE);
+    gtk_text_view_set_monospace(GTK_TEXT_VIEW(dlg->text_view), TRUE);
+    buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(dlg->text_view));
+    gtk_text_buffer_create_tag(buffer, "conflict", "background", "#fce8e6", NULL);
+    
+    scroll = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scroll),
+                                    GTK_POLICY_AUTOMATIC,
+                                    GTK_POLICY_AUTOMATIC);
+    gtk_container_add(GTK_CONTAINER(scroll), dlg->text_view);
+    gtk_box_pack_start(GTK_BOX(box), scroll, TRUE, TRUE, 0);
+    
+    button_box = gtk_button_box_new(GTK_ORIENTATION_HORIZONTAL);
+    gtk_button_box_set_layout(GTK_BUTTON_BOX(button_box), GTK_BUTTONBOX_START);
+    gtk_box_set_spacing(GTK_BOX(button_box), 6);
+    gtk_box_pack_start(GTK_BOX(box), button_box, FALSE, FALSE, 0);
+    
+    button = gtk_button_new_with_label("Use Ours");
+    g_signal_connect(button, "clicked", G_CALLBACK(conflict_use_ours_clicked), dlg);
+    gtk_container_add(GTK_CONTAINER(button_box), button);
+    
+    button = gtk_button_new_with_label("Use Theirs");
+    g_signal_connect(button, "clicked", G_CALLBACK(conflict_use_theirs_clicked), dlg);
+    gtk_container_add(GTK_CONTAINER(button_box), button);
+    
+    button = gtk_button_new_with_label("Mark Resolved");
+    g_signal_connect(button, "clicked", G_CALLBACK(conflict_resolve_clicked), dlg);
+    gtk_container_add(GTK_CONTAINER(button_box), button);
+    
+    g_signal_connect(gtk_tree_view_get_selection(GTK_TREE_VIEW(dlg->tree_view)), "changed",
+                     G_CALLBACK(conflict_selection_changed), dlg);
     
     gtk_widget_show_all(dialog);
     gtk_dialog_run(GTK_DIALOG(dialog));
+    
+    dlg->closed = TRUE;
+    if (dlg->render_source)
+    {
+        g_source_remove(dlg->render_source);
+        dlg->render_source = 0;
+    }
+    
+    if (dlg->repo)
+        tgp_plugin_update_emblems_when_flushed(dlg->repo, dlg->resolved);
+    
     gtk_widget_destroy(dialog);
+    conflict_dialog_unref(dlg);
 }
 
 /* Status Dialog */
@@ -1096,6 +2088,8 @@ tgp_show_status_dialog(GtkWindow *parent, const gchar *repo_path)
                      GIT_STATUS_OPT_RENAMES_HEAD_TO_INDEX |
                      GIT_STATUS_OPT_SORT_CASE_SENSITIVELY;
         
+        tgp_index_session_flush(repo, NULL);
+        
         if (git_status_list_new(&status_list, repo, &opts) == 0)
         {
             size_t count = git_status_list_entrycount(status_list);
@@ -0,0 +1,510 @@
+/*
+ * Thunar Git Plugin - Repository Discovery Cache Implementation
+ * Copyright (C) 2025 MiniMax Agent
+ *
+ * git_repository_discover() stats every ancestor up to / on each call. The
+ * answer for a path, and for every directory the walk went through, is
+ * remembered here, including "not in a repository". A path whose parent is
+ * already known only needs to be checked for a repository of its own.
+ *
+ * A .git showing up in or vanishing from a directory changes its mtime,
+ * so each answer is stored with the mtime of its directory. An answer is
+ * trusted for TGP_DISCOVERY_RECHECK_SECONDS; after that the mtimes of its
+ * directory and of the cached ancestors it depends on are compared once,
+ * and a directory that changed is dropped with everything below it. That
+ * is one stat() per level instead of the several a discover walk costs,
+ * and no watch on every directory ever looked at.
+ *
+ * Only the gitdirs that were found are watched, from the main loop, so
+ * that a repository being deleted is forgotten right away.
+ */
+
+#include "tgp-discovery.h"
+#include "tgp-config.h"
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <git2.h>
+#include <string.h>
+
+typedef struct {
+    gchar  *gitdir;     /* "" records that there is no repository */
+    gint64  mtime;      /* Of the directory when the answer was found */
+    gint64  checked;    /* Monotonic time the mtime was last compared */
+} DiscoveryEntry;
+
+/* Directory -> DiscoveryEntry */
+static GHashTable *entries = NULL;
+static GMutex entries_mutex;
+
+/* Main thread only */
+static GHashTable *monitors = NULL;           /* gitdir -> GFileMonitor */
+static GPtrArray *pending_monitors = NULL;   /* Guarded by entries_mutex */
+static guint monitor_source = 0;              /* Guarded by entries_mutex */
+
+static gboolean discovery_update_monitors(gpointer user_data);
+
+static gchar*
+discovery_normalize(const gchar *path)
+{
+    gchar *dir = g_strdup(path);
+    gsize len = strlen(dir);
+
+    while (len > 1 && dir[len - 1] == '/')
+        dir[--len] = '\0';
+
+    return dir;
+}
+
+/* Working tree of a "<workdir>/.git/" gitdir, NULL for anything else */
+static gchar*
+discovery_workdir_of(const gchar *gitdir)
+{
+    gchar *dir = discovery_normalize(gitdir);
+
+    if (g_str_has_suffix(dir, "/.git"))
+    {
+        dir[strlen(dir) - 5] = '\0';
+        if (dir[0] == '\0')
+            strcpy(dir, "/");
+        return dir;
+    }
+
+    g_free(dir);
+    return NULL;
+}
+
+/* A directory that could itself be, or hold, a repository */
+static gboolean
+discovery_may_be_repository(const gchar *path)
+{
+    gchar *dot_git = g_build_filename(path, ".git", NULL);
+    gchar *head = g_build_filename(path, "HEAD", NULL);
+    gboolean result;
+
+    result = g_file_test(dot_git, G_FILE_TEST_EXISTS) ||
+             g_file_test(head, G_FILE_TEST_EXISTS);
+
+    g_free(head);
+    g_free(dot_git);
+    return result;
+}
+
+/* In nanoseconds, -1 if path can't be stat()ed */
+static gint64
+discovery_get_mtime(const gchar *path)
+{
+    GStatBuf st;
+
+    if (g_stat(path, &st) != 0)
+        return -1;
+
+    return (gint64)st.st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) + st.st_mtim.tv_nsec;
+}
+
+static void
+discovery_entry_free(gpointer data)
+{
+    DiscoveryEntry *entry = data;
+
+    g_free(entry->gitdir);
+    g_free(entry);
+}
+
+/* Called with entries_mutex held */
+static void
+discovery_remember(const gchar *path, const gchar *gitdir, gint64 mtime)
+{
+    DiscoveryEntry *entry;
+
+    if (g_hash_table_contains(entries, path))
+        return;
+
+    if (g_hash_table_size(entries) >= TGP_DISCOVERY_MAX_ENTRIES)
+        g_hash_table_remove_all(entries);
+
+    entry = g_new(DiscoveryEntry, 1);
+    entry->gitdir = g_strdup(gitdir ? gitdir : "");
+    entry->mtime = mtime;
+    entry->checked = g_get_monotonic_time();
+    g_hash_table_insert(entries, g_strdup(path), entry);
+
+    if (gitdir)
+    {
+        g_ptr_array_add(pending_monitors, g_strdup(gitdir));
+        if (!monitor_source)
+            monitor_source = g_idle_add(discovery_update_monitors, NULL);
+    }
+}
+
+/* Called with entries_mutex held */
+static void
+discovery_invalidate_locked(const gchar *dir)
+{
+    GHashTableIter iter;
+    gpointer key;
+    gsize len = strlen(dir);
+
+    g_hash_table_iter_init(&iter, entries);
+    while (g_hash_table_iter_next(&iter, &key, NULL))
+    {
+        const gchar *entry = key;
+
+        if (strncmp(entry, dir, len) == 0 &&
+            (entry[len] == '\0' || entry[len] == '/' || strcmp(dir, "/") == 0))
+            g_hash_table_iter_remove(&iter);
+    }
+}
+
+/*
+ * The cached answer for dir, if there is one that still holds: once it is
+ * older than TGP_DISCOVERY_RECHECK_SECONDS, the mtimes of dir and of its
+ * cached ancestors (up to the workdir for a repository) are compared.
+ */
+static gboolean
+discovery_lookup(const gchar *dir, gchar **gitdir)
+{
+    gint64 now = g_get_monotonic_time();
+    gint64 recheck = (gint64)TGP_DISCOVERY_RECHECK_SECONDS * G_USEC_PER_SEC;
+    DiscoveryEntry *entry;
+    GPtrArray *chain;              /* Directories to compare, dir first */
+    GArray *mtimes;                /* Their recorded mtimes */
+    gchar *workdir = NULL;
+    gchar *answer;
+    gboolean valid = TRUE;
+
+    g_mutex_lock(&entries_mutex);
+    entry = entries ? g_hash_table_lookup(entries, dir) : NULL;
+    if (!entry)
+    {
+        g_mutex_unlock(&entries_mutex);
+        return FALSE;
+    }
+    answer = *entry->gitdir ? g_strdup(entry->gitdir) : NULL;
+
+    if (now - entry->checked < recheck)
+    {
+        g_mutex_unlock(&entries_mutex);
+        *gitdir = answer;
+        return TRUE;
+    }
+
+    /* The answer depends on every level the walk went through */
+    chain = g_ptr_array_new_with_free_func(g_free);
+    mtimes = g_array_new(FALSE, FALSE, sizeof(gint64));
+    if (answer)
+        workdir = discovery_workdir_of(answer);
+
+    for (gchar *level = g_strdup(dir); level != NULL; )
+    {
+        DiscoveryEntry *cached = g_hash_table_lookup(entries, level);
+        gchar *up;
+
+        if (!cached || g_strcmp0(cached->gitdir, entry->gitdir) != 0)
+        {
+            g_free(level);
+            break;
+        }
+
+        g_ptr_array_add(chain, level);
+        g_array_append_val(mtimes, cached->mtime);
+
+        up = g_path_get_dirname(level);
+        if (strcmp(up, level) == 0 || (workdir && strcmp(level, workdir) == 0))
+        {
+            g_free(up);
+            up = NULL;
+        }
+        level = up;
+    }
+    g_mutex_unlock(&entries_mutex);
+
+    /* Top first, so a change high up drops everything below it at once */
+    for (guint i = chain->len; i > 0 && valid; i--)
+    {
+        const gchar *level = g_ptr_array_index(chain, i - 1);
+
+        if (discovery_get_mtime(level) != g_array_index(mtimes, gint64, i - 1))
+        {
+            g_mutex_lock(&entries_mutex);
+            if (entries)
+                discovery_invalidate_locked(level);
+            g_mutex_unlock(&entries_mutex);
+            valid = FALSE;
+        }
+    }
+
+    if (valid)
+    {
+        g_mutex_lock(&entries_mutex);
+        for (guint i = 0; entries && i < chain->len; i++)
+        {
+            DiscoveryEntry *cached = g_hash_table_lookup(entries, g_ptr_array_index(chain, i));
+
+            if (cached)
+                cached->checked = now;
+        }
+        g_mutex_unlock(&entries_mutex);
+        *gitdir = answer;
+    }
+    else
+    {
+        g_free(answer);
+    }
+
+    g_free(workdir);
+    g_array_unref(mtimes);
+    g_ptr_array_unref(chain);
+    return valid;
+}
+
+/* Forget everything found in a repository that went away */
+static void
+discovery_forget_gitdir(const gchar *gitdir)
+{
+    GHashTableIter iter;
+    gpointer value;
+
+    g_mutex_lock(&entries_mutex);
+    if (entries)
+    {
+        g_hash_table_iter_init(&iter, entries);
+        while (g_hash_table_iter_next(&iter, NULL, &value))
+        {
+            if (strcmp(((DiscoveryEntry *)value)->gitdir, gitdir) == 0)
+                g_hash_table_iter_remove(&iter);
+        }
+    }
+    g_mutex_unlock(&entries_mutex);
+}
+
+static void
+discovery_gitdir_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+                         GFileMonitorEvent event_type, gpointer user_data)
+{
+    gchar *path;
+
+    (void)monitor;
+    (void)other_file;
+
+    if (event_type != G_FILE_MONITOR_EVENT_DELETED)
+        return;
+
+    /* The gitdir itself, not something inside it */
+    path = g_file_get_path(file);
+    if (path && strcmp(path, user_data) == 0)
+        discovery_forget_gitdir(user_data);
+    g_free(path);
+}
+
+static gboolean
+discovery_update_monitors(gpointer user_data)
+{
+    GPtrArray *gitdirs;
+    GHashTable *found;
+    GHashTableIter iter;
+    gpointer key, value;
+
+    (void)user_data;
+
+    g_mutex_lock(&entries_mutex);
+    monitor_source = 0;
+    gitdirs = pending_monitors;
+    pending_monitors = g_ptr_array_new_with_free_func(g_free);
+
+    /* Stop watching repositories nothing in the cache points to anymore */
+    found = g_hash_table_new(g_str_hash, g_str_equal);
+    g_hash_table_iter_init(&iter, entries);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+        g_hash_table_add(found, ((DiscoveryEntry *)value)->gitdir);
+
+    g_hash_table_iter_init(&iter, monitors);
+    while (g_hash_table_iter_next(&iter, &key, NULL))
+    {
+        if (!g_hash_table_contains(found, key))
+            g_hash_table_iter_remove(&iter);
+    }
+    g_hash_table_destroy(found);
+    g_mutex_unlock(&entries_mutex);
+
+    for (guint i = 0; i < gitdirs->len; i++)
+    {
+        const gchar *gitdir = g_ptr_array_index(gitdirs, i);
+        GFileMonitor *monitor;
+        GFile *file;
+        gchar *dir;
+
+        if (g_hash_table_contains(monitors, gitdir))
+            continue;
+
+        dir = discovery_normalize(gitdir);
+        file = g_file_new_for_path(dir);
+        monitor = g_file_monitor_directory(file, G_FILE_MONITOR_NONE, NULL, NULL);
+        g_object_unref(file);
+
+        if (!monitor)
+        {
+            g_free(dir);
+            continue;
+        }
+
+        g_signal_connect_data(monitor, "changed", G_CALLBACK(discovery_gitdir_changed),
+                              dir, (GClosureNotify)g_free, 0);
+        g_hash_table_insert(monitors, g_strdup(gitdir), monitor);
+    }
+
+    g_ptr_array_unref(gitdirs);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+discovery_monitor_free(gpointer data)
+{
+    g_file_monitor_cancel(data);
+    g_object_unref(data);
+}
+
+void
+tgp_discovery_init(void)
+{
+    g_mutex_lock(&entries_mutex);
+    if (!entries)
+    {
+        entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                        discovery_entry_free);
+        monitors = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                         discovery_monitor_free);
+        pending_monitors = g_ptr_array_new_with_free_func(g_free);
+    }
+    g_mutex_unlock(&entries_mutex);
+}
+
+void
+tgp_discovery_shutdown(void)
+{
+    g_mutex_lock(&entries_mutex);
+    if (monitor_source)
+    {
+        g_source_remove(monitor_source);
+        monitor_source = 0;
+    }
+    if (entries)
+    {
+        g_hash_table_destroy(entries);
+        g_hash_table_destroy(monitors);
+        g_ptr_array_unref(pending_monitors);
+        entries = NULL;
+        monitors = NULL;
+        pending_monitors = NULL;
+    }
+    g_mutex_unlock(&entries_mutex);
+}
+
+gchar*
+tgp_discovery_find_gitdir(const gchar *path)
+{
+    gchar *key, *parent, *gitdir = NULL, *workdir = NULL;
+    git_buf repo_path = {0};
+    GPtrArray *walked;
+    GArray *mtimes;
+    gchar *dir;
+
+    g_return_val_if_fail(path != NULL, NULL);
+
+    key = discovery_normalize(path);
+
+    if (discovery_lookup(key, &gitdir))
+    {
+        g_free(key);
+        return gitdir;
+    }
+
+    parent = g_path_get_dirname(key);
+    if (strcmp(parent, key) != 0 && !discovery_may_be_repository(key) &&
+        discovery_lookup(parent, &gitdir))
+    {
+        /* Nothing here of its own, so it belongs where its parent does */
+        gint64 mtime = discovery_get_mtime(key);
+
+        g_mutex_lock(&entries_mutex);
+        if (entries)
+            discovery_remember(key, gitdir, mtime);
+        g_mutex_unlock(&entries_mutex);
+
+        g_free(parent);
+        g_free(key);
+        return gitdir;
+    }
+    g_free(parent);
+
+    if (git_repository_discover(&repo_path, key, 0, tgp_config_get_ceiling_dirs()) == 0)
+    {
+        gitdir = g_strdup(repo_path.ptr);
+        workdir = discovery_workdir_of(gitdir);
+        git_buf_dispose(&repo_path);
+    }
+
+    /* Every directory the walk passed through has the same answer */
+    walked = g_ptr_array_new_with_free_func(g_free);
+    mtimes = g_array_new(FALSE, FALSE, sizeof(gint64));
+    dir = g_strdup(key);
+    while (TRUE)
+    {
+        gint64 mtime;
+        gchar *up;
+
+        /*
+         * A walk from below a ceiling stops there and never looks at it
+         * or above. One starting at a ceiling is a full walk, whose
+         * answer is recorded like any other.
+         */
+        if (strcmp(dir, key) != 0 && tgp_config_is_ceiling_dir(dir))
+            break;
+
+        mtime = discovery_get_mtime(dir);
+        g_ptr_array_add(walked, g_strdup(dir));
+        g_array_append_val(mtimes, mtime);
+
+        if (gitdir && (!workdir || !g_str_has_prefix(dir, workdir) ||
+                       strcmp(dir, workdir) == 0))
+            break;
+
+        up = g_path_get_dirname(dir);
+        if (strcmp(up, dir) == 0)
+        {
+            g_free(up);
+            break;
+        }
+        g_free(dir);
+        dir = up;
+    }
+    g_free(dir);
+
+    g_mutex_lock(&entries_mutex);
+    for (guint i = 0; entries && i < walked->len; i++)
+        discovery_remember(g_ptr_array_index(walked, i), gitdir,
+                           g_array_index(mtimes, gint64, i));
+    g_mutex_unlock(&entries_mutex);
+
+    g_array_unref(mtimes);
+    g_ptr_array_unref(walked);
+    g_free(workdir);
+    g_free(key);
+    return gitdir;
+}
+
+void
+tgp_discovery_invalidate(const gchar *path)
+{
+    gchar *dir;
+
+    g_return_if_fail(path != NULL);
+
+    dir = discovery_normalize(path);
+
+    g_mutex_lock(&entries_mutex);
+    if (entries)
+        discovery_invalidate_locked(dir);
+    g_mutex_unlock(&entries_mutex);
+
+    g_free(dir);
+}
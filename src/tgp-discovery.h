@@ -0,0 +1,31 @@
+/*
+ * Thunar Git Plugin - Repository Discovery Cache
+ * Copyright (C) 2025 MiniMax Agent
+ */
+
+#ifndef __TGP_DISCOVERY_H__
+#define __TGP_DISCOVERY_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Entries kept before the cache starts over */
+#define TGP_DISCOVERY_MAX_ENTRIES 4096
+
+/* Seconds an answer is trusted before the mtimes it depends on are compared */
+#define TGP_DISCOVERY_RECHECK_SECONDS 5
+
+/* Initialize/cleanup */
+void     tgp_discovery_init(void);
+void     tgp_discovery_shutdown(void);
+
+/* Git directory of the repository containing path, NULL if there is none */
+gchar*   tgp_discovery_find_gitdir(const gchar *path);
+
+/* Forget path and everything below it, e.g. after creating a repository there */
+void     tgp_discovery_invalidate(const gchar *path);
+
+G_END_DECLS
+
+#endif /* __TGP_DISCOVERY_H__ */
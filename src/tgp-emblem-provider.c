@@ -1,6 +1,16 @@
 /*
  * Thunar Git Plugin - Emblem Provider Implementation
  * Copyright (C) 2025 MiniMax Agent
+ *
+ * Emblems are stored as GVFS metadata. Thunar does not reliably notice a
+ * metadata write on its own, so the file infos it hands to the menu
+ * provider are remembered through weak references, and whenever an
+ * emblem actually changes, thunarx_file_info_changed() is emitted for
+ * exactly that file from the main loop.
+ *
+ * The flags last written to each path are remembered too. Most writes
+ * repeat what a file already carries, and those are then dropped after a
+ * hash lookup, without asking the metadata store first.
  */
 
 #include "tgp-emblem-provider.h"
@@ -9,98 +19,383 @@
 /* GVFS custom attribute namespace for Git status */
 #define GIT_STATUS_ATTRIBUTE "metadata::git-status"
 #define GIT_EMBLEM_ATTRIBUTE "metadata::git-emblem"
+#define GIT_STALE_ATTRIBUTE  "metadata::git-stale"
 
-const gchar*
-tgp_emblem_get_icon_name(TgpStatusFlags flags)
+static GHashTable *file_infos = NULL;      /* path -> GWeakRef on a ThunarxFileInfo */
+static GHashTable *changed_paths = NULL;   /* Paths to notify, guarded by file_infos_mutex */
+static guint changed_source = 0;           /* Guarded by file_infos_mutex */
+static GMutex file_infos_mutex;
+
+static GHashTable *written_flags = NULL;   /* path -> TgpStatusFlags last written */
+static GMutex written_mutex;
+
+static void
+emblem_weak_ref_free(gpointer data)
+{
+    g_weak_ref_clear(data);
+    g_free(data);
+}
+
+void
+tgp_emblem_init(void)
+{
+    g_mutex_lock(&file_infos_mutex);
+    if (!file_infos)
+    {
+        file_infos = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                           emblem_weak_ref_free);
+        changed_paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    }
+    g_mutex_unlock(&file_infos_mutex);
+
+    g_mutex_lock(&written_mutex);
+    if (!written_flags)
+        written_flags = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    g_mutex_unlock(&written_mutex);
+}
+
+void
+tgp_emblem_shutdown(void)
+{
+    g_mutex_lock(&file_infos_mutex);
+    if (changed_source)
+    {
+        g_source_remove(changed_source);
+        changed_source = 0;
+    }
+    if (file_infos)
+    {
+        g_hash_table_destroy(file_infos);
+        g_hash_table_destroy(changed_paths);
+        file_infos = NULL;
+        changed_paths = NULL;
+    }
+    g_mutex_unlock(&file_infos_mutex);
+
+    g_mutex_lock(&written_mutex);
+    if (written_flags)
+    {
+        g_hash_table_destroy(written_flags);
+        written_flags = NULL;
+    }
+    g_mutex_unlock(&written_mutex);
+}
+
+/* Drop the entries whose file info is gone; file_infos_mutex held */
+static void
+emblem_prune_file_infos(void)
+{
+    GHashTableIter iter;
+    gpointer value;
+
+    g_hash_table_iter_init(&iter, file_infos);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+    {
+        GObject *object = g_weak_ref_get(value);
+
+        if (object)
+            g_object_unref(object);
+        else
+            g_hash_table_iter_remove(&iter);
+    }
+
+    /* All still alive: start over rather than grow without bounds */
+    if (g_hash_table_size(file_infos) >= TGP_EMBLEM_MAX_FILE_INFOS)
+        g_hash_table_remove_all(file_infos);
+}
+
+void
+tgp_emblem_track_file_info(ThunarxFileInfo *file_info)
+{
+    GFile *location;
+    gchar *path;
+    GWeakRef *ref;
+
+    if (!file_info)
+        return;
+
+    location = thunarx_file_info_get_location(file_info);
+    path = location ? g_file_get_path(location) : NULL;
+    if (location)
+        g_object_unref(location);
+    if (!path)
+        return;
+
+    g_mutex_lock(&file_infos_mutex);
+    if (!file_infos)
+    {
+        g_mutex_unlock(&file_infos_mutex);
+        g_free(path);
+        return;
+    }
+
+    if (g_hash_table_size(file_infos) >= TGP_EMBLEM_MAX_FILE_INFOS)
+        emblem_prune_file_infos();
+
+    ref = g_new0(GWeakRef, 1);
+    g_weak_ref_init(ref, file_info);
+    g_hash_table_replace(file_infos, path, ref);
+    g_mutex_unlock(&file_infos_mutex);
+}
+
+static gboolean
+emblem_notify_changed(gpointer user_data)
+{
+    GPtrArray *infos = g_ptr_array_new_with_free_func(g_object_unref);
+    GHashTableIter iter;
+    gpointer path;
+
+    (void)user_data;
+
+    g_mutex_lock(&file_infos_mutex);
+    changed_source = 0;
+    if (changed_paths)
+    {
+        g_hash_table_iter_init(&iter, changed_paths);
+        while (g_hash_table_iter_next(&iter, &path, NULL))
+        {
+            GWeakRef *ref = g_hash_table_lookup(file_infos, path);
+            GObject *object = ref ? g_weak_ref_get(ref) : NULL;
+
+            if (object)
+                g_ptr_array_add(infos, object);
+        }
+        g_hash_table_remove_all(changed_paths);
+    }
+    g_mutex_unlock(&file_infos_mutex);
+
+    /* Outside the lock, handlers may well look at the emblems again */
+    for (guint i = 0; i < infos->len; i++)
+        thunarx_file_info_changed(g_ptr_array_index(infos, i));
+
+    g_ptr_array_unref(infos);
+    return G_SOURCE_REMOVE;
+}
+
+/* Tell Thunar to redraw the file if it handed us its file info */
+static void
+emblem_queue_changed(const gchar *file_path)
 {
-    if (flags & TGP_STATUS_CONFLICTED)
-        return "emblem-git-conflict";
+    g_mutex_lock(&file_infos_mutex);
+    if (file_infos && g_hash_table_contains(file_infos, file_path))
+    {
+        g_hash_table_add(changed_paths, g_strdup(file_path));
+        if (!changed_source)
+            changed_source = g_idle_add(emblem_notify_changed, NULL);
+    }
+    g_mutex_unlock(&file_infos_mutex);
+}
+
+/*
+ * Emblem and status text of every combination of the flags below
+ * TGP_STATUS_STALE, worked out once: the emblem is the first state in
+ * emblem_states that is set, the text lists all the states that are.
+ * Emblem names map back to their state through a perfect hash of the two
+ * letters after the common prefix.
+ */
+#define EMBLEM_PREFIX          "emblem-git-"
+#define EMBLEM_TABLE_SIZE      TGP_STATUS_STALE
+#define EMBLEM_HASH_SIZE       16
+
+#define EMBLEM_HASH(suffix)    (((guchar)(suffix)[0] * 11u + (guchar)(suffix)[1]) % EMBLEM_HASH_SIZE)
+
+typedef struct {
+    TgpStatusFlags  flag;
+    const gchar    *icon_name;
+    const gchar    *text;
+} EmblemState;
+
+/* In order of precedence */
+static const EmblemState emblem_states[] = {
+    { TGP_STATUS_CONFLICTED, EMBLEM_PREFIX "conflict",  "Conflicted" },
+    { TGP_STATUS_MODIFIED,   EMBLEM_PREFIX "modified",  "Modified" },
+    { TGP_STATUS_ADDED,      EMBLEM_PREFIX "added",     "Added" },
+    { TGP_STATUS_DELETED,    EMBLEM_PREFIX "deleted",   "Deleted" },
+    { TGP_STATUS_UNTRACKED,  EMBLEM_PREFIX "untracked", "Untracked" },
+    { TGP_STATUS_IGNORED,    EMBLEM_PREFIX "ignored",   "Ignored" },
+    { TGP_STATUS_AHEAD,      EMBLEM_PREFIX "ahead",     "Ahead" },
+    { TGP_STATUS_BEHIND,     EMBLEM_PREFIX "behind",    "Behind" },
+    { TGP_STATUS_CLEAN,      EMBLEM_PREFIX "clean",     "Clean" },
+};
+
+static guint8 emblem_by_flags[EMBLEM_TABLE_SIZE];          /* 1 + emblem_states index, 0 for none */
+static const gchar *text_by_flags[EMBLEM_TABLE_SIZE];
+static guint8 emblem_by_hash[EMBLEM_HASH_SIZE];            /* 1 + emblem_states index, 0 for none */
+static GStringChunk *emblem_texts = NULL;                  /* Backs text_by_flags, never freed */
+
+static void
+emblem_tables_ensure(void)
+{
+    static gsize initialized = 0;
+    gchar text[128];
+
+    if (!g_once_init_enter(&initialized))
+        return;
 
-    if (flags & TGP_STATUS_MODIFIED)
-        return "emblem-git-modified";
+    emblem_texts = g_string_chunk_new(1024);
 
-    if (flags & TGP_STATUS_ADDED)
-        return "emblem-git-added";
+    for (guint flags = 0; flags < EMBLEM_TABLE_SIZE; flags++)
+    {
+        gsize len = 0;
 
-    if (flags & TGP_STATUS_DELETED)
-        return "emblem-git-deleted";
+        text[0] = '\0';
+        for (guint i = 0; i < G_N_ELEMENTS(emblem_states); i++)
+        {
+            if (!(flags & emblem_states[i].flag))
+                continue;
 
-    if (flags & TGP_STATUS_UNTRACKED)
-        return "emblem-git-untracked";
+            if (!emblem_by_flags[flags])
+                emblem_by_flags[flags] = i + 1;
 
-    if (flags & TGP_STATUS_IGNORED)
-        return "emblem-git-ignored";
+            /* "Clean" ends the list, everything else is followed by a space */
+            len += g_strlcpy(text + len, emblem_states[i].text, sizeof(text) - len);
+            if (emblem_states[i].flag != TGP_STATUS_CLEAN)
+                len += g_strlcpy(text + len, " ", sizeof(text) - len);
+        }
 
-    if (flags & TGP_STATUS_AHEAD)
-        return "emblem-git-ahead";
+        text_by_flags[flags] = g_string_chunk_insert_const(emblem_texts,
+                                                           len > 0 ? text : "Unknown");
+    }
 
-    if (flags & TGP_STATUS_BEHIND)
-        return "emblem-git-behind";
+    for (guint i = 0; i < G_N_ELEMENTS(emblem_states); i++)
+    {
+        guint slot = EMBLEM_HASH(emblem_states[i].icon_name + strlen(EMBLEM_PREFIX));
 
-    if (flags & TGP_STATUS_CLEAN)
-        return "emblem-git-clean";
+        g_assert(emblem_by_hash[slot] == 0);
+        emblem_by_hash[slot] = i + 1;
+    }
 
-    return NULL;
+    g_once_init_leave(&initialized, 1);
 }
 
-gchar*
+const gchar*
+tgp_emblem_get_icon_name(TgpStatusFlags flags)
+{
+    guint8 state;
+
+    emblem_tables_ensure();
+
+    state = emblem_by_flags[flags & (EMBLEM_TABLE_SIZE - 1)];
+    return state ? emblem_states[state - 1].icon_name : NULL;
+}
+
+const gchar*
 tgp_emblem_get_status_text(TgpStatusFlags flags)
 {
-    GString *text = g_string_new("");
+    emblem_tables_ensure();
+
+    return text_by_flags[flags & (EMBLEM_TABLE_SIZE - 1)];
+}
+
+/* Status flag an emblem name stands for, 0 if it isn't one of ours */
+static TgpStatusFlags
+emblem_flag_from_icon_name(const gchar *emblem_name)
+{
+    const gchar *suffix;
+    guint8 state;
 
-    if (flags & TGP_STATUS_CONFLICTED)
-        g_string_append(text, "Conflicted ");
+    if (!emblem_name || strncmp(emblem_name, EMBLEM_PREFIX, strlen(EMBLEM_PREFIX)) != 0)
+        return 0;
 
-    if (flags & TGP_STATUS_MODIFIED)
-        g_string_append(text, "Modified ");
+    suffix = emblem_name + strlen(EMBLEM_PREFIX);
+    if (suffix[0] == '\0')
+        return 0;
 
-    if (flags & TGP_STATUS_ADDED)
-        g_string_append(text, "Added ");
+    emblem_tables_ensure();
 
-    if (flags & TGP_STATUS_DELETED)
-        g_string_append(text, "Deleted ");
+    state = emblem_by_hash[EMBLEM_HASH(suffix)];
+    if (!state || strcmp(emblem_states[state - 1].icon_name, emblem_name) != 0)
+        return 0;
 
-    if (flags & TGP_STATUS_UNTRACKED)
-        g_string_append(text, "Untracked ");
+    return emblem_states[state - 1].flag;
+}
 
-    if (flags & TGP_STATUS_IGNORED)
-        g_string_append(text, "Ignored ");
+/* TRUE if file already carries exactly these attributes */
+static gboolean
+tgp_emblem_attributes_equal(GFile *file, const gchar *emblem_name, const gchar *status_text,
+                            const gchar *stale)
+{
+    GFileInfo *info;
+    gboolean equal;
 
-    if (flags & TGP_STATUS_AHEAD)
-        g_string_append(text, "Ahead ");
+    info = g_file_query_info(file, GIT_EMBLEM_ATTRIBUTE "," GIT_STATUS_ATTRIBUTE ","
+                             GIT_STALE_ATTRIBUTE, G_FILE_QUERY_INFO_NONE, NULL, NULL);
+    if (!info)
+        return FALSE;
 
-    if (flags & TGP_STATUS_BEHIND)
-        g_string_append(text, "Behind ");
+    equal = g_strcmp0(g_file_info_get_attribute_string(info, GIT_EMBLEM_ATTRIBUTE),
+                      emblem_name) == 0 &&
+            g_strcmp0(g_file_info_get_attribute_string(info, GIT_STATUS_ATTRIBUTE),
+                      status_text) == 0 &&
+            g_strcmp0(g_file_info_get_attribute_string(info, GIT_STALE_ATTRIBUTE),
+                      stale) == 0;
 
-    if (flags & TGP_STATUS_CLEAN)
-        g_string_append(text, "Clean");
+    g_object_unref(info);
+    return equal;
+}
+
+/* Whether flags are what was last written to file_path */
+static gboolean
+emblem_written_equal(const gchar *file_path, TgpStatusFlags flags)
+{
+    gpointer known;
+    gboolean equal = FALSE;
+
+    g_mutex_lock(&written_mutex);
+    if (written_flags && g_hash_table_lookup_extended(written_flags, file_path, NULL, &known))
+        equal = GPOINTER_TO_UINT(known) == flags;
+    g_mutex_unlock(&written_mutex);
 
-    if (text->len == 0)
-        g_string_append(text, "Unknown");
+    return equal;
+}
 
-    return g_string_free(text, FALSE);
+static void
+emblem_written_remember(const gchar *file_path, TgpStatusFlags flags)
+{
+    g_mutex_lock(&written_mutex);
+    if (written_flags)
+    {
+        /* Start over rather than grow without bounds */
+        if (g_hash_table_size(written_flags) >= TGP_EMBLEM_MAX_WRITTEN)
+            g_hash_table_remove_all(written_flags);
+        g_hash_table_replace(written_flags, g_strdup(file_path), GUINT_TO_POINTER(flags));
+    }
+    g_mutex_unlock(&written_mutex);
 }
 
 /*
  * Set Git status as GVFS metadata attribute on a file via GFile
- * This allows Thunar and other file managers to display emblems
+ * This allows Thunar and other file managers to display emblems.
+ * Reading the metadata is local while every write is a round trip to the
+ * metadata daemon and a change notification for the file manager, so a
+ * file whose emblem is already right is left alone. A stale status is
+ * written with its emblem and the git-stale attribute set to "true", so
+ * the file manager can tell the last known state from a checked one.
  */
-void
+gboolean
 tgp_emblem_set_git_status_attribute(GFile *file, TgpStatusFlags flags, GError **error)
 {
     GFileInfo *info;
     const gchar *emblem_name;
-    gchar *status_text;
+    const gchar *status_text;
+    const gchar *stale;
+    gboolean success;
 
     if (!file || !G_IS_FILE(file))
-        return;
+        return FALSE;
+
+    stale = (flags & TGP_STATUS_STALE) ? "true" : "false";
+    flags &= ~TGP_STATUS_STALE;
 
     emblem_name = tgp_emblem_get_icon_name(flags);
     if (!emblem_name)
-        return;
+        return FALSE;
 
     status_text = tgp_emblem_get_status_text(flags);
 
+    if (tgp_emblem_attributes_equal(file, emblem_name, status_text, stale))
+        return FALSE;
+
     /* Set custom attributes via GIO */
     info = g_file_info_new();
 
@@ -110,17 +405,22 @@ tgp_emblem_set_git_status_attribute(GFile *file, TgpStatusFlags flags, GError **
     /* Set the status text for tooltips/info */
     g_file_info_set_attribute_string(info, GIT_STATUS_ATTRIBUTE, status_text);
 
+    /* Whether that is only the last known status */
+    g_file_info_set_attribute_string(info, GIT_STALE_ATTRIBUTE, stale);
+
     /* Try to set attributes on the file - this works with GVFS backends that support metadata */
-    g_file_set_attributes_from_info(file, info,
-                                     G_FILE_QUERY_INFO_NONE,
-                                     NULL, error);
+    success = g_file_set_attributes_from_info(file, info,
+                                              G_FILE_QUERY_INFO_NONE,
+                                              NULL, error);
 
     g_object_unref(info);
-    g_free(status_text);
+    return success;
 }
 
 /*
- * Convenience function to set Git status from a file path
+ * Convenience function to set Git status from a file path. Flags already
+ * written to the path cost a hash lookup; the metadata store is only asked
+ * about paths not written since startup.
  */
 void
 tgp_emblem_set_git_status_on_file(const gchar *file_path, TgpStatusFlags flags)
@@ -128,11 +428,17 @@ tgp_emblem_set_git_status_on_file(const gchar *file_path, TgpStatusFlags flags)
     GFile *file;
     GError *error = NULL;
 
-    if (!file_path)
+    if (!file_path || !tgp_emblem_get_icon_name(flags & ~TGP_STATUS_STALE) ||
+        emblem_written_equal(file_path, flags))
         return;
 
     file = g_file_new_for_path(file_path);
-    tgp_emblem_set_git_status_attribute(file, flags, &error);
+    if (tgp_emblem_set_git_status_attribute(file, flags, &error))
+        emblem_queue_changed(file_path);
+
+    /* Writing again won't help a filesystem without metadata, so that is remembered too */
+    if (!error || g_error_matches(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED))
+        emblem_written_remember(file_path, flags);
 
     if (error)
     {
@@ -174,30 +480,9 @@ tgp_emblem_get_git_status_attribute(GFile *file)
     if (!info)
         return flags;
 
+    /* Map emblem names back to status flags */
     emblem_name = g_file_info_get_attribute_string(info, GIT_EMBLEM_ATTRIBUTE);
-
-    if (emblem_name)
-    {
-        /* Map emblem names back to status flags */
-        if (g_strcmp0(emblem_name, "emblem-git-conflict") == 0)
-            flags = TGP_STATUS_CONFLICTED;
-        else if (g_strcmp0(emblem_name, "emblem-git-modified") == 0)
-            flags = TGP_STATUS_MODIFIED;
-        else if (g_strcmp0(emblem_name, "emblem-git-added") == 0)
-            flags = TGP_STATUS_ADDED;
-        else if (g_strcmp0(emblem_name, "emblem-git-deleted") == 0)
-            flags = TGP_STATUS_DELETED;
-        else if (g_strcmp0(emblem_name, "emblem-git-untracked") == 0)
-            flags = TGP_STATUS_UNTRACKED;
-        else if (g_strcmp0(emblem_name, "emblem-git-ignored") == 0)
-            flags = TGP_STATUS_IGNORED;
-        else if (g_strcmp0(emblem_name, "emblem-git-ahead") == 0)
-            flags = TGP_STATUS_AHEAD;
-        else if (g_strcmp0(emblem_name, "emblem-git-behind") == 0)
-            flags = TGP_STATUS_BEHIND;
-        else if (g_strcmp0(emblem_name, "emblem-git-clean") == 0)
-            flags = TGP_STATUS_CLEAN;
-    }
+    flags = emblem_flag_from_icon_name(emblem_name);
 
     g_object_unref(info);
     return flags;
@@ -8,17 +8,34 @@
 
 #include <glib.h>
 #include <gio/gio.h>
+#include <thunarx/thunarx.h>
 #include "tgp-plugin.h"
 
 G_BEGIN_DECLS
 
-/* Emblem icon and status text retrieval */
+/* File infos remembered for change notifications before the table is pruned */
+#define TGP_EMBLEM_MAX_FILE_INFOS 4096
+
+/* Paths whose last written flags are remembered before the table starts over */
+#define TGP_EMBLEM_MAX_WRITTEN    65536
+
+/* Initialize/cleanup */
+void tgp_emblem_init(void);
+void tgp_emblem_shutdown(void);
+
+/* Emblem icon and status text retrieval; static strings, not to be freed */
 const gchar* tgp_emblem_get_icon_name(TgpStatusFlags flags);
-gchar*       tgp_emblem_get_status_text(TgpStatusFlags flags);
+const gchar* tgp_emblem_get_status_text(TgpStatusFlags flags);
 
-/* GVFS attribute setters */
-void tgp_emblem_set_git_status_attribute(GFile *file, TgpStatusFlags flags, GError **error);
-void tgp_emblem_set_git_status_on_file(const gchar *file_path, TgpStatusFlags flags);
+/* GVFS attribute setters; TRUE if the attributes changed */
+gboolean tgp_emblem_set_git_status_attribute(GFile *file, TgpStatusFlags flags, GError **error);
+void     tgp_emblem_set_git_status_on_file(const gchar *file_path, TgpStatusFlags flags);
+
+/*
+ * Remember (weakly) a file info Thunar handed out, so that it can be told
+ * to redraw once its emblem changes.
+ */
+void tgp_emblem_track_file_info(ThunarxFileInfo *file_info);
 
 /* GVFS attribute retrieval */
 TgpStatusFlags tgp_emblem_get_git_status_attribute(GFile *file);
@@ -0,0 +1,379 @@
+/*
+ * Thunar Git Plugin - Per-Repository Executor Implementation
+ * Copyright (C) 2025 MiniMax Agent
+ *
+ * A git_repository handle must never be used by two threads at once, so
+ * every operation used to open a handle of its own and close it again,
+ * rereading config, refs and packs each time. Here each repository gets
+ * a queue and one handle that outlives the operations: the queue is
+ * drained by one thread of a shared pool at a time, so operations on a
+ * repository run in order while different repositories run in parallel.
+ *
+ * Read-only work does not have to wait its turn. It borrows one of a few
+ * extra handles opened on the same repository and runs on the caller's
+ * thread, next to other reads and to the operation the queue is running.
+ * A thread never waits for a handle while it holds one already: nested
+ * reads of the same repository reuse the borrowed handle (or the queue's,
+ * inside a queued operation), and reads of another one get a handle of
+ * their own if none is free, so holders can never wait on each other.
+ *
+ * Handles of repositories nobody used for the longest are closed once
+ * more than TGP_EXECUTOR_MAX_REPOS are open.
+ */
+
+#include "tgp-executor.h"
+#include "tgp-discovery.h"
+#include "tgp-config.h"
+#include <string.h>
+
+typedef struct {
+    TgpExecutorFunc  func;
+    gpointer         user_data;
+    gboolean         ran;
+    gboolean         done;
+} ExecutorTask;
+
+typedef struct {
+    gchar           *gitdir;
+    git_repository  *repo;        /* Only used by the thread draining tasks */
+    GQueue           tasks;       /* ExecutorTask waiting their turn */
+    gboolean         draining;    /* Pushed to the pool or being drained */
+    GSList          *readers;     /* Idle cloned handles */
+    guint            n_readers;   /* Cloned handles, idle or lent out */
+    gint64           last_used;
+} ExecutorRepo;
+
+static GThreadPool *pool = NULL;
+static GHashTable *repos = NULL;          /* gitdir -> ExecutorRepo */
+static GMutex executor_mutex;
+static GCond executor_cond;               /* A task finished or a reader came back */
+static GPrivate current_repo;             /* ExecutorRepo drained by this thread */
+static GPrivate current_read;             /* Innermost ExecutorRead of this thread */
+
+/* A handle borrowed by a thread, on its stack */
+typedef struct _ExecutorRead ExecutorRead;
+struct _ExecutorRead {
+    const gchar     *gitdir;
+    git_repository  *repo;
+    ExecutorRead    *outer;
+};
+
+static void
+executor_repo_free(ExecutorRepo *actor)
+{
+    g_slist_free_full(actor->readers, (GDestroyNotify)git_repository_free);
+    if (actor->repo)
+        git_repository_free(actor->repo);
+    g_free(actor->gitdir);
+    g_free(actor);
+}
+
+static gboolean
+executor_repo_is_idle(const ExecutorRepo *actor)
+{
+    return !actor->draining && g_queue_is_empty(&actor->tasks) &&
+           g_slist_length(actor->readers) == actor->n_readers;
+}
+
+/* Close the handles of the repository unused for the longest; executor_mutex held */
+static void
+executor_evict(void)
+{
+    GHashTableIter iter;
+    gpointer value;
+    ExecutorRepo *oldest = NULL;
+
+    g_hash_table_iter_init(&iter, repos);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+    {
+        ExecutorRepo *actor = value;
+
+        if (executor_repo_is_idle(actor) && (!oldest || actor->last_used < oldest->last_used))
+            oldest = actor;
+    }
+
+    if (oldest)
+        g_hash_table_remove(repos, oldest->gitdir);
+}
+
+/* executor_mutex held */
+static ExecutorRepo*
+executor_lookup(const gchar *gitdir)
+{
+    ExecutorRepo *actor = g_hash_table_lookup(repos, gitdir);
+
+    if (actor)
+        return actor;
+
+    if (g_hash_table_size(repos) >= TGP_EXECUTOR_MAX_REPOS)
+        executor_evict();
+
+    actor = g_new0(ExecutorRepo, 1);
+    actor->gitdir = g_strdup(gitdir);
+    g_queue_init(&actor->tasks);
+    actor->last_used = g_get_monotonic_time();
+    g_hash_table_insert(repos, actor->gitdir, actor);
+
+    return actor;
+}
+
+static void
+executor_drain(gpointer data, gpointer user_data)
+{
+    ExecutorRepo *actor = data;
+    ExecutorTask *task;
+
+    (void)user_data;
+
+    g_private_set(&current_repo, actor);
+
+    g_mutex_lock(&executor_mutex);
+    while ((task = g_queue_pop_head(&actor->tasks)))
+    {
+        g_mutex_unlock(&executor_mutex);
+
+        /* Opened here so that a repository that went away is retried later */
+        if (!actor->repo)
+            git_repository_open(&actor->repo, actor->gitdir);
+        if (actor->repo)
+        {
+            task->func(actor->repo, task->user_data);
+            task->ran = TRUE;
+        }
+
+        g_mutex_lock(&executor_mutex);
+        task->done = TRUE;
+        g_cond_broadcast(&executor_cond);
+    }
+    actor->draining = FALSE;
+    actor->last_used = g_get_monotonic_time();
+    g_mutex_unlock(&executor_mutex);
+
+    g_private_set(&current_repo, NULL);
+}
+
+/* Outside the executor: a handle for this call alone */
+static gboolean
+executor_run_private(const gchar *gitdir, TgpExecutorFunc func, gpointer user_data)
+{
+    git_repository *repo = NULL;
+
+    if (git_repository_open(&repo, gitdir) != 0)
+        return FALSE;
+
+    func(repo, user_data);
+    git_repository_free(repo);
+    return TRUE;
+}
+
+void
+tgp_executor_init(void)
+{
+    g_mutex_lock(&executor_mutex);
+    if (!repos)
+    {
+        repos = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                      (GDestroyNotify)executor_repo_free);
+        pool = g_thread_pool_new(executor_drain, NULL, TGP_EXECUTOR_THREADS, FALSE, NULL);
+    }
+    g_mutex_unlock(&executor_mutex);
+}
+
+void
+tgp_executor_shutdown(void)
+{
+    GThreadPool *old_pool;
+    GHashTable *old_repos;
+
+    /* New calls get private handles from now on */
+    g_mutex_lock(&executor_mutex);
+    old_pool = pool;
+    old_repos = repos;
+    pool = NULL;
+    repos = NULL;
+    g_mutex_unlock(&executor_mutex);
+
+    if (!old_repos)
+        return;
+
+    /* Let queued operations finish; their callers are waiting for them */
+    g_thread_pool_free(old_pool, FALSE, TRUE);
+
+    /* Wait for lent readers to come back before closing them */
+    g_mutex_lock(&executor_mutex);
+    for (;;)
+    {
+        GHashTableIter iter;
+        gpointer value;
+        gboolean lent = FALSE;
+
+        g_hash_table_iter_init(&iter, old_repos);
+        while (!lent && g_hash_table_iter_next(&iter, NULL, &value))
+            lent = !executor_repo_is_idle(value);
+
+        if (!lent)
+            break;
+        g_cond_wait(&executor_cond, &executor_mutex);
+    }
+    g_mutex_unlock(&executor_mutex);
+
+    g_hash_table_destroy(old_repos);
+}
+
+gboolean
+tgp_executor_run(const gchar *path, TgpExecutorFunc func, gpointer user_data)
+{
+    ExecutorRepo *actor;
+    ExecutorRepo *current;
+    ExecutorTask task = { func, user_data, FALSE, FALSE };
+    gchar *gitdir;
+
+    g_return_val_if_fail(path != NULL && func != NULL, FALSE);
+
+    gitdir = tgp_discovery_find_gitdir(path);
+    if (!gitdir)
+        return FALSE;
+
+    /* Nested in an operation on the same repository, which holds its turn */
+    current = g_private_get(&current_repo);
+    if (current && strcmp(current->gitdir, gitdir) == 0)
+    {
+        g_free(gitdir);
+        func(current->repo, user_data);
+        return TRUE;
+    }
+
+    g_mutex_lock(&executor_mutex);
+    if (!repos || current)
+    {
+        /* Waiting for another queue from inside one could tie up the whole pool */
+        g_mutex_unlock(&executor_mutex);
+        task.ran = executor_run_private(gitdir, func, user_data);
+        g_free(gitdir);
+        return task.ran;
+    }
+
+    actor = executor_lookup(gitdir);
+    g_queue_push_tail(&actor->tasks, &task);
+    if (!actor->draining)
+    {
+        actor->draining = TRUE;
+        g_thread_pool_push(pool, actor, NULL);
+    }
+
+    while (!task.done)
+        g_cond_wait(&executor_cond, &executor_mutex);
+    g_mutex_unlock(&executor_mutex);
+
+    g_free(gitdir);
+    return task.ran;
+}
+
+/* The handle this thread already uses for gitdir, if any */
+static git_repository*
+executor_held_handle(const gchar *gitdir)
+{
+    ExecutorRepo *current = g_private_get(&current_repo);
+
+    if (current && strcmp(current->gitdir, gitdir) == 0)
+        return current->repo;
+
+    for (ExecutorRead *read = g_private_get(&current_read); read != NULL; read = read->outer)
+    {
+        if (strcmp(read->gitdir, gitdir) == 0)
+            return read->repo;
+    }
+
+    return NULL;
+}
+
+gboolean
+tgp_executor_run_read(const gchar *path, TgpExecutorFunc func, gpointer user_data)
+{
+    ExecutorRepo *actor;
+    ExecutorRead read = { NULL };
+    git_repository *repo = NULL;
+    guint max_readers = tgp_config_get_read_handles();
+    gboolean holding;
+    gchar *gitdir;
+    gboolean success;
+
+    g_return_val_if_fail(path != NULL && func != NULL, FALSE);
+
+    if (max_readers == 0)
+        return tgp_executor_run(path, func, user_data);
+
+    gitdir = tgp_discovery_find_gitdir(path);
+    if (!gitdir)
+        return FALSE;
+
+    /* Nested in work on the same repository */
+    repo = executor_held_handle(gitdir);
+    if (repo)
+    {
+        g_free(gitdir);
+        func(repo, user_data);
+        return TRUE;
+    }
+
+    holding = g_private_get(&current_repo) || g_private_get(&current_read);
+
+    g_mutex_lock(&executor_mutex);
+    if (!repos)
+    {
+        g_mutex_unlock(&executor_mutex);
+        success = executor_run_private(gitdir, func, user_data);
+        g_free(gitdir);
+        return success;
+    }
+
+    actor = executor_lookup(gitdir);
+    while (!holding && !actor->readers && actor->n_readers >= max_readers)
+        g_cond_wait(&executor_cond, &executor_mutex);
+
+    if (actor->readers)
+    {
+        repo = actor->readers->data;
+        actor->readers = g_slist_delete_link(actor->readers, actor->readers);
+    }
+    else if (actor->n_readers < max_readers)
+    {
+        /* Counted before it is opened, so that the limit holds meanwhile */
+        actor->n_readers++;
+    }
+    else
+    {
+        /* Waiting here could wait on a thread waiting for what we hold */
+        g_mutex_unlock(&executor_mutex);
+        success = executor_run_private(gitdir, func, user_data);
+        g_free(gitdir);
+        return success;
+    }
+    g_mutex_unlock(&executor_mutex);
+
+    if (!repo && git_repository_open(&repo, gitdir) != 0)
+        repo = NULL;
+
+    if (repo)
+    {
+        read.gitdir = gitdir;
+        read.repo = repo;
+        read.outer = g_private_get(&current_read);
+        g_private_set(&current_read, &read);
+        func(repo, user_data);
+        g_private_set(&current_read, read.outer);
+    }
+    success = repo != NULL;
+
+    g_mutex_lock(&executor_mutex);
+    if (repo)
+        actor->readers = g_slist_prepend(actor->readers, repo);
+    else
+        actor->n_readers--;
+    actor->last_used = g_get_monotonic_time();
+    g_cond_broadcast(&executor_cond);
+    g_mutex_unlock(&executor_mutex);
+
+    g_free(gitdir);
+    return success;
+}
@@ -0,0 +1,45 @@
+/*
+ * Thunar Git Plugin - Per-Repository Executor
+ * Copyright (C) 2025 MiniMax Agent
+ */
+
+#ifndef __TGP_EXECUTOR_H__
+#define __TGP_EXECUTOR_H__
+
+#include <glib.h>
+#include <git2.h>
+
+G_BEGIN_DECLS
+
+/* Worker threads shared by the serial queues of all repositories */
+#define TGP_EXECUTOR_THREADS   4
+
+/* Repositories whose handles are kept open while idle */
+#define TGP_EXECUTOR_MAX_REPOS 32
+
+/* Runs with a handle no other thread is using meanwhile */
+typedef void (*TgpExecutorFunc)(git_repository *repo, gpointer user_data);
+
+/* Initialize/cleanup */
+void     tgp_executor_init(void);
+void     tgp_executor_shutdown(void);
+
+/*
+ * Run func on the serial queue of the repository containing path and wait
+ * for it: operations on one repository run one at a time, in order, on a
+ * handle that stays open between them. Returns FALSE without calling func
+ * if path is not inside a repository or it cannot be opened.
+ */
+gboolean tgp_executor_run(const gchar *path, TgpExecutorFunc func, gpointer user_data);
+
+/*
+ * Run read-only func on the calling thread with one of the repository's
+ * cloned handles, alongside other reads; at most ReadHandles of them run
+ * at once. A call nested in work on the same repository reuses its handle.
+ * With ReadHandles=0 this is tgp_executor_run().
+ */
+gboolean tgp_executor_run_read(const gchar *path, TgpExecutorFunc func, gpointer user_data);
+
+G_END_DECLS
+
+#endif /* __TGP_EXECUTOR_H__ */
@@ -0,0 +1,115 @@
+/*
+ * Thunar Git Plugin - Single-Flight Queries Implementation
+ * Copyright (C) 2025 MiniMax Agent
+ *
+ * Several windows, split views and the menu provider tend to ask the same
+ * question about a repository at the same moment. The first caller of a
+ * key computes the answer; callers arriving while it runs wait for it and
+ * get a copy. Once the answer is published the key is free again, so a
+ * later call computes afresh instead of reusing an old answer; caching is
+ * left to the callers.
+ *
+ * The published result is owned by the flight until the last waiter has
+ * copied it, so the first caller is free to drop its own as soon as it
+ * returns.
+ */
+
+#include "tgp-flight.h"
+
+typedef struct {
+    gint            waiters;
+    gboolean        done;
+    gpointer        result;     /* Copy for the waiters */
+    GDestroyNotify  destroy;
+} Flight;
+
+static GHashTable *flights = NULL;   /* key -> Flight, in flight only */
+static GMutex flights_mutex;
+static GCond flights_cond;
+
+static void
+flight_free(Flight *flight)
+{
+    if (flight->result && flight->destroy)
+        flight->destroy(flight->result);
+    g_free(flight);
+}
+
+void
+tgp_flight_init(void)
+{
+    g_mutex_lock(&flights_mutex);
+    if (!flights)
+        flights = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    g_mutex_unlock(&flights_mutex);
+}
+
+void
+tgp_flight_shutdown(void)
+{
+    /* Flights in progress hold no reference to the table */
+    g_mutex_lock(&flights_mutex);
+    if (flights)
+    {
+        g_hash_table_destroy(flights);
+        flights = NULL;
+    }
+    g_mutex_unlock(&flights_mutex);
+}
+
+gpointer
+tgp_flight_do(const gchar *key, TgpFlightFunc func, gpointer user_data,
+              GBoxedCopyFunc copy, GDestroyNotify destroy)
+{
+    Flight *flight;
+    gpointer result;
+
+    g_return_val_if_fail(key != NULL && func != NULL && copy != NULL, NULL);
+
+    g_mutex_lock(&flights_mutex);
+    if (!flights)
+    {
+        g_mutex_unlock(&flights_mutex);
+        return func(user_data);
+    }
+
+    flight = g_hash_table_lookup(flights, key);
+    if (flight)
+    {
+        flight->waiters++;
+        while (!flight->done)
+            g_cond_wait(&flights_cond, &flights_mutex);
+
+        result = flight->result ? copy(flight->result) : NULL;
+        if (--flight->waiters == 0)
+            flight_free(flight);
+        g_mutex_unlock(&flights_mutex);
+
+        return result;
+    }
+
+    flight = g_new0(Flight, 1);
+    flight->destroy = destroy;
+    g_hash_table_insert(flights, g_strdup(key), flight);
+    g_mutex_unlock(&flights_mutex);
+
+    result = func(user_data);
+
+    g_mutex_lock(&flights_mutex);
+    if (flights)
+        g_hash_table_remove(flights, key);
+
+    if (flight->waiters > 0)
+    {
+        flight->result = result ? copy(result) : NULL;
+        flight->done = TRUE;
+        g_cond_broadcast(&flights_cond);
+    }
+    else
+    {
+        flight_free(flight);
+    }
+    g_mutex_unlock(&flights_mutex);
+
+    return result;
+}
@@ -0,0 +1,32 @@
+/*
+ * Thunar Git Plugin - Single-Flight Queries
+ * Copyright (C) 2025 MiniMax Agent
+ */
+
+#ifndef __TGP_FLIGHT_H__
+#define __TGP_FLIGHT_H__
+
+#include <glib.h>
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/* Computes a shared result on the thread of the first caller */
+typedef gpointer (*TgpFlightFunc)(gpointer user_data);
+
+/* Initialize/cleanup */
+void      tgp_flight_init(void);
+void      tgp_flight_shutdown(void);
+
+/*
+ * Run func, unless a call with the same key is in flight already: then
+ * wait for that one and return a copy of its result, made with copy and
+ * released with destroy. The key has to name everything the result
+ * depends on (repository, generation, pathspec).
+ */
+gpointer  tgp_flight_do(const gchar *key, TgpFlightFunc func, gpointer user_data,
+                        GBoxedCopyFunc copy, GDestroyNotify destroy);
+
+G_END_DECLS
+
+#endif /* __TGP_FLIGHT_H__ */
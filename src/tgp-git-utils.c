@@ -5,8 +5,14 @@
 
 #include "tgp-git-utils.h"
 #include "tgp-credentials.h"
+#include "tgp-index-session.h"
+#include "tgp-discovery.h"
+#include "tgp-index-snapshot.h"
+#include "tgp-flight.h"
+#include <glib/gstdio.h>
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
 
 void
 tgp_git_init(void)
@@ -20,16 +26,123 @@ tgp_git_shutdown(void)
     git_libgit2_shutdown();
 }
 
+/*
+ * Index mutations are batched by the index session; anything that reads
+ * .git/index from disk has to see them first.
+ */
+static void
+tgp_git_sync_index(git_repository *repo)
+{
+    GError *error = NULL;
+
+    if (!tgp_index_session_flush(repo, &error))
+    {
+        g_warning("%s", error->message);
+        g_error_free(error);
+    }
+}
+
+static GPtrArray*
+tgp_git_relative_paths(git_repository *repo, GList *files)
+{
+    GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
+    const gchar *workdir = git_repository_workdir(repo);
+    gsize workdir_len = workdir ? strlen(workdir) : 0;
+
+    for (GList *l = files; l != NULL; l = l->next)
+    {
+        const gchar *file = l->data;
+
+        if (workdir && g_str_has_prefix(file, workdir))
+            g_ptr_array_add(paths, g_strdup(file + workdir_len));
+        else if (workdir_len > 1 && strlen(file) == workdir_len - 1 &&
+                 strncmp(file, workdir, workdir_len - 1) == 0)
+            g_ptr_array_add(paths, g_strdup(""));  /* The workdir itself */
+        else
+            g_ptr_array_add(paths, g_strdup(file));
+    }
+
+    return paths;
+}
+
+typedef struct {
+    TgpCheckoutNotifyFunc func;
+    TgpProgressFunc       progress;
+    gpointer              user_data;
+    guint                 n_updated;
+} TgpCheckoutNotify;
+
+static int
+tgp_git_checkout_notify_cb(git_checkout_notify_t why, const char *path,
+                           const git_diff_file *baseline, const git_diff_file *target,
+                           const git_diff_file *workdir, void *payload)
+{
+    TgpCheckoutNotify *notify = payload;
+
+    (void)baseline;
+    (void)target;
+    (void)workdir;
+
+    if (why == GIT_CHECKOUT_NOTIFY_UPDATED)
+    {
+        notify->n_updated++;
+        if (notify->func)
+            notify->func(path, notify->n_updated, notify->user_data);
+    }
+
+    return 0;
+}
+
+static void
+tgp_git_checkout_progress_cb(const char *path, size_t completed_steps,
+                             size_t total_steps, void *payload)
+{
+    TgpCheckoutNotify *notify = payload;
+
+    (void)path;
+
+    if (notify->progress)
+        notify->progress(completed_steps, total_steps, notify->user_data);
+}
+
+static void
+tgp_git_checkout_options_set_notify(git_checkout_options *opts, TgpCheckoutNotify *notify)
+{
+    opts->notify_flags = GIT_CHECKOUT_NOTIFY_UPDATED;
+    opts->notify_cb = tgp_git_checkout_notify_cb;
+    opts->notify_payload = notify;
+    opts->progress_cb = tgp_git_checkout_progress_cb;
+    opts->progress_payload = notify;
+}
+
+/* TgpCheckoutNotifyFunc gathering rewritten paths into a touched array */
+static void
+tgp_git_collect_touched(const gchar *path, guint n_updated, gpointer user_data)
+{
+    (void)n_updated;
+    g_ptr_array_add(user_data, g_strdup(path));
+}
+
+static void
+tgp_git_add_touched(GPtrArray *touched, GPtrArray *paths)
+{
+    if (!touched)
+        return;
+
+    for (guint i = 0; i < paths->len; i++)
+        g_ptr_array_add(touched, g_strdup(g_ptr_array_index(paths, i)));
+}
+
 git_repository*
 tgp_git_open_repository(const gchar *path)
 {
     git_repository *repo = NULL;
-    git_buf repo_path = {0};
+    gchar *gitdir = tgp_discovery_find_gitdir(path);
     
-    if (git_repository_discover(&repo_path, path, 0, NULL) == 0)
+    if (gitdir)
     {
-        git_repository_open(&repo, repo_path.ptr);
-        git_buf_dispose(&repo_path);
+        git_repository_open(&repo, gitdir);
+        g_free(gitdir);
     }
     
     return repo;
@@ -50,68 +163,36 @@ tgp_git_is_repository(const gchar *path)
 gchar*
 tgp_git_find_repository_root(const gchar *path)
 {
-    git_buf repo_path = {0};
-    gchar *result = NULL;
-    
-    if (git_repository_discover(&repo_path, path, 0, NULL) == 0)
-    {
-        result = g_strdup(repo_path.ptr);
-        git_buf_dispose(&repo_path);
-    }
-    
-    return result;
+    return tgp_discovery_find_gitdir(path);
 }
 
+/* Map libgit2 git_status_t bits to the emblem status flags */
 TgpStatusFlags
-tgp_git_get_file_status(git_repository *repo, const gchar *path)
+tgp_git_status_to_flags(unsigned int status_flags)
 {
     TgpStatusFlags flags = 0;
-    unsigned int status_flags;
-    const gchar *workdir;
-    gchar *relative_path;
+
+    if (status_flags & GIT_STATUS_INDEX_NEW || status_flags & GIT_STATUS_WT_NEW)
+        flags |= TGP_STATUS_UNTRACKED;
     
-    if (!repo || !path)
-        return flags;
+    if (status_flags & GIT_STATUS_INDEX_MODIFIED || status_flags & GIT_STATUS_WT_MODIFIED)
+        flags |= TGP_STATUS_MODIFIED;
     
-    workdir = git_repository_workdir(repo);
-    if (!workdir)
-        return flags;
+    if (status_flags & GIT_STATUS_INDEX_DELETED || status_flags & GIT_STATUS_WT_DELETED)
+        flags |= TGP_STATUS_DELETED;
     
-    /* Get relative path from repository root */
-    if (g_str_has_prefix(path, workdir))
-    {
-        relative_path = g_strdup(path + strlen(workdir));
-    }
-    else
-    {
-        relative_path = g_strdup(path);
-    }
+    if (status_flags & GIT_STATUS_INDEX_RENAMED || status_flags & GIT_STATUS_WT_RENAMED)
+        flags |= TGP_STATUS_RENAMED;
     
-    if (git_status_file(&status_flags, repo, relative_path) == 0)
-    {
-        if (status_flags & GIT_STATUS_INDEX_NEW || status_flags & GIT_STATUS_WT_NEW)
-            flags |= TGP_STATUS_UNTRACKED;
-        
-        if (status_flags & GIT_STATUS_INDEX_MODIFIED || status_flags & GIT_STATUS_WT_MODIFIED)
-            flags |= TGP_STATUS_MODIFIED;
-        
-        if (status_flags & GIT_STATUS_INDEX_DELETED || status_flags & GIT_STATUS_WT_DELETED)
-            flags |= TGP_STATUS_DELETED;
-        
-        if (status_flags & GIT_STATUS_INDEX_RENAMED || status_flags & GIT_STATUS_WT_RENAMED)
-            flags |= TGP_STATUS_RENAMED;
-        
-        if (status_flags & GIT_STATUS_CONFLICTED)
-            flags |= TGP_STATUS_CONFLICTED;
-        
-        if (status_flags & GIT_STATUS_IGNORED)
-            flags |= TGP_STATUS_IGNORED;
-        
-        if (status_flags == GIT_STATUS_CURRENT)
-            flags |= TGP_STATUS_CLEAN;
-    }
+    if (status_flags & GIT_STATUS_CONFLICTED)
+        flags |= TGP_STATUS_CONFLICTED;
+    
+    if (status_flags & GIT_STATUS_IGNORED)
+        flags |= TGP_STATUS_IGNORED;
     
-    g_free(relative_path);
+    if (status_flags == GIT_STATUS_CURRENT)
+        flags |= TGP_STATUS_CLEAN;
+
     return flags;
 }
 
@@ -126,6 +207,8 @@ tgp_git_has_uncommitted_changes(git_repository *repo)
     opts.show = GIT_STATUS_SHOW_INDEX_AND_WORKDIR;
     opts.flags = GIT_STATUS_OPT_INCLUDE_UNTRACKED;
     
+    tgp_git_sync_index(repo);
+    
     if (git_status_list_new(&status_list, repo, &opts) == 0)
     {
         size_t count = git_status_list_entrycount(status_list);
@@ -168,14 +251,14 @@ cleanup:
     return result;
 }
 
-gchar*
-tgp_git_get_current_branch(git_repository *repo)
+static gpointer
+tgp_git_get_current_branch_flight(gpointer user_data)
 {
     git_reference *head = NULL;
     const gchar *branch_name = NULL;
     gchar *result = NULL;
     
-    if (git_repository_head(&head, repo) == 0)
+    if (git_repository_head(&head, user_data) == 0)
     {
         if (git_branch_name(&branch_name, head) == 0)
         {
@@ -187,64 +270,78 @@ tgp_git_get_current_branch(git_repository *repo)
     return result;
 }
 
+gchar*
+tgp_git_get_current_branch(git_repository *repo)
+{
+    gchar *head_path = g_build_filename(git_repository_path(repo), "HEAD", NULL);
+    gchar *key;
+    gchar *result;
+    GStatBuf st;
+
+    /* Callers asking at the same time about the same HEAD share one lookup */
+    if (g_stat(head_path, &st) != 0)
+        memset(&st, 0, sizeof(st));
+    key = g_strdup_printf("branch:%s:%" G_GINT64_FORMAT ".%09ld:%" G_GINT64_FORMAT,
+                          git_repository_path(repo), (gint64)st.st_mtim.tv_sec,
+                          (long)st.st_mtim.tv_nsec, (gint64)st.st_size);
+    result = tgp_flight_do(key, tgp_git_get_current_branch_flight, repo,
+                           (GBoxedCopyFunc)g_strdup, g_free);
+
+    g_free(key);
+    g_free(head_path);
+    return result;
+}
+
 gboolean
-tgp_git_add_files(git_repository *repo, GList *files, GError **error)
+tgp_git_add_files(git_repository *repo, GList *files, GPtrArray *touched, GError **error)
 {
-    git_index *index;
-    const gchar *workdir;
-    gboolean success = TRUE;
-    
-    if (git_repository_index(&index, repo) != 0)
-    {
-        g_set_error(error, 0, 0, "Failed to open repository index");
-        return FALSE;
-    }
-    
-    workdir = git_repository_workdir(repo);
-    
-    for (GList *l = files; l != NULL; l = l->next)
-    {
-        const gchar *file = l->data;
-        gchar *relative_path;
-        
-        if (g_str_has_prefix(file, workdir))
-            relative_path = g_strdup(file + strlen(workdir));
-        else
-            relative_path = g_strdup(file);
-        
-        if (git_index_add_bypath(index, relative_path) != 0)
-        {
-            g_set_error(error, 0, 0, "Failed to add file: %s", relative_path);
-            success = FALSE;
-            g_free(relative_path);
-            break;
-        }
-        
-        g_free(relative_path);
-    }
-    
+    GPtrArray *paths = tgp_git_relative_paths(repo, files);
+    gboolean success = tgp_index_session_add_paths(repo, paths, error);
+
     if (success)
+        tgp_git_add_touched(touched, paths);
+
+    g_ptr_array_unref(paths);
+    return success;
+}
+
+/* Paths that differ between two trees (old_tree NULL for a root commit) */
+static void
+tgp_git_collect_tree_changes(git_repository *repo, git_tree *old_tree, git_tree *new_tree,
+                             GPtrArray *touched)
+{
+    git_diff *diff = NULL;
+
+    if (!touched || git_diff_tree_to_tree(&diff, repo, old_tree, new_tree, NULL) != 0)
+        return;
+
+    for (size_t i = 0; i < git_diff_num_deltas(diff); i++)
     {
-        git_index_write(index);
+        const git_diff_delta *delta = git_diff_get_delta(diff, i);
+
+        g_ptr_array_add(touched, g_strdup(delta->new_file.path));
+        if (strcmp(delta->old_file.path, delta->new_file.path) != 0)
+            g_ptr_array_add(touched, g_strdup(delta->old_file.path));
     }
-    
-    git_index_free(index);
-    return success;
+
+    git_diff_free(diff);
 }
 
 gboolean
-tgp_git_commit(git_repository *repo, const gchar *message, GList *files, GError **error)
+tgp_git_commit(git_repository *repo, const gchar *message, GList *files,
+               GPtrArray *touched, GError **error)
 {
     git_signature *sig = NULL;
     git_index *index = NULL;
     git_oid tree_id, commit_id;
     git_tree *tree = NULL;
+    git_tree *parent_tree = NULL;
     git_reference *head = NULL;
     git_commit *parent = NULL;
     gboolean success = FALSE;
     
     /* Add files first */
-    if (files && !tgp_git_add_files(repo, files, error))
+    if (files && !tgp_git_add_files(repo, files, NULL, error))
         return FALSE;
     
     /* Get default signature */
@@ -255,12 +352,17 @@ tgp_git_commit(git_repository *repo, const gchar *message, GList *files, GError
     }
     
     /* Get the index and create tree */
+    tgp_git_sync_index(repo);
+    
     if (git_repository_index(&index, repo) != 0)
     {
         g_set_error(error, 0, 0, "Failed to open index");
         goto cleanup;
     }
     
+    /* The handle may have loaded the index before the session wrote it */
+    git_index_read(index, FALSE);
+    
     if (git_index_write_tree(&tree_id, index) != 0)
     {
         g_set_error(error, 0, 0, "Failed to write tree");
@@ -284,6 +386,11 @@ tgp_git_commit(git_repository *repo, const gchar *message, GList *files, GError
                             NULL, message, tree, parent ? 1 : 0, parent) == 0)
     {
         success = TRUE;
+
+        /* Everything staged went from "added/modified" to clean */
+        if (parent)
+            git_commit_tree(&parent_tree, parent);
+        tgp_git_collect_tree_changes(repo, parent_tree, tree, touched);
     }
     else
     {
@@ -293,6 +400,7 @@ tgp_git_commit(git_repository *repo, const gchar *message, GList *files, GError
 cleanup:
     if (sig) git_signature_free(sig);
     if (index) git_index_free(index);
+    if (parent_tree) git_tree_free(parent_tree);
     if (tree) git_tree_free(tree);
     if (head) git_reference_free(head);
     if (parent) git_commit_free(parent);
@@ -315,6 +423,7 @@ tgp_git_clone(const gchar *url, const gchar *path, GError **error)
         return FALSE;
     }
     
+    tgp_discovery_invalidate(path);
     git_repository_free(repo);
     return TRUE;
 }
@@ -356,27 +465,245 @@ tgp_git_push(git_repository *repo, const gchar *remote_name, const gchar *branch
     return success;
 }
 
+/*
+ * Conclude a merge started by git_merge(): write the merged index as a
+ * two-parent commit and clear the merge state. Conflicts are not an error;
+ * they are left in place, together with the merge state, for the user to
+ * resolve and commit.
+ */
+static gboolean
+tgp_git_commit_merge(git_repository *repo, git_annotated_commit *their_head,
+                     const gchar *their_name, GError **error)
+{
+    git_index *index = NULL;
+    git_signature *sig = NULL;
+    git_reference *head = NULL;
+    git_commit *parents[2] = { NULL, NULL };
+    git_tree *tree = NULL;
+    git_oid tree_id, commit_id;
+    gchar *message = NULL;
+    gboolean success = FALSE;
+
+    if (git_repository_index(&index, repo) != 0)
+    {
+        g_set_error(error, 0, 0, "Failed to open index");
+        goto cleanup;
+    }
+
+    if (git_index_has_conflicts(index))
+    {
+        success = TRUE;
+        goto cleanup;
+    }
+
+    if (git_signature_default(&sig, repo) != 0)
+    {
+        g_set_error(error, 0, 0, "Failed to create signature");
+        goto cleanup;
+    }
+
+    if (git_repository_head(&head, repo) != 0 ||
+        git_commit_lookup(&parents[0], repo, git_reference_target(head)) != 0 ||
+        git_commit_lookup(&parents[1], repo, git_annotated_commit_id(their_head)) != 0)
+    {
+        g_set_error(error, 0, 0, "Failed to lookup merge parents");
+        goto cleanup;
+    }
+
+    if (git_index_write_tree(&tree_id, index) != 0 ||
+        git_tree_lookup(&tree, repo, &tree_id) != 0)
+    {
+        g_set_error(error, 0, 0, "Failed to write tree");
+        goto cleanup;
+    }
+
+    message = g_strdup_printf("Merge %s", their_name);
+
+    if (git_commit_create(&commit_id, repo, "HEAD", sig, sig, NULL, message, tree,
+                          2, (const git_commit **)parents) != 0)
+    {
+        g_set_error(error, 0, 0, "Failed to create merge commit");
+        goto cleanup;
+    }
+
+    git_repository_state_cleanup(repo);
+    success = TRUE;
+
+cleanup:
+    if (index) git_index_free(index);
+    if (sig) git_signature_free(sig);
+    if (head) git_reference_free(head);
+    if (parents[0]) git_commit_free(parents[0]);
+    if (parents[1]) git_commit_free(parents[1]);
+    if (tree) git_tree_free(tree);
+    g_free(message);
+
+    return success;
+}
+
+/*
+ * Integrate refs/remotes/<remote>/<branch> into the current branch after a
+ * fetch. git_merge_analysis decides the cheapest way: nothing to do, a
+ * fast-forward (move the branch ref and check out only what changed between
+ * the two trees), or a real merge that ends in a merge commit.
+ */
+static gboolean
+tgp_git_merge_fetched(git_repository *repo, const gchar *remote_name, const gchar *branch,
+                      TgpCheckoutNotify *notify, GError **error)
+{
+    git_reference *remote_ref = NULL;
+    git_reference *head = NULL;
+    git_reference *new_ref = NULL;
+    git_annotated_commit *their_head = NULL;
+    git_merge_analysis_t analysis;
+    git_merge_preference_t preference;
+    git_checkout_options checkout_opts;
+    const git_oid *their_oid;
+    gchar *remote_ref_name;
+    gchar *current_branch = NULL;
+    gboolean success = FALSE;
+
+    if (!branch)
+    {
+        current_branch = tgp_git_get_current_branch(repo);
+        branch = current_branch;
+    }
+
+    if (!branch)
+    {
+        g_set_error(error, 0, 0, "No branch to pull into");
+        return FALSE;
+    }
+
+    remote_ref_name = g_strdup_printf("refs/remotes/%s/%s", remote_name, branch);
+
+    if (git_reference_lookup(&remote_ref, repo, remote_ref_name) != 0)
+    {
+        g_set_error(error, 0, 0, "Remote reference '%s' not found", remote_ref_name);
+        goto cleanup;
+    }
+
+    if (git_annotated_commit_from_ref(&their_head, repo, remote_ref) != 0)
+    {
+        g_set_error(error, 0, 0, "Failed to resolve remote reference '%s'", remote_ref_name);
+        goto cleanup;
+    }
+
+    tgp_git_sync_index(repo);
+
+    if (git_merge_analysis(&analysis, &preference, repo,
+                           (const git_annotated_commit **)&their_head, 1) != 0)
+    {
+        const git_error *e = git_error_last();
+        g_set_error(error, 0, 0, "Merge analysis failed: %s", e ? e->message : "unknown error");
+        goto cleanup;
+    }
+
+    their_oid = git_annotated_commit_id(their_head);
+
+    git_checkout_options_init(&checkout_opts, GIT_CHECKOUT_OPTIONS_VERSION);
+    checkout_opts.checkout_strategy = GIT_CHECKOUT_SAFE;
+    if (notify)
+        tgp_git_checkout_options_set_notify(&checkout_opts, notify);
+
+    if (analysis & GIT_MERGE_ANALYSIS_UP_TO_DATE)
+    {
+        success = TRUE;
+    }
+    else if ((analysis & (GIT_MERGE_ANALYSIS_FASTFORWARD | GIT_MERGE_ANALYSIS_UNBORN)) &&
+             !(preference & GIT_MERGE_PREFERENCE_NO_FASTFORWARD))
+    {
+        git_object *target = NULL;
+        gchar *log_message = g_strdup_printf("pull: Fast-forward to %s", remote_ref_name);
+
+        /* Checkout against the current HEAD only rewrites what differs */
+        if (git_object_lookup(&target, repo, their_oid, GIT_OBJECT_COMMIT) != 0 ||
+            git_checkout_tree(repo, target, &checkout_opts) != 0)
+        {
+            const git_error *e = git_error_last();
+            g_set_error(error, 0, 0, "Fast-forward failed: %s", e ? e->message : "unknown error");
+        }
+        else if (analysis & GIT_MERGE_ANALYSIS_UNBORN)
+        {
+            gchar *branch_ref_name = g_strdup_printf("refs/heads/%s", branch);
+            if (git_reference_create(&new_ref, repo, branch_ref_name, their_oid, 0, log_message) == 0)
+                success = TRUE;
+            else
+                g_set_error(error, 0, 0, "Failed to create branch '%s'", branch);
+            g_free(branch_ref_name);
+        }
+        else if (git_repository_head(&head, repo) == 0 &&
+                 git_reference_set_target(&new_ref, head, their_oid, log_message) == 0)
+        {
+            success = TRUE;
+        }
+        else
+        {
+            g_set_error(error, 0, 0, "Failed to update branch '%s'", branch);
+        }
+
+        if (target)
+            git_object_free(target);
+        g_free(log_message);
+    }
+    else if (preference & GIT_MERGE_PREFERENCE_FASTFORWARD_ONLY)
+    {
+        g_set_error(error, 0, 0, "Branches have diverged and only fast-forward pulls are allowed");
+    }
+    else
+    {
+        git_merge_options merge_opts;
+
+        git_merge_options_init(&merge_opts, GIT_MERGE_OPTIONS_VERSION);
+        checkout_opts.checkout_strategy = GIT_CHECKOUT_SAFE | GIT_CHECKOUT_ALLOW_CONFLICTS;
+
+        if (git_merge(repo, (const git_annotated_commit **)&their_head, 1,
+                      &merge_opts, &checkout_opts) != 0)
+        {
+            const git_error *e = git_error_last();
+            g_set_error(error, 0, 0, "Merge failed: %s", e ? e->message : "unknown error");
+        }
+        else
+        {
+            success = tgp_git_commit_merge(repo, their_head, remote_ref_name, error);
+        }
+    }
+
+cleanup:
+    if (new_ref) git_reference_free(new_ref);
+    if (head) git_reference_free(head);
+    if (their_head) git_annotated_commit_free(their_head);
+    if (remote_ref) git_reference_free(remote_ref);
+    g_free(remote_ref_name);
+    g_free(current_branch);
+
+    return success;
+}
+
 gboolean
-tgp_git_pull(git_repository *repo, const gchar *remote_name, const gchar *branch, GError **error)
+tgp_git_pull(git_repository *repo, const gchar *remote_name, const gchar *branch,
+             GPtrArray *touched, GError **error)
 {
+    TgpCheckoutNotify notify = { tgp_git_collect_touched, NULL, touched, 0 };
     git_remote *remote = NULL;
     git_fetch_options fetch_opts;
     gboolean success = FALSE;
 
     git_fetch_options_init(&fetch_opts, GIT_FETCH_OPTIONS_VERSION);
 
-    if (git_remote_lookup(&remote, repo, remote_name ? remote_name : "origin") != 0)
+    if (!remote_name)
+        remote_name = "origin";
+
+    if (git_remote_lookup(&remote, repo, remote_name) != 0)
     {
         g_set_error(error, 0, 0, "Failed to lookup remote");
         return FALSE;
     }
 
-    (void)branch;
-
     if (git_remote_fetch(remote, NULL, &fetch_opts, NULL) == 0)
     {
-        /* TODO: Implement merge after fetch */
-        success = TRUE;
+        success = tgp_git_merge_fetched(repo, remote_name, branch,
+                                        touched ? &notify : NULL, error);
     }
     else
     {
@@ -391,23 +718,42 @@ tgp_git_pull(git_repository *repo, const gchar *remote_name, const gchar *branch
 gboolean
 tgp_git_has_conflicts(git_repository *repo)
 {
-    git_index *index;
+    TgpIndexSnapshot *snapshot;
     gboolean has_conflicts = FALSE;
     
-    if (git_repository_index(&index, repo) == 0)
+    tgp_git_sync_index(repo);
+    
+    /* Computed once whenever the index file is reloaded */
+    snapshot = tgp_index_snapshot_get(repo);
+    if (snapshot)
     {
-        has_conflicts = git_index_has_conflicts(index);
-        git_index_free(index);
+        has_conflicts = snapshot->has_conflicts;
+        tgp_index_snapshot_unref(snapshot);
     }
     
     return has_conflicts;
 }
 
+static int
+tgp_git_collect_status_path(const char *path, unsigned int status_flags, void *payload)
+{
+    (void)status_flags;
+    g_ptr_array_add(payload, g_strdup(path));
+    return 0;
+}
+
+/*
+ * Stash tracked changes. git_stash_save() has no checkout callbacks, so the
+ * paths it resets are taken from a status run beforehand and reported to
+ * notify once the stash exists.
+ */
 gboolean
-tgp_git_stash(git_repository *repo, const gchar *message, GError **error)
+tgp_git_stash(git_repository *repo, const gchar *message,
+              TgpCheckoutNotifyFunc notify, gpointer user_data, GError **error)
 {
     git_signature *sig = NULL;
     git_oid stash_id;
+    GPtrArray *paths = NULL;
     gboolean success = FALSE;
     
     if (git_signature_default(&sig, repo) != 0)
@@ -416,27 +762,53 @@ tgp_git_stash(git_repository *repo, const gchar *message, GError **error)
         return FALSE;
     }
     
+    tgp_git_sync_index(repo);
+    
+    if (notify)
+    {
+        git_status_options opts;
+
+        git_status_options_init(&opts, GIT_STATUS_OPTIONS_VERSION);
+        opts.show = GIT_STATUS_SHOW_INDEX_AND_WORKDIR;
+        opts.flags = 0;
+
+        paths = g_ptr_array_new_with_free_func(g_free);
+        git_status_foreach_ext(repo, &opts, tgp_git_collect_status_path, paths);
+    }
+    
     if (git_stash_save(&stash_id, repo, sig, message, GIT_STASH_DEFAULT) == 0)
     {
         success = TRUE;
+
+        for (guint i = 0; paths && i < paths->len; i++)
+            notify(g_ptr_array_index(paths, i), i + 1, user_data);
     }
     else
     {
-        g_set_error(error, 0, 0, "Failed to create stash");
+        const git_error *e = git_error_last();
+        g_set_error(error, 0, 0, "Failed to create stash: %s", e ? e->message : "unknown error");
     }
     
+    if (paths)
+        g_ptr_array_unref(paths);
     git_signature_free(sig);
     return success;
 }
 
 gboolean
-tgp_git_stash_pop(git_repository *repo, GError **error)
+tgp_git_stash_pop(git_repository *repo, gsize index,
+                  TgpCheckoutNotifyFunc notify, TgpProgressFunc progress,
+                  gpointer user_data, GError **error)
 {
     git_stash_apply_options opts;
+    TgpCheckoutNotify payload = { notify, progress, user_data, 0 };
 
     git_stash_apply_options_init(&opts, GIT_STASH_APPLY_OPTIONS_VERSION);
+    tgp_git_checkout_options_set_notify(&opts.checkout_options, &payload);
+
+    tgp_git_sync_index(repo);
 
-    if (git_stash_pop(repo, 0, &opts) != 0)
+    if (git_stash_pop(repo, index, &opts) != 0)
     {
         const git_error *e = git_error_last();
         g_set_error(error, 0, 0, "Stash pop failed: %s", e ? e->message : "unknown error");
@@ -446,6 +818,111 @@ tgp_git_stash_pop(git_repository *repo, GError **error)
     return TRUE;
 }
 
+static int
+tgp_git_stash_foreach_cb(size_t index, const char *message, const git_oid *stash_id, void *payload)
+{
+    TgpStashList *list = payload;
+    TgpStashEntry entry;
+
+    entry.index = index;
+    git_oid_cpy(&entry.id, stash_id);
+    entry.message_offset = list->messages->len;
+
+    g_string_append(list->messages, message ? message : "");
+    g_string_append_c(list->messages, '\0');
+    g_array_append_val(list->entries, entry);
+
+    return 0;
+}
+
+TgpStashList*
+tgp_git_get_stashes(git_repository *repo)
+{
+    TgpStashList *list = g_new0(TgpStashList, 1);
+
+    list->entries = g_array_new(FALSE, FALSE, sizeof(TgpStashEntry));
+    list->messages = g_string_new(NULL);
+
+    if (repo)
+        git_stash_foreach(repo, tgp_git_stash_foreach_cb, list);
+
+    return list;
+}
+
+const gchar*
+tgp_stash_list_get_message(TgpStashList *list, guint i)
+{
+    g_return_val_if_fail(list != NULL && i < list->entries->len, NULL);
+
+    return list->messages->str + g_array_index(list->entries, TgpStashEntry, i).message_offset;
+}
+
+void
+tgp_stash_list_free(TgpStashList *list)
+{
+    if (!list)
+        return;
+
+    g_array_unref(list->entries);
+    g_string_free(list->messages, TRUE);
+    g_free(list);
+}
+
+static int
+tgp_git_diff_append_line(const git_diff_delta *delta, const git_diff_hunk *hunk,
+                         const git_diff_line *line, void *payload)
+{
+    GString *text = payload;
+
+    (void)delta;
+    (void)hunk;
+
+    if (line->origin == GIT_DIFF_LINE_CONTEXT ||
+        line->origin == GIT_DIFF_LINE_ADDITION ||
+        line->origin == GIT_DIFF_LINE_DELETION)
+        g_string_append_c(text, line->origin);
+
+    g_string_append_len(text, line->content, line->content_len);
+    return 0;
+}
+
+/*
+ * Patch of a stash against the commit it was taken on. Stashes can be
+ * large, so this is only computed for the entry the user looks at.
+ */
+gchar*
+tgp_git_get_stash_diff(git_repository *repo, const git_oid *stash_id)
+{
+    git_commit *stash = NULL;
+    git_commit *base = NULL;
+    git_tree *stash_tree = NULL;
+    git_tree *base_tree = NULL;
+    git_diff *diff = NULL;
+    GString *text = g_string_new("");
+
+    if (git_commit_lookup(&stash, repo, stash_id) == 0 &&
+        git_commit_parent(&base, stash, 0) == 0 &&
+        git_commit_tree(&stash_tree, stash) == 0 &&
+        git_commit_tree(&base_tree, base) == 0 &&
+        git_diff_tree_to_tree(&diff, repo, base_tree, stash_tree, NULL) == 0)
+    {
+        git_diff_print(diff, GIT_DIFF_FORMAT_PATCH, tgp_git_diff_append_line, text);
+    }
+
+    if (diff) git_diff_free(diff);
+    if (base_tree) git_tree_free(base_tree);
+    if (stash_tree) git_tree_free(stash_tree);
+    if (base) git_commit_free(base);
+    if (stash) git_commit_free(stash);
+
+    if (text->len == 0)
+    {
+        g_string_free(text, TRUE);
+        return NULL;
+    }
+
+    return g_string_free(text, FALSE);
+}
 
 gchar*
 tgp_git_get_diff(git_repository *repo, const gchar *path)
@@ -456,6 +933,8 @@ tgp_git_get_diff(git_repository *repo, const gchar *path)
 
     git_diff_options_init(&diff_opts, GIT_DIFF_OPTIONS_VERSION);
 
+    tgp_git_sync_index(repo);
+
     /* Get diff between HEAD and working directory */
     if (git_diff_index_to_workdir(&diff, repo, NULL, &diff_opts) == 0)
     {
@@ -518,16 +997,24 @@ tgp_git_get_branches(git_repository *repo)
     return branches;
 }
 
+/*
+ * Switch branches. notify sees every path the checkout rewrites, so callers
+ * can refresh exactly those emblems afterwards.
+ */
 gboolean
-tgp_git_checkout_branch(git_repository *repo, const gchar *branch_name, GError **error)
+tgp_git_checkout_branch(git_repository *repo, const gchar *branch_name,
+                        TgpCheckoutNotifyFunc notify, TgpProgressFunc progress,
+                        gpointer user_data, GError **error)
 {
     git_reference *branch_ref = NULL;
     git_object *treeish = NULL;
     git_checkout_options checkout_opts;
+    TgpCheckoutNotify payload = { notify, progress, user_data, 0 };
     gboolean success = FALSE;
 
     git_checkout_options_init(&checkout_opts, GIT_CHECKOUT_OPTIONS_VERSION);
     checkout_opts.checkout_strategy = GIT_CHECKOUT_SAFE;
+    tgp_git_checkout_options_set_notify(&checkout_opts, &payload);
     
     if (git_branch_lookup(&branch_ref, repo, branch_name, GIT_BRANCH_LOCAL) != 0)
     {
@@ -541,9 +1028,12 @@ tgp_git_checkout_branch(git_repository *repo, const gchar *branch_name, GError *
         goto cleanup;
     }
     
+    tgp_git_sync_index(repo);
+    
     if (git_checkout_tree(repo, treeish, &checkout_opts) != 0)
     {
-        g_set_error(error, 0, 0, "Checkout failed");
+        const git_error *e = git_error_last();
+        g_set_error(error, 0, 0, "Checkout failed: %s", e ? e->message : "unknown error");
         goto cleanup;
     }
     
@@ -600,47 +1090,70 @@ tgp_git_create_branch(git_repository *repo, const gchar *branch_name, GError **e
 }
 
 gboolean
-tgp_git_remove_files(git_repository *repo, GList *files, GError **error)
+tgp_git_remove_files(git_repository *repo, GList *files, GPtrArray *touched, GError **error)
 {
-    git_index *index;
-    const gchar *workdir;
+    GPtrArray *paths = tgp_git_relative_paths(repo, files);
+    gboolean success = tgp_index_session_remove_paths(repo, paths, error);
+
+    if (success)
+        tgp_git_add_touched(touched, paths);
+
+    g_ptr_array_unref(paths);
+    return success;
+}
+
+/*
+ * Discard worktree changes of the selected files in a single checkout pass.
+ * Pathspec matching is disabled so the selection is taken literally (a
+ * selected folder still covers its contents); nothing else is touched.
+ */
+gboolean
+tgp_git_revert_files(git_repository *repo, GList *files,
+                     TgpCheckoutNotifyFunc notify, TgpProgressFunc progress,
+                     gpointer user_data, GError **error)
+{
+    git_checkout_options checkout_opts;
+    TgpCheckoutNotify payload = { notify, progress, user_data, 0 };
+    GPtrArray *paths;
+    gboolean whole_tree = FALSE;
     gboolean success = TRUE;
-    
-    if (git_repository_index(&index, repo) != 0)
+
+    paths = tgp_git_relative_paths(repo, files);
+
+    for (guint i = 0; i < paths->len; i++)
     {
-        g_set_error(error, 0, 0, "Failed to open repository index");
-        return FALSE;
+        gchar *path = g_ptr_array_index(paths, i);
+        gsize len = strlen(path);
+
+        /* Folders come in with a trailing slash when given relative to the workdir */
+        while (len > 0 && path[len - 1] == '/')
+            path[--len] = '\0';
+
+        if (len == 0)
+            whole_tree = TRUE;
     }
-    
-    workdir = git_repository_workdir(repo);
-    
-    for (GList *l = files; l != NULL; l = l->next)
+
+    git_checkout_options_init(&checkout_opts, GIT_CHECKOUT_OPTIONS_VERSION);
+    checkout_opts.checkout_strategy = GIT_CHECKOUT_FORCE |
+                                      GIT_CHECKOUT_DISABLE_PATHSPEC_MATCH;
+    tgp_git_checkout_options_set_notify(&checkout_opts, &payload);
+
+    if (!whole_tree)
     {
-        const gchar *file = l->data;
-        gchar *relative_path;
-        
-        if (g_str_has_prefix(file, workdir))
-            relative_path = g_strdup(file + strlen(workdir));
-        else
-            relative_path = g_strdup(file);
-        
-        if (git_index_remove_bypath(index, relative_path) != 0)
-        {
-            g_set_error(error, 0, 0, "Failed to remove file: %s", relative_path);
-            success = FALSE;
-            g_free(relative_path);
-            break;
-        }
-        
-        g_free(relative_path);
+        checkout_opts.paths.strings = (char **)paths->pdata;
+        checkout_opts.paths.count = paths->len;
     }
-    
-    if (success)
+
+    tgp_git_sync_index(repo);
+
+    if (paths->len > 0 && git_checkout_index(repo, NULL, &checkout_opts) != 0)
     {
-        git_index_write(index);
+        const git_error *e = git_error_last();
+        g_set_error(error, 0, 0, "Revert failed: %s", e ? e->message : "unknown error");
+        success = FALSE;
     }
-    
-    git_index_free(index);
+
+    g_ptr_array_unref(paths);
     return success;
 }
 
@@ -705,61 +1218,305 @@ GList*
 tgp_git_get_conflicted_files(git_repository *repo)
 {
     GList *files = NULL;
-    git_index *index;
+    TgpIndexSnapshot *snapshot;
+    
+    tgp_git_sync_index(repo);
     
-    if (git_repository_index(&index, repo) == 0)
+    snapshot = tgp_index_snapshot_get(repo);
+    if (snapshot)
     {
-        git_index_conflict_iterator *iter;
-        const git_index_entry *ancestor, *our, *their;
-        
-        if (git_index_conflict_iterator_new(&iter, index) == 0)
-        {
-            while (git_index_conflict_next(&ancestor, &our, &their, iter) == 0)
-            {
-                const gchar *path = our ? our->path : (their ? their->path : NULL);
-                if (path)
-                    files = g_list_append(files, g_strdup(path));
-            }
-            git_index_conflict_iterator_free(iter);
-        }
-        git_index_free(index);
+        for (guint i = snapshot->conflicts->len; i > 0; i--)
+            files = g_list_prepend(files, g_strdup(g_array_index(snapshot->conflicts,
+                                                                 TgpConflict, i - 1).path));
+        tgp_index_snapshot_unref(snapshot);
     }
     
     return files;
 }
 
-gboolean
-tgp_git_resolve_conflict(git_repository *repo, const gchar *path, GError **error)
+void
+tgp_conflict_clear(gpointer data)
 {
-    git_index *index;
-    gboolean success = FALSE;
-    
-    if (git_repository_index(&index, repo) != 0)
+    TgpConflict *conflict = data;
+    g_free(conflict->path);
+}
+
+/*
+ * Conflicted paths with the blob ids of each side, copied from the shared
+ * index snapshot, so listing a merge with many conflicts stays cheap.
+ */
+GArray*
+tgp_git_get_conflicts(git_repository *repo)
+{
+    GArray *conflicts = g_array_new(FALSE, TRUE, sizeof(TgpConflict));
+    TgpIndexSnapshot *snapshot;
+
+    g_array_set_clear_func(conflicts, tgp_conflict_clear);
+
+    tgp_git_sync_index(repo);
+
+    snapshot = tgp_index_snapshot_get(repo);
+    if (!snapshot)
+        return conflicts;
+
+    for (guint i = 0; i < snapshot->conflicts->len; i++)
     {
-        g_set_error(error, 0, 0, "Failed to open index");
+        TgpConflict conflict = g_array_index(snapshot->conflicts, TgpConflict, i);
+
+        conflict.path = g_strdup(conflict.path);
+        g_array_append_val(conflicts, conflict);
+    }
+
+    tgp_index_snapshot_unref(snapshot);
+    return conflicts;
+}
+
+static gboolean
+tgp_git_load_merge_input(git_repository *repo, const git_oid *id, gboolean present,
+                         const gchar *path, guint32 mode,
+                         git_merge_file_input *input, git_blob **blob)
+{
+    git_merge_file_input_init(input, GIT_MERGE_FILE_INPUT_VERSION);
+    *blob = NULL;
+
+    /* A side that deleted the file merges as empty content */
+    if (!present)
+        return TRUE;
+
+    if (git_blob_lookup(blob, repo, id) != 0)
         return FALSE;
+
+    input->ptr = git_blob_rawcontent(*blob);
+    input->size = (size_t)git_blob_rawsize(*blob);
+    input->path = path;
+    input->mode = mode;
+    return TRUE;
+}
+
+/* Split merged output at the conflict markers git_merge_file() wrote */
+static GArray*
+tgp_git_split_merge_hunks(const gchar *content, gsize length)
+{
+    GArray *hunks = g_array_new(FALSE, FALSE, sizeof(TgpMergeHunk));
+    TgpMergeHunk hunk = { 0, 0, FALSE };
+    gsize pos = 0;
+
+    while (pos < length)
+    {
+        const gchar *eol = memchr(content + pos, '\n', length - pos);
+        gsize next = eol ? (gsize)(eol - content) + 1 : length;
+        gboolean opens = !hunk.conflict && length - pos >= 8 &&
+                         strncmp(content + pos, "<<<<<<< ", 8) == 0;
+
+        if (opens && pos > hunk.offset)
+        {
+            hunk.length = pos - hunk.offset;
+            g_array_append_val(hunks, hunk);
+            hunk.offset = pos;
+        }
+        if (opens)
+            hunk.conflict = TRUE;
+
+        if (hunk.conflict && !opens && length - pos >= 8 &&
+            strncmp(content + pos, ">>>>>>> ", 8) == 0)
+        {
+            hunk.length = next - hunk.offset;
+            g_array_append_val(hunks, hunk);
+            hunk.offset = next;
+            hunk.conflict = FALSE;
+        }
+
+        pos = next;
     }
-    
-    if (git_index_conflict_remove(index, path) == 0)
+
+    if (length > hunk.offset)
     {
-        git_index_write(index);
-        success = TRUE;
+        hunk.length = length - hunk.offset;
+        g_array_append_val(hunks, hunk);
     }
-    else
+
+    return hunks;
+}
+
+/*
+ * Three-way merge of one conflicted path. The ancestor, ours and theirs
+ * blobs are only looked up here, so callers can defer this to the moment
+ * a file is opened and run it off the main thread.
+ */
+TgpMergeResult*
+tgp_git_merge_conflict(git_repository *repo, const TgpConflict *conflict,
+                       git_merge_file_favor_t favor, GError **error)
+{
+    git_merge_file_input ancestor, ours, theirs;
+    git_blob *ancestor_blob = NULL, *ours_blob = NULL, *theirs_blob = NULL;
+    git_merge_file_options opts;
+    git_merge_file_result merged;
+    TgpMergeResult *result = NULL;
+
+    g_return_val_if_fail(repo != NULL && conflict != NULL, NULL);
+
+    /* Modify/delete: keeping the side that deleted the file leaves nothing to merge */
+    if ((favor == GIT_MERGE_FILE_FAVOR_OURS && !conflict->has_ours) ||
+        (favor == GIT_MERGE_FILE_FAVOR_THEIRS && !conflict->has_theirs))
     {
-        g_set_error(error, 0, 0, "Failed to resolve conflict");
+        result = g_new0(TgpMergeResult, 1);
+        result->content = g_strdup("");
+        result->automergeable = TRUE;
+        result->deleted = TRUE;
+        result->hunks = g_array_new(FALSE, FALSE, sizeof(TgpMergeHunk));
+        return result;
     }
-    
-    git_index_free(index);
+
+    if (!tgp_git_load_merge_input(repo, &conflict->ancestor, conflict->has_ancestor,
+                                  conflict->path, conflict->mode, &ancestor, &ancestor_blob) ||
+        !tgp_git_load_merge_input(repo, &conflict->ours, conflict->has_ours,
+                                  conflict->path, conflict->mode, &ours, &ours_blob) ||
+        !tgp_git_load_merge_input(repo, &conflict->theirs, conflict->has_theirs,
+                                  conflict->path, conflict->mode, &theirs, &theirs_blob))
+    {
+        const git_error *e = git_error_last();
+        g_set_error(error, 0, 0, "Failed to load conflict for %s: %s",
+                    conflict->path, e ? e->message : "unknown error");
+        goto out;
+    }
+
+    if (favor == GIT_MERGE_FILE_FAVOR_NORMAL &&
+        ((ours_blob && git_blob_is_binary(ours_blob)) ||
+         (theirs_blob && git_blob_is_binary(theirs_blob))))
+    {
+        g_set_error(error, 0, 0, "%s is a binary file; choose one side to keep",
+                    conflict->path);
+        goto out;
+    }
+
+    git_merge_file_options_init(&opts, GIT_MERGE_FILE_OPTIONS_VERSION);
+    opts.ancestor_label = "base";
+    opts.our_label = "ours";
+    opts.their_label = "theirs";
+    opts.favor = favor;
+
+    if (git_merge_file(&merged, &ancestor, &ours, &theirs, &opts) != 0)
+    {
+        const git_error *e = git_error_last();
+        g_set_error(error, 0, 0, "Failed to merge %s: %s",
+                    conflict->path, e ? e->message : "unknown error");
+        goto out;
+    }
+
+    result = g_new0(TgpMergeResult, 1);
+    result->content = g_strndup(merged.ptr, merged.len);
+    result->length = merged.len;
+    result->automergeable = merged.automergeable != 0;
+    result->hunks = tgp_git_split_merge_hunks(result->content, result->length);
+    git_merge_file_result_free(&merged);
+
+out:
+    if (ancestor_blob) git_blob_free(ancestor_blob);
+    if (ours_blob) git_blob_free(ours_blob);
+    if (theirs_blob) git_blob_free(theirs_blob);
+    return result;
+}
+
+void
+tgp_merge_result_free(TgpMergeResult *result)
+{
+    if (!result)
+        return;
+
+    g_array_unref(result->hunks);
+    g_free(result->content);
+    g_free(result);
+}
+
+/*
+ * Mark a conflict resolved. With content, the file is rewritten first;
+ * without, the working tree file is taken as it is. Either way staging
+ * it is a single add, which also drops the conflict entries.
+ */
+gboolean
+tgp_git_resolve_conflict(git_repository *repo, const gchar *path,
+                         const gchar *content, gsize length,
+                         GPtrArray *touched, GError **error)
+{
+    GPtrArray *paths;
+    gboolean success;
+
+    if (content)
+    {
+        const gchar *workdir = git_repository_workdir(repo);
+        gchar *full_path;
+        FILE *fp;
+
+        if (!workdir)
+        {
+            g_set_error(error, 0, 0, "Repository has no working directory");
+            return FALSE;
+        }
+
+        /* Rewrite in place so the file keeps its permissions */
+        full_path = g_build_filename(workdir, path, NULL);
+        fp = fopen(full_path, "wb");
+        if (!fp || fwrite(content, 1, length, fp) != length)
+        {
+            g_set_error(error, 0, 0, "Failed to write %s", full_path);
+            if (fp)
+                fclose(fp);
+            g_free(full_path);
+            return FALSE;
+        }
+        fclose(fp);
+        g_free(full_path);
+    }
+
+    paths = g_ptr_array_new();
+    g_ptr_array_add(paths, (gpointer)path);
+    success = tgp_index_session_add_paths(repo, paths, error);
+    if (success)
+        tgp_git_add_touched(touched, paths);
+    g_ptr_array_unref(paths);
+
     return success;
 }
 
-GList*
-tgp_git_get_stashes(git_repository *repo)
+/*
+ * Resolve a modify/delete conflict in favour of the deletion: the conflict
+ * entries go away without a stage 0 entry taking their place, and the
+ * working tree file is removed.
+ */
+gboolean
+tgp_git_resolve_conflict_by_deletion(git_repository *repo, const gchar *path,
+                                     GPtrArray *touched, GError **error)
 {
-    (void)repo;
-    /* Simplified - would need to implement stash list traversal */
-    return NULL;
+    const gchar *workdir = git_repository_workdir(repo);
+    gchar *full_path;
+    GPtrArray *paths;
+
+    if (!workdir)
+    {
+        g_set_error(error, 0, 0, "Repository has no working directory");
+        return FALSE;
+    }
+
+    full_path = g_build_filename(workdir, path, NULL);
+    if (g_unlink(full_path) != 0 && errno != ENOENT)
+    {
+        gint saved_errno = errno;
+
+        g_set_error(error, 0, 0, "Failed to delete %s: %s", full_path, g_strerror(saved_errno));
+        g_free(full_path);
+        return FALSE;
+    }
+    g_free(full_path);
+
+    if (!tgp_index_session_remove_conflict(repo, path, error))
+        return FALSE;
+
+    paths = g_ptr_array_new();
+    g_ptr_array_add(paths, (gpointer)path);
+    tgp_git_add_touched(touched, paths);
+    g_ptr_array_unref(paths);
+
+    return TRUE;
 }
 
 /*
@@ -842,19 +1599,15 @@ tgp_git_push_with_auth(git_repository *repo, const gchar *remote, const gchar *b
  */
 gboolean
 tgp_git_pull_with_auth(git_repository *repo, const gchar *remote, const gchar *branch,
-                       const gchar *username, const gchar *password, GError **error)
+                       const gchar *username, const gchar *password,
+                       GPtrArray *touched, GError **error)
 {
+    TgpCheckoutNotify notify = { tgp_git_collect_touched, NULL, touched, 0 };
     git_remote *remote_obj = NULL;
     git_fetch_options fetch_opts;
-    git_merge_options merge_opts;
-    git_checkout_options checkout_opts;
-    git_reference *ref = NULL;
-    git_annotated_commit *annotated = NULL;
     gint ret = 0;
 
     git_fetch_options_init(&fetch_opts, GIT_FETCH_OPTIONS_VERSION);
-    git_merge_options_init(&merge_opts, GIT_MERGE_OPTIONS_VERSION);
-    git_checkout_options_init(&checkout_opts, GIT_CHECKOUT_OPTIONS_VERSION);
 
     if (!repo || !remote || !branch)
         return FALSE;
@@ -902,44 +1655,8 @@ tgp_git_pull_with_auth(git_repository *repo, const gchar *remote, const gchar *b
         return FALSE;
     }
 
-    /* Merge remote tracking branch */
-    gchar *remote_ref = g_strdup_printf("refs/remotes/%s/%s", remote, branch);
-
-    if (git_reference_lookup(&ref, repo, remote_ref) != 0)
-    {
-        g_set_error(error, 0, 0, "Remote reference '%s' not found", remote_ref);
-        g_free(remote_ref);
-        git_remote_free(remote_obj);
-        return FALSE;
-    }
-
-    if (git_annotated_commit_from_ref(&annotated, repo, ref) != 0)
-    {
-        g_set_error(error, 0, 0, "Failed to resolve remote reference '%s'", remote_ref);
-        git_reference_free(ref);
-        g_free(remote_ref);
-        git_remote_free(remote_obj);
-        return FALSE;
-    }
-
-    git_reference_free(ref);
-
-    ret = git_merge(repo,
-                    (const git_annotated_commit **)&annotated,
-                    1,
-                    &merge_opts,
-                    &checkout_opts);
-
-    git_annotated_commit_free(annotated);
-
-    g_free(remote_ref);
     git_remote_free(remote_obj);
 
-    if (ret != 0 && ret != GIT_EMERGECONFLICT)
-    {
-        g_set_error(error, 0, 0, "Merge failed: %s", git_error_last()->message);
-        return FALSE;
-    }
-
-    return TRUE;
+    /* Fast-forward when possible, merge only when the branches diverged */
+    return tgp_git_merge_fetched(repo, remote, branch, touched ? &notify : NULL, error);
 }
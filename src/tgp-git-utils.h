@@ -12,30 +12,90 @@
 
 G_BEGIN_DECLS
 
+/* Called from checkout notify callbacks for every path that gets rewritten */
+typedef void (*TgpCheckoutNotifyFunc)(const gchar *path, guint n_updated, gpointer user_data);
+
+/* Step progress of checkout-based operations */
+typedef void (*TgpProgressFunc)(gsize completed, gsize total, gpointer user_data);
+
+/* Stash list: one compact array, messages share a single buffer */
+typedef struct {
+    gsize   index;           /* Position in the stash reflog, stash@{index} */
+    git_oid id;
+    gsize   message_offset;  /* Into TgpStashList.messages */
+} TgpStashEntry;
+
+typedef struct {
+    GArray  *entries;        /* TgpStashEntry, newest first */
+    GString *messages;       /* NUL-separated messages */
+} TgpStashList;
+
+/* A conflicted path as recorded in the index; blobs are loaded on demand */
+typedef struct {
+    gchar   *path;
+    git_oid  ancestor;
+    git_oid  ours;
+    git_oid  theirs;
+    guint32  mode;
+    guint    has_ancestor : 1;
+    guint    has_ours : 1;
+    guint    has_theirs : 1;
+} TgpConflict;
+
+/* Span of merged output, either clean text or a marked conflict */
+typedef struct {
+    gsize    offset;
+    gsize    length;
+    gboolean conflict;
+} TgpMergeHunk;
+
+typedef struct {
+    gchar   *content;
+    gsize    length;
+    gboolean automergeable;
+    gboolean deleted;        /* The chosen side deletes the file, content is empty */
+    GArray  *hunks;          /* TgpMergeHunk, in file order */
+} TgpMergeResult;
+
 /* Repository operations */
 git_repository* tgp_git_open_repository(const gchar *path);
 gboolean        tgp_git_is_repository(const gchar *path);
 gchar*          tgp_git_find_repository_root(const gchar *path);
 
 /* Status operations */
-TgpStatusFlags  tgp_git_get_file_status(git_repository *repo, const gchar *path);
+TgpStatusFlags  tgp_git_status_to_flags(unsigned int status_flags);
 gboolean        tgp_git_has_uncommitted_changes(git_repository *repo);
 gboolean        tgp_git_is_ahead_behind(git_repository *repo, gint *ahead, gint *behind);
 
 /* Branch operations */
 gchar*          tgp_git_get_current_branch(git_repository *repo);
 GList*          tgp_git_get_branches(git_repository *repo);
-gboolean        tgp_git_checkout_branch(git_repository *repo, const gchar *branch_name, GError **error);
+gboolean        tgp_git_checkout_branch(git_repository *repo, const gchar *branch_name,
+                                        TgpCheckoutNotifyFunc notify, TgpProgressFunc progress,
+                                        gpointer user_data, GError **error);
 gboolean        tgp_git_create_branch(git_repository *repo, const gchar *branch_name, GError **error);
 
+/*
+ * Mutating operations append the workdir-relative paths whose status they
+ * may have changed to touched (if not NULL); checkout-based ones report
+ * them through their TgpCheckoutNotifyFunc instead.
+ */
+
 /* Commit operations */
-gboolean        tgp_git_commit(git_repository *repo, const gchar *message, GList *files, GError **error);
-gboolean        tgp_git_add_files(git_repository *repo, GList *files, GError **error);
-gboolean        tgp_git_remove_files(git_repository *repo, GList *files, GError **error);
+gboolean        tgp_git_commit(git_repository *repo, const gchar *message, GList *files,
+                               GPtrArray *touched, GError **error);
+gboolean        tgp_git_add_files(git_repository *repo, GList *files, GPtrArray *touched,
+                                  GError **error);
+gboolean        tgp_git_remove_files(git_repository *repo, GList *files, GPtrArray *touched,
+                                     GError **error);
+gboolean        tgp_git_revert_files(git_repository *repo, GList *files,
+                                     TgpCheckoutNotifyFunc notify, TgpProgressFunc progress,
+                                     gpointer user_data, GError **error);
 
 /* Remote operations */
 gboolean        tgp_git_push(git_repository *repo, const gchar *remote, const gchar *branch, GError **error);
-gboolean        tgp_git_pull(git_repository *repo, const gchar *remote, const gchar *branch, GError **error);
+gboolean        tgp_git_pull(git_repository *repo, const gchar *remote, const gchar *branch,
+                             GPtrArray *touched, GError **error);
 gboolean        tgp_git_fetch(git_repository *repo, const gchar *remote, GError **error);
 gboolean        tgp_git_clone(const gchar *url, const gchar *path, GError **error);
 GList*          tgp_git_get_remotes(git_repository *repo);
@@ -44,7 +104,8 @@ GList*          tgp_git_get_remotes(git_repository *repo);
 gboolean        tgp_git_push_with_auth(git_repository *repo, const gchar *remote, const gchar *branch,
                                        const gchar *username, const gchar *password, GError **error);
 gboolean        tgp_git_pull_with_auth(git_repository *repo, const gchar *remote, const gchar *branch,
-                                       const gchar *username, const gchar *password, GError **error);
+                                       const gchar *username, const gchar *password,
+                                       GPtrArray *touched, GError **error);
 
 /* History operations */
 GList*          tgp_git_get_log(git_repository *repo, gint limit);
@@ -53,12 +114,27 @@ gchar*          tgp_git_get_diff(git_repository *repo, const gchar *path);
 /* Conflict resolution */
 gboolean        tgp_git_has_conflicts(git_repository *repo);
 GList*          tgp_git_get_conflicted_files(git_repository *repo);
-gboolean        tgp_git_resolve_conflict(git_repository *repo, const gchar *path, GError **error);
+GArray*         tgp_git_get_conflicts(git_repository *repo);
+void            tgp_conflict_clear(gpointer conflict);
+TgpMergeResult* tgp_git_merge_conflict(git_repository *repo, const TgpConflict *conflict,
+                                       git_merge_file_favor_t favor, GError **error);
+void            tgp_merge_result_free(TgpMergeResult *result);
+gboolean        tgp_git_resolve_conflict(git_repository *repo, const gchar *path,
+                                         const gchar *content, gsize length,
+                                         GPtrArray *touched, GError **error);
+gboolean        tgp_git_resolve_conflict_by_deletion(git_repository *repo, const gchar *path,
+                                                     GPtrArray *touched, GError **error);
 
 /* Stash operations */
-gboolean        tgp_git_stash(git_repository *repo, const gchar *message, GError **error);
-gboolean        tgp_git_stash_pop(git_repository *repo, GError **error);
-GList*          tgp_git_get_stashes(git_repository *repo);
+gboolean        tgp_git_stash(git_repository *repo, const gchar *message,
+                              TgpCheckoutNotifyFunc notify, gpointer user_data, GError **error);
+gboolean        tgp_git_stash_pop(git_repository *repo, gsize index,
+                                  TgpCheckoutNotifyFunc notify, TgpProgressFunc progress,
+                                  gpointer user_data, GError **error);
+TgpStashList*   tgp_git_get_stashes(git_repository *repo);
+gchar*          tgp_git_get_stash_diff(git_repository *repo, const git_oid *stash_id);
+const gchar*    tgp_stash_list_get_message(TgpStashList *list, guint i);
+void            tgp_stash_list_free(TgpStashList *list);
 
 /* Initialize/cleanup */
 void            tgp_git_init(void);
@@ -0,0 +1,810 @@
+/*
+ * Thunar Git Plugin - Coalesced Index Sessions Implementation
+ * Copyright (C) 2025 MiniMax Agent
+ *
+ * Every index mutation used to rewrite the whole .git/index. A session keeps
+ * the parsed index of one repository in memory, applies mutations to it right
+ * away (so errors are still reported to the caller) and writes the result once
+ * the repository has been idle for TGP_INDEX_SESSION_FLUSH_DELAY_MS.
+ *
+ * index.lock is only taken while the file is actually written, so command
+ * line git is never blocked by an idle session. Mutations are logged until
+ * they reach disk: once the lock is held, the on-disk index is re-read if
+ * another process rewrote it and the log is replayed on top, so nothing can
+ * be committed in between and clobbered. The result is written to a scratch
+ * file that replaces the lock, and the lock then replaces the index, the way
+ * git itself commits a locked file.
+ *
+ * Writes happen on a worker thread, never on the GTK thread. A write that
+ * fails (usually because git holds the lock) is retried with a growing delay;
+ * after TGP_INDEX_SESSION_MAX_RETRIES attempts the waiting callbacks are told
+ * and the mutations stay queued for the next write.
+ */
+
+#include "tgp-index-session.h"
+#include <git2/sys/index.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+
+/* Threads writing indexes and running flushed callbacks */
+#define INDEX_SESSION_FLUSH_THREADS 2
+
+typedef enum {
+    TGP_INDEX_OP_ADD,
+    TGP_INDEX_OP_REMOVE,
+    TGP_INDEX_OP_REMOVE_CONFLICT,
+    TGP_INDEX_OP_REFRESH
+} TgpIndexOpKind;
+
+typedef struct {
+    TgpIndexOpKind kind;
+    gchar         *path;
+    git_oid        id;            /* TGP_INDEX_OP_REFRESH only */
+    GStatBuf       st;
+} TgpIndexOp;
+
+typedef struct {
+    TgpIndexFlushedFunc func;
+    gpointer            user_data;
+    GDestroyNotify      destroy;
+} TgpFlushedCallback;
+
+typedef struct {
+    gchar          *gitdir;
+    gchar          *index_path;
+    git_repository *repo;         /* Private handle, only used under lock */
+    git_index      *index;
+    GArray         *pending;      /* TgpIndexOp not yet written to disk */
+    GStatBuf        disk_stat;    /* Index file as last read or written */
+    gboolean        has_disk_stat;
+    guint           flush_source;
+    guint           retries;      /* Failed writes in a row */
+    GList          *callbacks;    /* TgpFlushedCallback */
+    GMutex          lock;
+} TgpIndexSession;
+
+/* Work for the flush pool: write a session out, or just run callbacks */
+typedef struct {
+    TgpIndexSession *session;
+    gchar           *workdir;
+    GList           *callbacks;
+} TgpFlushJob;
+
+static GHashTable *sessions = NULL;
+static GThreadPool *flush_pool = NULL;
+static GMutex sessions_mutex;
+
+static void index_session_flush_job(gpointer data, gpointer user_data);
+static gboolean index_session_flush_timeout(gpointer user_data);
+
+static void
+index_op_clear(gpointer data)
+{
+    TgpIndexOp *op = data;
+    g_free(op->path);
+}
+
+static void
+flushed_callback_free(TgpFlushedCallback *cb)
+{
+    if (cb->destroy)
+        cb->destroy(cb->user_data);
+    g_free(cb);
+}
+
+static void
+index_session_free(TgpIndexSession *session)
+{
+    if (session->flush_source)
+        g_source_remove(session->flush_source);
+
+    g_list_free_full(session->callbacks, (GDestroyNotify)flushed_callback_free);
+    g_array_unref(session->pending);
+
+    if (session->index)
+        git_index_free(session->index);
+    if (session->repo)
+        git_repository_free(session->repo);
+
+    g_mutex_clear(&session->lock);
+    g_free(session->index_path);
+    g_free(session->gitdir);
+    g_free(session);
+}
+
+void
+tgp_index_session_init(void)
+{
+    g_mutex_lock(&sessions_mutex);
+
+    if (!sessions)
+    {
+        sessions = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                         NULL, (GDestroyNotify)index_session_free);
+        flush_pool = g_thread_pool_new(index_session_flush_job, NULL,
+                                       INDEX_SESSION_FLUSH_THREADS, FALSE, NULL);
+    }
+
+    g_mutex_unlock(&sessions_mutex);
+}
+
+static gboolean
+index_session_disk_changed(TgpIndexSession *session)
+{
+    GStatBuf st;
+
+    if (g_stat(session->index_path, &st) != 0)
+        return session->has_disk_stat;
+
+    if (!session->has_disk_stat)
+        return TRUE;
+
+    return st.st_ino != session->disk_stat.st_ino ||
+           st.st_size != session->disk_stat.st_size ||
+           st.st_mtim.tv_sec != session->disk_stat.st_mtim.tv_sec ||
+           st.st_mtim.tv_nsec != session->disk_stat.st_mtim.tv_nsec;
+}
+
+static void
+index_session_remember_disk(TgpIndexSession *session)
+{
+    session->has_disk_stat = (g_stat(session->index_path, &session->disk_stat) == 0);
+}
+
+static gboolean
+index_session_stat_equal(const GStatBuf *a, const GStatBuf *b)
+{
+    return a->st_ino == b->st_ino &&
+           a->st_size == b->st_size &&
+           a->st_mtim.tv_sec == b->st_mtim.tv_sec &&
+           a->st_mtim.tv_nsec == b->st_mtim.tv_nsec &&
+           a->st_ctim.tv_sec == b->st_ctim.tv_sec &&
+           a->st_ctim.tv_nsec == b->st_ctim.tv_nsec;
+}
+
+/* Whether the entry already carries the stat data of st */
+static gboolean
+index_session_entry_has_stat(const git_index_entry *entry, const GStatBuf *st)
+{
+    return entry->mtime.seconds == (gint32)st->st_mtim.tv_sec &&
+           entry->mtime.nanoseconds == (guint32)st->st_mtim.tv_nsec &&
+           entry->ctime.seconds == (gint32)st->st_ctim.tv_sec &&
+           entry->ctime.nanoseconds == (guint32)st->st_ctim.tv_nsec &&
+           entry->ino == (guint32)st->st_ino &&
+           entry->file_size == (guint32)st->st_size;
+}
+
+/*
+ * Copy the current stat data of a verified file into its entry. Skipped
+ * (not an error) if the entry or the file changed since it was hashed, or
+ * the entry already has that stat data.
+ */
+static int
+index_session_refresh_entry(TgpIndexSession *session, const TgpIndexOp *op)
+{
+    const git_index_entry *current = git_index_get_bypath(session->index, op->path, 0);
+    git_index_entry entry;
+    gchar *file_path;
+    GStatBuf st;
+    gboolean unchanged;
+
+    if (!current || !git_oid_equal(&current->id, &op->id) ||
+        index_session_entry_has_stat(current, &op->st))
+        return 0;
+
+    file_path = g_build_filename(git_repository_workdir(session->repo), op->path, NULL);
+    unchanged = g_lstat(file_path, &st) == 0 && index_session_stat_equal(&st, &op->st);
+    g_free(file_path);
+
+    if (!unchanged)
+        return 0;
+
+    entry = *current;
+    entry.path = op->path;
+    entry.ctime.seconds = st.st_ctim.tv_sec;
+    entry.ctime.nanoseconds = st.st_ctim.tv_nsec;
+    entry.mtime.seconds = st.st_mtim.tv_sec;
+    entry.mtime.nanoseconds = st.st_mtim.tv_nsec;
+    entry.dev = st.st_dev;
+    entry.ino = st.st_ino;
+    entry.uid = st.st_uid;
+    entry.gid = st.st_gid;
+    entry.file_size = st.st_size;
+
+    return git_index_add(session->index, &entry);
+}
+
+static int
+index_session_apply(TgpIndexSession *session, const TgpIndexOp *op)
+{
+    switch (op->kind)
+    {
+        case TGP_INDEX_OP_ADD:
+            return git_index_add_bypath(session->index, op->path);
+        case TGP_INDEX_OP_REMOVE:
+            return git_index_remove_bypath(session->index, op->path);
+        case TGP_INDEX_OP_REMOVE_CONFLICT:
+            return git_index_conflict_remove(session->index, op->path);
+        case TGP_INDEX_OP_REFRESH:
+            return index_session_refresh_entry(session, op);
+    }
+
+    return -1;
+}
+
+/*
+ * Throw away the in-memory index, re-read it from disk and replay the
+ * mutations that have not been written yet. Ops that no longer apply
+ * (the file vanished, the conflict was resolved elsewhere) are dropped.
+ */
+static void
+index_session_reload(TgpIndexSession *session)
+{
+    guint i = 0;
+
+    git_index_read(session->index, TRUE);
+    index_session_remember_disk(session);
+
+    while (i < session->pending->len)
+    {
+        TgpIndexOp *op = &g_array_index(session->pending, TgpIndexOp, i);
+
+        if (index_session_apply(session, op) != 0)
+        {
+            g_warning("Dropping stale index update for %s", op->path);
+            g_array_remove_index(session->pending, i);
+            continue;
+        }
+
+        i++;
+    }
+}
+
+/* Called with session->lock held */
+static void
+index_session_sync(TgpIndexSession *session)
+{
+    if (index_session_disk_changed(session))
+        index_session_reload(session);
+}
+
+static void
+index_session_set_git_error(GError **error, const gchar *what)
+{
+    const git_error *e = git_error_last();
+
+    g_set_error(error, 0, 0, "%s: %s", what, e ? e->message : "unknown error");
+}
+
+/*
+ * session->index copied into scratch for writing. git_index_write() on
+ * session->index itself would take index.lock, which we already hold, and
+ * letting go of it first would let another writer in between the sync and
+ * the write. read_index() copies the entries only, so the version (v3/v4
+ * path compression) and the resolve-undo records are carried over here.
+ * The cached trees, untracked cache and fsmonitor data are lost; they are
+ * caches git rebuilds on its next write, and libgit2 would not have
+ * written the latter two anyway.
+ */
+static gboolean
+index_session_copy(TgpIndexSession *session, git_index *scratch)
+{
+    if (git_index_read_index(scratch, session->index) != 0 ||
+        git_index_set_version(scratch, git_index_version(session->index)) != 0)
+        return FALSE;
+
+    for (size_t i = 0; i < git_index_reuc_entrycount(session->index); i++)
+    {
+        const git_index_reuc_entry *reuc = git_index_reuc_get_byindex(session->index, i);
+
+        if (git_index_reuc_add(scratch, reuc->path,
+                               reuc->mode[0], &reuc->oid[0],
+                               reuc->mode[1], &reuc->oid[1],
+                               reuc->mode[2], &reuc->oid[2]) != 0)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Write the index out under index.lock. Called with session->lock held;
+ * on failure the lock is released and the mutations stay pending.
+ */
+static gboolean
+index_session_write(TgpIndexSession *session, GError **error)
+{
+    gchar *lock_path;
+    gchar *scratch_path;
+    git_index *scratch = NULL;
+    gboolean success = FALSE;
+    gint fd;
+
+    if (session->pending->len == 0)
+        return TRUE;
+
+    lock_path = g_strconcat(session->index_path, ".lock", NULL);
+    fd = g_open(lock_path, O_WRONLY | O_CREAT | O_EXCL, 0666);
+    if (fd < 0)
+    {
+        gint saved_errno = errno;
+
+        g_set_error(error, 0, 0, "Failed to lock index: %s", g_strerror(saved_errno));
+        g_free(lock_path);
+        return FALSE;
+    }
+    g_close(fd, NULL);
+
+    /* Nobody can commit an index meanwhile: merge with the current one */
+    index_session_sync(session);
+
+    /* libgit2 locks the scratch file for itself, ".lock" keeps both quiet for watchers */
+    scratch_path = g_strconcat(session->index_path, ".tgp.lock", NULL);
+
+    if (git_index_open(&scratch, scratch_path) != 0 ||
+        !index_session_copy(session, scratch) ||
+        git_index_write(scratch) != 0)
+    {
+        index_session_set_git_error(error, "Failed to write index");
+    }
+    else if (g_rename(scratch_path, lock_path) != 0 ||
+             g_rename(lock_path, session->index_path) != 0)
+    {
+        gint saved_errno = errno;
+
+        g_set_error(error, 0, 0, "Failed to replace index: %s", g_strerror(saved_errno));
+    }
+    else
+    {
+        success = TRUE;
+    }
+
+    if (scratch)
+        git_index_free(scratch);
+
+    if (success)
+    {
+        g_array_set_size(session->pending, 0);
+        index_session_remember_disk(session);
+    }
+    else
+    {
+        g_unlink(scratch_path);
+        g_unlink(lock_path);
+    }
+
+    g_free(scratch_path);
+    g_free(lock_path);
+
+    return success;
+}
+
+static TgpIndexSession*
+index_session_lookup(git_repository *repo, gboolean create, GError **error)
+{
+    TgpIndexSession *session;
+    const gchar *gitdir;
+
+    if (!repo)
+    {
+        g_set_error(error, 0, 0, "No repository");
+        return NULL;
+    }
+
+    gitdir = git_repository_path(repo);
+
+    tgp_index_session_init();
+
+    g_mutex_lock(&sessions_mutex);
+
+    session = g_hash_table_lookup(sessions, gitdir);
+    if (!session && create)
+    {
+        session = g_new0(TgpIndexSession, 1);
+        session->gitdir = g_strdup(gitdir);
+        session->index_path = g_build_filename(gitdir, "index", NULL);
+        session->pending = g_array_new(FALSE, FALSE, sizeof(TgpIndexOp));
+        g_array_set_clear_func(session->pending, index_op_clear);
+        g_mutex_init(&session->lock);
+
+        if (git_repository_open(&session->repo, gitdir) != 0 ||
+            git_repository_index(&session->index, session->repo) != 0)
+        {
+            g_set_error(error, 0, 0, "Failed to open repository index");
+            index_session_free(session);
+            session = NULL;
+        }
+        else
+        {
+            index_session_remember_disk(session);
+            g_hash_table_insert(sessions, session->gitdir, session);
+        }
+    }
+
+    g_mutex_unlock(&sessions_mutex);
+
+    return session;
+}
+
+static void
+index_session_run_callbacks(const gchar *workdir, const GError *error, GList *callbacks)
+{
+    for (GList *l = callbacks; l != NULL; l = l->next)
+    {
+        TgpFlushedCallback *cb = l->data;
+        cb->func(workdir, error, cb->user_data);
+    }
+
+    g_list_free_full(callbacks, (GDestroyNotify)flushed_callback_free);
+}
+
+/* Hand a job to the flush pool; without one (shut down) it runs right here */
+static void
+index_session_push_job(TgpIndexSession *session, const gchar *workdir, GList *callbacks)
+{
+    TgpFlushJob *job = g_new0(TgpFlushJob, 1);
+    gboolean pushed = FALSE;
+
+    job->session = session;
+    job->workdir = g_strdup(workdir);
+    job->callbacks = callbacks;
+
+    g_mutex_lock(&sessions_mutex);
+    if (flush_pool)
+        pushed = g_thread_pool_push(flush_pool, job, NULL);
+    g_mutex_unlock(&sessions_mutex);
+
+    if (!pushed)
+        index_session_flush_job(job, NULL);
+}
+
+/* Called with session->lock held */
+static void
+index_session_schedule_flush(TgpIndexSession *session, guint delay)
+{
+    if (session->flush_source)
+        g_source_remove(session->flush_source);
+
+    session->flush_source = g_timeout_add(delay, index_session_flush_timeout, session);
+}
+
+/* Main loop: the idle window is over, write on a worker */
+static gboolean
+index_session_flush_timeout(gpointer user_data)
+{
+    TgpIndexSession *session = user_data;
+
+    g_mutex_lock(&session->lock);
+    session->flush_source = 0;
+    g_mutex_unlock(&session->lock);
+
+    index_session_push_job(session, NULL, NULL);
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Write a session out and run its callbacks, or run the callbacks of a job */
+static void
+index_session_flush_job(gpointer data, gpointer user_data)
+{
+    TgpFlushJob *job = data;
+    TgpIndexSession *session = job->session;
+    GError *error = NULL;
+    gboolean retry = FALSE;
+
+    (void)user_data;
+
+    if (session)
+    {
+        g_mutex_lock(&session->lock);
+
+        if (index_session_write(session, &error))
+        {
+            session->retries = 0;
+        }
+        else if (++session->retries < TGP_INDEX_SESSION_MAX_RETRIES)
+        {
+            /* Most likely git holds index.lock; a new mutation reschedules anyway */
+            g_debug("%s, retrying", error->message);
+            if (!session->flush_source)
+                index_session_schedule_flush(session,
+                                             TGP_INDEX_SESSION_FLUSH_DELAY_MS << session->retries);
+            retry = TRUE;
+        }
+        else
+        {
+            /* Give up for now, the mutations go out with the next write */
+            g_warning("Index of %s not written after %u attempts: %s",
+                      session->gitdir, session->retries, error->message);
+            session->retries = 0;
+        }
+
+        if (!retry)
+        {
+            job->callbacks = session->callbacks;
+            session->callbacks = NULL;
+            job->workdir = g_strdup(git_repository_workdir(session->repo));
+        }
+
+        g_mutex_unlock(&session->lock);
+    }
+
+    if (!retry)
+        index_session_run_callbacks(job->workdir, error, job->callbacks);
+
+    g_clear_error(&error);
+    g_free(job->workdir);
+    g_free(job);
+}
+
+static gboolean
+index_session_mutate(git_repository *repo, TgpIndexOpKind kind,
+                     GPtrArray *paths, GError **error)
+{
+    TgpIndexSession *session;
+    gboolean success = TRUE;
+    guint i;
+
+    session = index_session_lookup(repo, TRUE, error);
+    if (!session)
+        return FALSE;
+
+    g_mutex_lock(&session->lock);
+
+    index_session_sync(session);
+
+    for (i = 0; i < paths->len; i++)
+    {
+        TgpIndexOp op = { kind, (gchar *)g_ptr_array_index(paths, i) };
+
+        if (index_session_apply(session, &op) != 0)
+        {
+            g_set_error(error, 0, 0, "Failed to update index for: %s", op.path);
+            success = FALSE;
+            break;
+        }
+    }
+
+    if (success)
+    {
+        for (i = 0; i < paths->len; i++)
+        {
+            TgpIndexOp op = { kind, g_strdup(g_ptr_array_index(paths, i)) };
+            g_array_append_val(session->pending, op);
+        }
+
+        if (paths->len > 0)
+            index_session_schedule_flush(session, TGP_INDEX_SESSION_FLUSH_DELAY_MS);
+    }
+    else
+    {
+        /* Roll the partial batch back, keep what was queued before */
+        index_session_reload(session);
+    }
+
+    g_mutex_unlock(&session->lock);
+
+    return success;
+}
+
+gboolean
+tgp_index_session_add_paths(git_repository *repo, GPtrArray *paths, GError **error)
+{
+    return index_session_mutate(repo, TGP_INDEX_OP_ADD, paths, error);
+}
+
+gboolean
+tgp_index_session_remove_paths(git_repository *repo, GPtrArray *paths, GError **error)
+{
+    return index_session_mutate(repo, TGP_INDEX_OP_REMOVE, paths, error);
+}
+
+gboolean
+tgp_index_session_remove_conflict(git_repository *repo, const gchar *path, GError **error)
+{
+    GPtrArray *paths = g_ptr_array_new();
+    gboolean success;
+
+    g_ptr_array_add(paths, (gpointer)path);
+    success = index_session_mutate(repo, TGP_INDEX_OP_REMOVE_CONFLICT, paths, error);
+    g_ptr_array_unref(paths);
+
+    return success;
+}
+
+gboolean
+tgp_index_session_refresh(git_repository *repo, const TgpIndexRefresh *refreshes,
+                          guint n_refreshes, GError **error)
+{
+    TgpIndexSession *session;
+    gboolean success = TRUE;
+    guint n_applied = 0;
+
+    if (n_refreshes == 0)
+        return TRUE;
+
+    session = index_session_lookup(repo, TRUE, error);
+    if (!session)
+        return FALSE;
+
+    g_mutex_lock(&session->lock);
+
+    index_session_sync(session);
+
+    for (guint i = 0; i < n_refreshes; i++)
+    {
+        TgpIndexOp op = { TGP_INDEX_OP_REFRESH, (gchar *)refreshes[i].path };
+        const git_index_entry *current = git_index_get_bypath(session->index, op.path, 0);
+
+        git_oid_cpy(&op.id, &refreshes[i].id);
+        op.st = refreshes[i].st;
+
+        /* Already up to date, e.g. refreshed by an earlier scan: nothing to write */
+        if (!current || !git_oid_equal(&current->id, &op.id) ||
+            index_session_entry_has_stat(current, &op.st))
+            continue;
+
+        if (index_session_apply(session, &op) != 0)
+        {
+            g_set_error(error, 0, 0, "Failed to refresh index entry for: %s", op.path);
+            success = FALSE;
+            break;
+        }
+
+        op.path = g_strdup(op.path);
+        g_array_append_val(session->pending, op);
+        n_applied++;
+    }
+
+    if (n_applied > 0)
+        index_session_schedule_flush(session, TGP_INDEX_SESSION_FLUSH_DELAY_MS);
+
+    g_mutex_unlock(&session->lock);
+
+    return success;
+}
+
+/* Whether anything but stat refreshes is pending; session->lock held */
+static gboolean
+index_session_has_mutations(TgpIndexSession *session)
+{
+    for (guint i = 0; i < session->pending->len; i++)
+    {
+        if (g_array_index(session->pending, TgpIndexOp, i).kind != TGP_INDEX_OP_REFRESH)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+gboolean
+tgp_index_session_flush(git_repository *repo, GError **error)
+{
+    TgpIndexSession *session;
+    GList *callbacks = NULL;
+    gchar *workdir = NULL;
+    gboolean success;
+
+    session = index_session_lookup(repo, FALSE, NULL);
+    if (!session)
+        return TRUE;
+
+    g_mutex_lock(&session->lock);
+
+    /*
+     * Readers of .git/index see the same status with or without refreshed
+     * stat data, at most a few more racy entries; those writes are left to
+     * the scheduled flush instead of costing every reader a write.
+     */
+    if (!index_session_has_mutations(session))
+    {
+        g_mutex_unlock(&session->lock);
+        return TRUE;
+    }
+
+    success = index_session_write(session, error);
+    if (success && session->flush_source)
+    {
+        g_source_remove(session->flush_source);
+        session->flush_source = 0;
+    }
+
+    if (success)
+    {
+        session->retries = 0;
+        callbacks = session->callbacks;
+        session->callbacks = NULL;
+        workdir = g_strdup(git_repository_workdir(session->repo));
+    }
+
+    g_mutex_unlock(&session->lock);
+
+    /* Not inline: the caller may hold things the callbacks need */
+    if (callbacks)
+        index_session_push_job(NULL, workdir, callbacks);
+    g_free(workdir);
+
+    return success;
+}
+
+void
+tgp_index_session_when_flushed(git_repository *repo, TgpIndexFlushedFunc func,
+                               gpointer user_data, GDestroyNotify destroy)
+{
+    TgpIndexSession *session;
+    gboolean queued = FALSE;
+
+    g_return_if_fail(func != NULL);
+
+    session = index_session_lookup(repo, FALSE, NULL);
+    if (session)
+    {
+        g_mutex_lock(&session->lock);
+
+        if (session->pending->len > 0)
+        {
+            TgpFlushedCallback *cb = g_new0(TgpFlushedCallback, 1);
+            cb->func = func;
+            cb->user_data = user_data;
+            cb->destroy = destroy;
+            session->callbacks = g_list_append(session->callbacks, cb);
+            queued = TRUE;
+        }
+
+        g_mutex_unlock(&session->lock);
+    }
+
+    if (!queued)
+    {
+        /* Nothing pending, the on-disk index is already current */
+        TgpFlushedCallback *cb = g_new0(TgpFlushedCallback, 1);
+        cb->func = func;
+        cb->user_data = user_data;
+        cb->destroy = destroy;
+        index_session_push_job(NULL, git_repository_workdir(repo), g_list_append(NULL, cb));
+    }
+}
+
+void
+tgp_index_session_shutdown(void)
+{
+    GHashTableIter iter;
+    gpointer value;
+    GThreadPool *old_pool;
+
+    /* Let running writes and callbacks finish; later jobs run where they are pushed */
+    g_mutex_lock(&sessions_mutex);
+    old_pool = flush_pool;
+    flush_pool = NULL;
+    g_mutex_unlock(&sessions_mutex);
+
+    if (old_pool)
+        g_thread_pool_free(old_pool, FALSE, TRUE);
+
+    g_mutex_lock(&sessions_mutex);
+
+    if (sessions)
+    {
+        g_hash_table_iter_init(&iter, sessions);
+        while (g_hash_table_iter_next(&iter, NULL, &value))
+        {
+            TgpIndexSession *session = value;
+            GError *error = NULL;
+
+            g_mutex_lock(&session->lock);
+            if (!index_session_write(session, &error))
+            {
+                g_warning("Index changes lost on shutdown: %s", error->message);
+                g_error_free(error);
+            }
+            g_mutex_unlock(&session->lock);
+        }
+
+        g_hash_table_destroy(sessions);
+        sessions = NULL;
+    }
+
+    g_mutex_unlock(&sessions_mutex);
+}
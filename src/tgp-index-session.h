@@ -0,0 +1,60 @@
+/*
+ * Thunar Git Plugin - Coalesced Index Sessions
+ * Copyright (C) 2025 MiniMax Agent
+ */
+
+#ifndef __TGP_INDEX_SESSION_H__
+#define __TGP_INDEX_SESSION_H__
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <git2.h>
+
+G_BEGIN_DECLS
+
+/* Idle window after the last mutation before the index is written out */
+#define TGP_INDEX_SESSION_FLUSH_DELAY_MS 750
+
+/* Failed writes, with the delay doubling each time, before callbacks get the error */
+#define TGP_INDEX_SESSION_MAX_RETRIES    6
+
+/* error is set if the mutations could not be written, they stay queued then */
+typedef void (*TgpIndexFlushedFunc)(const gchar *workdir, const GError *error,
+                                    gpointer user_data);
+
+/* A file whose content was hashed and found equal to its index entry */
+typedef struct {
+    const gchar *path;   /* Relative to the workdir */
+    git_oid      id;     /* Blob the entry has to still point at */
+    GStatBuf     st;     /* lstat() taken before hashing */
+} TgpIndexRefresh;
+
+/* Initialize/cleanup; shutdown writes out any pending mutations */
+void     tgp_index_session_init(void);
+void     tgp_index_session_shutdown(void);
+
+/* Batched mutations, paths are relative to the repository workdir */
+gboolean tgp_index_session_add_paths(git_repository *repo, GPtrArray *paths, GError **error);
+gboolean tgp_index_session_remove_paths(git_repository *repo, GPtrArray *paths, GError **error);
+gboolean tgp_index_session_remove_conflict(git_repository *repo, const gchar *path, GError **error);
+
+/* Record fresh stat data for verified files so they need no hashing next time */
+gboolean tgp_index_session_refresh(git_repository *repo, const TgpIndexRefresh *refreshes,
+                                   guint n_refreshes, GError **error);
+
+/*
+ * Write pending mutations now, for operations that read .git/index from disk.
+ * Pending stat refreshes alone are left to the scheduled write.
+ */
+gboolean tgp_index_session_flush(git_repository *repo, GError **error);
+
+/*
+ * Run func on a worker thread once the pending mutations of repo have
+ * reached disk, or right away there if nothing is pending
+ */
+void     tgp_index_session_when_flushed(git_repository *repo, TgpIndexFlushedFunc func,
+                                        gpointer user_data, GDestroyNotify destroy);
+
+G_END_DECLS
+
+#endif /* __TGP_INDEX_SESSION_H__ */
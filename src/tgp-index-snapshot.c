@@ -0,0 +1,700 @@
+/*
+ * Thunar Git Plugin - Shared Index Snapshots Implementation
+ * Copyright (C) 2025 MiniMax Agent
+ *
+ * Parsing .git/index is the expensive part of most status and conflict
+ * queries. One parsed copy per repository is shared here and only thrown
+ * away when the index file changed: its stat data is compared on every
+ * request, and if that differs the 20-byte trailing checksum decides
+ * whether the content really changed. Anything derived from the entries,
+ * such as the conflict list and which entries differ from HEAD, is computed
+ * once per reload; a moved HEAD forces a reload too. Concurrent requests
+ * for the same version of the file share a single load.
+ *
+ * Resolving HEAD reads a ref file or two on every request, so for gitdirs
+ * the watch module monitors the commit it resolved to is kept next to the
+ * snapshot and only resolved again once the monitor reports a change.
+ *
+ * Snapshots reflect the file on disk; pending index session mutations have
+ * to be flushed first (tgp_git_sync_index() does that).
+ */
+
+#include "tgp-index-snapshot.h"
+#include "tgp-git-utils.h"
+#include "tgp-flight.h"
+#include <sys/stat.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+typedef struct {
+    git_oid   id;
+    gboolean  resolved;     /* id is current until the next change */
+    guint     generation;   /* Bumped by every change */
+} SnapshotHead;
+
+/*
+ * Published snapshot and the index file it was last seen as; that moves on
+ * when the file is rewritten with the same content, the snapshot doesn't.
+ */
+typedef struct {
+    TgpIndexSnapshot *snapshot;
+    guint64           file_ino;
+    gint64            file_size;
+    gint64            file_mtime;
+} SnapshotCached;
+
+static GHashTable *snapshots = NULL;   /* gitdir -> SnapshotCached */
+static GHashTable *heads = NULL;       /* Monitored gitdir -> SnapshotHead */
+static GMutex snapshots_mutex;
+
+TgpIndexSnapshot*
+tgp_index_snapshot_ref(TgpIndexSnapshot *snapshot)
+{
+    g_atomic_int_inc(&snapshot->ref_count);
+    return snapshot;
+}
+
+void
+tgp_index_snapshot_unref(TgpIndexSnapshot *snapshot)
+{
+    if (!snapshot || !g_atomic_int_dec_and_test(&snapshot->ref_count))
+        return;
+
+    g_array_unref(snapshot->conflicts);
+    g_ptr_array_unref(snapshot->staged_deletions);
+    g_array_unref(snapshot->entries);
+    g_string_free(snapshot->paths, TRUE);
+    g_free(snapshot);
+}
+
+static void
+snapshot_cached_free(SnapshotCached *cached)
+{
+    tgp_index_snapshot_unref(cached->snapshot);
+    g_free(cached);
+}
+
+void
+tgp_index_snapshot_init(void)
+{
+    g_mutex_lock(&snapshots_mutex);
+    if (!snapshots)
+    {
+        snapshots = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                          (GDestroyNotify)snapshot_cached_free);
+        heads = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    }
+    g_mutex_unlock(&snapshots_mutex);
+}
+
+void
+tgp_index_snapshot_shutdown(void)
+{
+    g_mutex_lock(&snapshots_mutex);
+    if (snapshots)
+    {
+        g_hash_table_destroy(snapshots);
+        g_hash_table_destroy(heads);
+        snapshots = NULL;
+        heads = NULL;
+    }
+    g_mutex_unlock(&snapshots_mutex);
+}
+
+void
+tgp_index_snapshot_watch_head(const gchar *gitdir)
+{
+    g_return_if_fail(gitdir != NULL);
+
+    g_mutex_lock(&snapshots_mutex);
+    if (heads && !g_hash_table_contains(heads, gitdir))
+        g_hash_table_insert(heads, g_strdup(gitdir), g_new0(SnapshotHead, 1));
+    g_mutex_unlock(&snapshots_mutex);
+}
+
+void
+tgp_index_snapshot_head_changed(const gchar *gitdir)
+{
+    SnapshotHead *head;
+
+    g_return_if_fail(gitdir != NULL);
+
+    g_mutex_lock(&snapshots_mutex);
+    head = heads ? g_hash_table_lookup(heads, gitdir) : NULL;
+    if (head)
+    {
+        head->resolved = FALSE;
+        head->generation++;
+    }
+    g_mutex_unlock(&snapshots_mutex);
+}
+
+/* The commit HEAD of repo points to, all zeroes on an unborn branch */
+static void
+snapshot_get_head(git_repository *repo, const gchar *gitdir, git_oid *head_id)
+{
+    SnapshotHead *head;
+    gboolean monitored = FALSE;
+    guint generation = 0;
+
+    g_mutex_lock(&snapshots_mutex);
+    head = heads ? g_hash_table_lookup(heads, gitdir) : NULL;
+    if (head && head->resolved)
+    {
+        git_oid_cpy(head_id, &head->id);
+        g_mutex_unlock(&snapshots_mutex);
+        return;
+    }
+    if (head)
+    {
+        monitored = TRUE;
+        generation = head->generation;
+    }
+    g_mutex_unlock(&snapshots_mutex);
+
+    if (git_reference_name_to_id(head_id, repo, "HEAD") != 0)
+        memset(head_id, 0, sizeof(*head_id));
+
+    if (!monitored)
+        return;
+
+    /* Unless it changed while we were reading it */
+    g_mutex_lock(&snapshots_mutex);
+    head = heads ? g_hash_table_lookup(heads, gitdir) : NULL;
+    if (head && head->generation == generation)
+    {
+        git_oid_cpy(&head->id, head_id);
+        head->resolved = TRUE;
+    }
+    g_mutex_unlock(&snapshots_mutex);
+}
+
+static gboolean
+snapshot_read_checksum(const gchar *index_path, guint8 *checksum)
+{
+    gboolean success = FALSE;
+    int fd = g_open(index_path, O_RDONLY, 0);
+
+    if (fd < 0)
+        return FALSE;
+
+    if (lseek(fd, -GIT_OID_RAWSZ, SEEK_END) >= 0 &&
+        read(fd, checksum, GIT_OID_RAWSZ) == GIT_OID_RAWSZ)
+        success = TRUE;
+
+    close(fd);
+    return success;
+}
+
+static gint
+snapshot_entry_cmp(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    const TgpIndexEntry *ea = a, *eb = b;
+    const gchar *paths = user_data;
+    gint cmp = strcmp(paths + ea->path_offset, paths + eb->path_offset);
+
+    if (cmp != 0)
+        return cmp;
+
+    return GIT_INDEX_ENTRY_STAGE(ea) - GIT_INDEX_ENTRY_STAGE(eb);
+}
+
+/* Group the stage 1-3 entries of each conflicted path */
+static void
+snapshot_collect_conflicts(TgpIndexSnapshot *snapshot)
+{
+    TgpConflict *current = NULL;
+
+    for (guint i = 0; i < snapshot->entries->len; i++)
+    {
+        const TgpIndexEntry *entry = &g_array_index(snapshot->entries, TgpIndexEntry, i);
+        const gchar *path = tgp_index_snapshot_entry_path(snapshot, entry);
+        int stage = GIT_INDEX_ENTRY_STAGE(entry);
+
+        if (stage == 0)
+            continue;
+
+        if (!current || strcmp(current->path, path) != 0)
+        {
+            TgpConflict conflict = { 0 };
+
+            conflict.path = g_strdup(path);
+            conflict.mode = entry->mode;
+            g_array_append_val(snapshot->conflicts, conflict);
+            current = &g_array_index(snapshot->conflicts, TgpConflict,
+                                     snapshot->conflicts->len - 1);
+        }
+
+        switch (stage)
+        {
+            case 1:
+                git_oid_cpy(&current->ancestor, &entry->id);
+                current->has_ancestor = TRUE;
+                break;
+            case 2:
+                git_oid_cpy(&current->ours, &entry->id);
+                current->has_ours = TRUE;
+                current->mode = entry->mode;
+                break;
+            case 3:
+                git_oid_cpy(&current->theirs, &entry->id);
+                current->has_theirs = TRUE;
+                if (!current->has_ours)
+                    current->mode = entry->mode;
+                break;
+        }
+    }
+
+    snapshot->has_conflicts = snapshot->conflicts->len > 0;
+}
+
+static const TgpIndexEntry*
+snapshot_find_stage(TgpIndexSnapshot *snapshot, const gchar *path, int stage)
+{
+    guint lo = 0, hi = snapshot->entries->len;
+
+    while (lo < hi)
+    {
+        guint mid = lo + (hi - lo) / 2;
+        const TgpIndexEntry *entry = &g_array_index(snapshot->entries, TgpIndexEntry, mid);
+        gint cmp = strcmp(path, tgp_index_snapshot_entry_path(snapshot, entry));
+
+        if (cmp == 0)
+            cmp = stage - GIT_INDEX_ENTRY_STAGE(entry);
+
+        if (cmp == 0)
+            return entry;
+
+        if (cmp > 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return NULL;
+}
+
+/* Mark the stage-0 entries whose content is staged relative to HEAD */
+static void
+snapshot_collect_staged(TgpIndexSnapshot *snapshot, git_repository *repo, git_index *index,
+                        const git_oid *head_id)
+{
+    git_commit *head = NULL;
+    git_tree *tree = NULL;
+    git_diff *diff = NULL;
+    git_diff_options opts;
+
+    git_oid_cpy(&snapshot->head_id, head_id);
+    if (git_oid_is_zero(head_id))
+    {
+        /* Unborn branch, everything in the index is new */
+        for (guint i = 0; i < snapshot->entries->len; i++)
+            g_array_index(snapshot->entries, TgpIndexEntry, i).staged = GIT_STATUS_INDEX_NEW;
+        return;
+    }
+
+    if (git_commit_lookup(&head, repo, &snapshot->head_id) != 0 ||
+        git_commit_tree(&tree, head) != 0)
+        goto out;
+
+    git_diff_options_init(&opts, GIT_DIFF_OPTIONS_VERSION);
+    if (git_diff_tree_to_index(&diff, repo, tree, index, &opts) != 0)
+        goto out;
+
+    for (size_t i = 0; i < git_diff_num_deltas(diff); i++)
+    {
+        const git_diff_delta *delta = git_diff_get_delta(diff, i);
+        TgpIndexEntry *entry;
+
+        if (delta->status == GIT_DELTA_DELETED)
+        {
+            g_ptr_array_add(snapshot->staged_deletions, g_strdup(delta->old_file.path));
+            continue;
+        }
+
+        entry = (TgpIndexEntry *)snapshot_find_stage(snapshot, delta->new_file.path, 0);
+        if (!entry)
+            continue;
+
+        if (delta->status == GIT_DELTA_ADDED)
+            entry->staged = GIT_STATUS_INDEX_NEW;
+        else if (delta->status == GIT_DELTA_TYPECHANGE)
+            entry->staged = GIT_STATUS_INDEX_TYPECHANGE;
+        else
+            entry->staged = GIT_STATUS_INDEX_MODIFIED;
+    }
+
+out:
+    if (diff) git_diff_free(diff);
+    if (tree) git_tree_free(tree);
+    if (head) git_commit_free(head);
+}
+
+static TgpIndexSnapshot*
+snapshot_load(git_repository *repo, const gchar *index_path, const git_oid *head_id)
+{
+    TgpIndexSnapshot *snapshot;
+    git_index *index;
+    gsize count;
+
+    if (git_index_open(&index, index_path) != 0)
+        return NULL;
+
+    count = git_index_entrycount(index);
+
+    snapshot = g_new0(TgpIndexSnapshot, 1);
+    snapshot->ref_count = 1;
+    snapshot->entries = g_array_sized_new(FALSE, FALSE, sizeof(TgpIndexEntry), count);
+    snapshot->paths = g_string_sized_new(count * 32);
+    snapshot->conflicts = g_array_new(FALSE, TRUE, sizeof(TgpConflict));
+    g_array_set_clear_func(snapshot->conflicts, tgp_conflict_clear);
+    snapshot->staged_deletions = g_ptr_array_new_with_free_func(g_free);
+
+    for (gsize i = 0; i < count; i++)
+    {
+        const git_index_entry *src = git_index_get_byindex(index, i);
+        TgpIndexEntry entry;
+
+        if (!src)
+            continue;
+
+        entry.path_offset = snapshot->paths->len;
+        entry.mode = src->mode;
+        entry.mtime_sec = src->mtime.seconds;
+        entry.mtime_nsec = src->mtime.nanoseconds;
+        entry.ctime_sec = src->ctime.seconds;
+        entry.ctime_nsec = src->ctime.nanoseconds;
+        entry.dev = src->dev;
+        entry.ino = src->ino;
+        entry.uid = src->uid;
+        entry.gid = src->gid;
+        entry.file_size = src->file_size;
+        git_oid_cpy(&entry.id, &src->id);
+        entry.flags = src->flags;
+        entry.flags_extended = src->flags_extended;
+        entry.staged = 0;
+
+        g_string_append(snapshot->paths, src->path);
+        g_string_append_c(snapshot->paths, '\0');
+        g_array_append_val(snapshot->entries, entry);
+    }
+
+    /* libgit2 may keep a case-insensitive order; lookups here use strcmp() */
+    g_array_sort_with_data(snapshot->entries, snapshot_entry_cmp, snapshot->paths->str);
+    snapshot_collect_conflicts(snapshot);
+    snapshot_collect_staged(snapshot, repo, index, head_id);
+
+    git_index_free(index);
+
+    return snapshot;
+}
+
+static gint64
+snapshot_stat_mtime(const GStatBuf *st)
+{
+    return (gint64)st->st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) + st->st_mtim.tv_nsec;
+}
+
+static gboolean
+snapshot_cached_matches_stat(SnapshotCached *cached, const GStatBuf *st)
+{
+    return cached->file_ino == (guint64)st->st_ino &&
+           cached->file_size == (gint64)st->st_size &&
+           cached->file_mtime == snapshot_stat_mtime(st);
+}
+
+static void
+snapshot_cached_set_stat(SnapshotCached *cached, const GStatBuf *st)
+{
+    cached->file_ino = st->st_ino;
+    cached->file_size = st->st_size;
+    cached->file_mtime = snapshot_stat_mtime(st);
+}
+
+typedef struct {
+    git_repository *repo;
+    const gchar    *index_path;
+    const GStatBuf *st;
+    const git_oid  *head_id;
+} SnapshotLoad;
+
+static gpointer
+snapshot_load_flight(gpointer user_data)
+{
+    SnapshotLoad *load = user_data;
+    const gchar *gitdir = git_repository_path(load->repo);
+    TgpIndexSnapshot *snapshot = snapshot_load(load->repo, load->index_path, load->head_id);
+
+    if (snapshot)
+    {
+        SnapshotCached *cached = g_new(SnapshotCached, 1);
+
+        /* Complete before anyone else gets to see it */
+        snapshot->file_ino = load->st->st_ino;
+        snapshot->file_size = load->st->st_size;
+        snapshot->file_mtime = snapshot_stat_mtime(load->st);
+        snapshot_read_checksum(load->index_path, snapshot->checksum);
+
+        cached->snapshot = tgp_index_snapshot_ref(snapshot);
+        snapshot_cached_set_stat(cached, load->st);
+
+        g_mutex_lock(&snapshots_mutex);
+        if (snapshots)
+            g_hash_table_replace(snapshots, g_strdup(gitdir), cached);
+        else
+            snapshot_cached_free(cached);
+        g_mutex_unlock(&snapshots_mutex);
+    }
+
+    return snapshot;
+}
+
+/*
+ * Shared snapshot of repo's index, NULL if it has none yet.
+ * Release with tgp_index_snapshot_unref().
+ */
+TgpIndexSnapshot*
+tgp_index_snapshot_get(git_repository *repo)
+{
+    const gchar *gitdir;
+    gchar index_path[4096];
+    TgpIndexSnapshot *snapshot = NULL;
+    TgpIndexSnapshot *cached = NULL;
+    SnapshotCached *entry;
+    guint8 checksum[GIT_OID_RAWSZ];
+    gchar head_hex[GIT_OID_HEXSZ + 1];
+    git_oid head_id;
+    SnapshotLoad load;
+    GStatBuf st;
+    gchar key[4096 + 128];
+
+    g_return_val_if_fail(repo != NULL, NULL);
+
+    /* Called for every folder shown: no allocation until the index has to be read */
+    gitdir = git_repository_path(repo);
+    if (g_snprintf(index_path, sizeof(index_path), "%s%sindex", gitdir,
+                   g_str_has_suffix(gitdir, "/") ? "" : "/") >= (gint)sizeof(index_path))
+        return NULL;
+
+    if (g_stat(index_path, &st) != 0)
+        return NULL;
+
+    snapshot_get_head(repo, gitdir, &head_id);
+
+    g_mutex_lock(&snapshots_mutex);
+    entry = snapshots ? g_hash_table_lookup(snapshots, gitdir) : NULL;
+    if (entry && !git_oid_equal(&entry->snapshot->head_id, &head_id))
+        entry = NULL;
+    if (entry && snapshot_cached_matches_stat(entry, &st))
+        snapshot = tgp_index_snapshot_ref(entry->snapshot);
+    else if (entry)
+        cached = tgp_index_snapshot_ref(entry->snapshot);
+    g_mutex_unlock(&snapshots_mutex);
+
+    if (snapshot)
+        return snapshot;
+
+    /*
+     * Touched but rewritten with the same content: keep the parsed copy and
+     * remember the file as it is now. The snapshot keeps its older mtime,
+     * which at worst has a few more entries hashed as racily clean.
+     */
+    if (cached && snapshot_read_checksum(index_path, checksum) &&
+        memcmp(checksum, cached->checksum, GIT_OID_RAWSZ) == 0)
+    {
+        g_mutex_lock(&snapshots_mutex);
+        entry = snapshots ? g_hash_table_lookup(snapshots, gitdir) : NULL;
+        if (entry && entry->snapshot == cached)
+            snapshot_cached_set_stat(entry, &st);
+        g_mutex_unlock(&snapshots_mutex);
+
+        return cached;
+    }
+
+    if (cached)
+        tgp_index_snapshot_unref(cached);
+
+    /* One load per version of the index file and HEAD */
+    load.repo = repo;
+    load.index_path = index_path;
+    load.st = &st;
+    load.head_id = &head_id;
+    git_oid_tostr(head_hex, sizeof(head_hex), &head_id);
+    g_snprintf(key, sizeof(key), "index:%s:%" G_GUINT64_FORMAT ":%" G_GINT64_FORMAT ":%"
+               G_GINT64_FORMAT ".%09ld:%s", gitdir, (guint64)st.st_ino,
+               (gint64)st.st_size, (gint64)st.st_mtim.tv_sec,
+               (long)st.st_mtim.tv_nsec, head_hex);
+    snapshot = tgp_flight_do(key, snapshot_load_flight, &load,
+                             (GBoxedCopyFunc)tgp_index_snapshot_ref,
+                             (GDestroyNotify)tgp_index_snapshot_unref);
+
+    return snapshot;
+}
+
+const TgpIndexEntry*
+tgp_index_snapshot_find(TgpIndexSnapshot *snapshot, const gchar *path)
+{
+    g_return_val_if_fail(snapshot != NULL && path != NULL, NULL);
+
+    return snapshot_find_stage(snapshot, path, 0);
+}
+
+/* Paths below "dir/" are one run in strcmp order, look at where it would start */
+gboolean
+tgp_index_snapshot_tracks_below(TgpIndexSnapshot *snapshot, const gchar *dir)
+{
+    gsize len;
+    guint lo = 0, hi;
+    const gchar *path;
+
+    g_return_val_if_fail(snapshot != NULL && dir != NULL, FALSE);
+
+    len = strlen(dir);
+    hi = snapshot->entries->len;
+    if (len == 0)
+        return hi > 0;
+
+    while (lo < hi)
+    {
+        guint mid = lo + (hi - lo) / 2;
+        const TgpIndexEntry *entry = &g_array_index(snapshot->entries, TgpIndexEntry, mid);
+        gint cmp;
+
+        path = tgp_index_snapshot_entry_path(snapshot, entry);
+        cmp = strncmp(path, dir, len);
+        if (cmp == 0)
+            cmp = (guchar)path[len] - '/';
+
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo == snapshot->entries->len)
+        return FALSE;
+
+    path = tgp_index_snapshot_entry_path(snapshot,
+                                         &g_array_index(snapshot->entries, TgpIndexEntry, lo));
+    return strncmp(path, dir, len) == 0 && path[len] == '/';
+}
+
+/*
+ * Compare an entry's stat data with lstat() of its worktree file, the way
+ * git's ie_match_stat() does. Entries written in the same second as the
+ * index itself are "racily clean" and have to be hashed; so do entries
+ * whose timestamps or inode moved while the size stayed the same (touch,
+ * checkout of identical content). A changed size is a modification.
+ */
+TgpIndexStatMatch
+tgp_index_snapshot_match_stat(TgpIndexSnapshot *snapshot, const TgpIndexEntry *entry,
+                              const GStatBuf *st)
+{
+    gint64 entry_mtime;
+
+    if (entry->mode != GIT_FILEMODE_BLOB && entry->mode != GIT_FILEMODE_BLOB_EXECUTABLE)
+        return TGP_INDEX_STAT_UNKNOWN;
+
+    /* Type change, or a mode change core.filemode may ignore */
+    if (!S_ISREG(st->st_mode) ||
+        ((st->st_mode & S_IXUSR) != 0) != (entry->mode == GIT_FILEMODE_BLOB_EXECUTABLE))
+        return TGP_INDEX_STAT_UNKNOWN;
+
+    if (entry->file_size != (guint32)st->st_size)
+        return TGP_INDEX_STAT_MODIFIED;
+
+    if (entry->mtime_sec != (gint32)st->st_mtim.tv_sec ||
+        entry->mtime_nsec != (guint32)st->st_mtim.tv_nsec ||
+        entry->ctime_sec != (gint32)st->st_ctim.tv_sec ||
+        entry->ctime_nsec != (guint32)st->st_ctim.tv_nsec ||
+        entry->ino != (guint32)st->st_ino)
+        return TGP_INDEX_STAT_RACY;
+
+    entry_mtime = (gint64)entry->mtime_sec * G_GINT64_CONSTANT(1000000000) + entry->mtime_nsec;
+    if (entry_mtime >= snapshot->file_mtime)
+        return TGP_INDEX_STAT_RACY;
+
+    return TGP_INDEX_STAT_CLEAN;
+}
+
+static void
+snapshot_add_parent_dir(GHashTable *dirs, const gchar *path)
+{
+    const gchar *slash = strrchr(path, '/');
+
+    g_hash_table_add(dirs, slash ? g_strndup(path, slash - path) : g_strdup(""));
+}
+
+/*
+ * Same status for the entry's path. Stat data is left out: every git status
+ * refreshes it, and a file whose content changed is reported by the watcher.
+ */
+static gboolean
+snapshot_entries_equal(const TgpIndexEntry *a, const TgpIndexEntry *b)
+{
+    return a->mode == b->mode &&
+           a->flags == b->flags &&
+           a->staged == b->staged &&
+           git_oid_equal(&a->id, &b->id);
+}
+
+/*
+ * Both entry arrays are sorted the same way, so one merge pass finds every
+ * added, removed or changed entry; the cost is linear in the index, but no
+ * file is touched.
+ */
+void
+tgp_index_snapshot_collect_changed_dirs(TgpIndexSnapshot *old_snapshot,
+                                        TgpIndexSnapshot *new_snapshot,
+                                        GHashTable *dirs)
+{
+    guint i = 0, j = 0;
+
+    if (old_snapshot == new_snapshot)
+        return;
+
+    while (i < old_snapshot->entries->len || j < new_snapshot->entries->len)
+    {
+        const TgpIndexEntry *a = i < old_snapshot->entries->len ?
+            &g_array_index(old_snapshot->entries, TgpIndexEntry, i) : NULL;
+        const TgpIndexEntry *b = j < new_snapshot->entries->len ?
+            &g_array_index(new_snapshot->entries, TgpIndexEntry, j) : NULL;
+        gint cmp;
+
+        if (!a)
+            cmp = 1;
+        else if (!b)
+            cmp = -1;
+        else
+        {
+            cmp = strcmp(tgp_index_snapshot_entry_path(old_snapshot, a),
+                         tgp_index_snapshot_entry_path(new_snapshot, b));
+            if (cmp == 0)
+                cmp = GIT_INDEX_ENTRY_STAGE(a) - GIT_INDEX_ENTRY_STAGE(b);
+        }
+
+        if (cmp < 0)
+        {
+            snapshot_add_parent_dir(dirs, tgp_index_snapshot_entry_path(old_snapshot, a));
+            i++;
+        }
+        else if (cmp > 0)
+        {
+            snapshot_add_parent_dir(dirs, tgp_index_snapshot_entry_path(new_snapshot, b));
+            j++;
+        }
+        else
+        {
+            if (!snapshot_entries_equal(a, b))
+                snapshot_add_parent_dir(dirs, tgp_index_snapshot_entry_path(new_snapshot, b));
+            i++;
+            j++;
+        }
+    }
+
+    for (i = 0; i < old_snapshot->staged_deletions->len; i++)
+        snapshot_add_parent_dir(dirs, g_ptr_array_index(old_snapshot->staged_deletions, i));
+    for (i = 0; i < new_snapshot->staged_deletions->len; i++)
+        snapshot_add_parent_dir(dirs, g_ptr_array_index(new_snapshot->staged_deletions, i));
+}
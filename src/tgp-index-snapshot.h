@@ -0,0 +1,92 @@
+/*
+ * Thunar Git Plugin - Shared Index Snapshots
+ * Copyright (C) 2025 MiniMax Agent
+ */
+
+#ifndef __TGP_INDEX_SNAPSHOT_H__
+#define __TGP_INDEX_SNAPSHOT_H__
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <git2.h>
+
+G_BEGIN_DECLS
+
+/* Stage-0 and conflict entries as stored in .git/index */
+typedef struct {
+    guint32  path_offset;    /* Into TgpIndexSnapshot.paths */
+    guint32  mode;
+    gint32   mtime_sec;
+    guint32  mtime_nsec;
+    gint32   ctime_sec;
+    guint32  ctime_nsec;
+    guint32  dev;
+    guint32  ino;
+    guint32  uid;
+    guint32  gid;
+    guint32  file_size;
+    git_oid  id;
+    guint16  flags;          /* GIT_INDEX_ENTRY_STAGEMASK etc. */
+    guint16  flags_extended;
+    guint8   staged;         /* GIT_STATUS_INDEX_* bits against HEAD */
+} TgpIndexEntry;
+
+/* Read-only once published; hold a reference while using it */
+typedef struct {
+    gint      ref_count;
+    GArray   *entries;        /* TgpIndexEntry, sorted by path, then stage */
+    GString  *paths;          /* NUL-separated entry paths */
+    GArray   *conflicts;      /* TgpConflict, see tgp-git-utils.h */
+    GPtrArray *staged_deletions; /* Paths in HEAD but not in the index */
+    gboolean  has_conflicts;
+    gint64    file_mtime;     /* Index file these entries were read from */
+    gint64    file_size;
+    guint64   file_ino;
+    guint8    checksum[GIT_OID_RAWSZ];
+    git_oid   head_id;        /* Commit the staged bits were computed against */
+} TgpIndexSnapshot;
+
+/* Initialize/cleanup */
+void               tgp_index_snapshot_init(void);
+void               tgp_index_snapshot_shutdown(void);
+
+/*
+ * HEAD of gitdir (as git_repository_path() has it) is monitored from now on:
+ * keep what it resolves to until tgp_index_snapshot_head_changed() is called.
+ */
+void               tgp_index_snapshot_watch_head(const gchar *gitdir);
+void               tgp_index_snapshot_head_changed(const gchar *gitdir);
+
+/* Snapshot of repo's on-disk index, reloaded only if the file or HEAD changed */
+TgpIndexSnapshot*  tgp_index_snapshot_get(git_repository *repo);
+TgpIndexSnapshot*  tgp_index_snapshot_ref(TgpIndexSnapshot *snapshot);
+void               tgp_index_snapshot_unref(TgpIndexSnapshot *snapshot);
+
+/* Binary search for the stage-0 entry of path, NULL if not tracked */
+const TgpIndexEntry* tgp_index_snapshot_find(TgpIndexSnapshot *snapshot, const gchar *path);
+
+/* TRUE if any entry lies below directory dir (relative, without trailing '/') */
+gboolean           tgp_index_snapshot_tracks_below(TgpIndexSnapshot *snapshot, const gchar *dir);
+
+#define tgp_index_snapshot_entry_path(s, e) ((s)->paths->str + (e)->path_offset)
+
+/* What an entry's recorded stat data says about the worktree file */
+typedef enum {
+    TGP_INDEX_STAT_CLEAN,      /* Unchanged */
+    TGP_INDEX_STAT_MODIFIED,   /* Size differs */
+    TGP_INDEX_STAT_RACY,       /* Same size, content has to be hashed */
+    TGP_INDEX_STAT_UNKNOWN     /* Not a plain file on one side, ask libgit2 */
+} TgpIndexStatMatch;
+
+/* Add the parent directory of every path whose entry differs to dirs (a set) */
+void              tgp_index_snapshot_collect_changed_dirs(TgpIndexSnapshot *old_snapshot,
+                                                          TgpIndexSnapshot *new_snapshot,
+                                                          GHashTable *dirs);
+
+TgpIndexStatMatch tgp_index_snapshot_match_stat(TgpIndexSnapshot *snapshot,
+                                                const TgpIndexEntry *entry,
+                                                const GStatBuf *st);
+
+G_END_DECLS
+
+#endif /* __TGP_INDEX_SNAPSHOT_H__ */
@@ -0,0 +1,293 @@
+/*
+ * Thunar Git Plugin - Background Jobs Implementation
+ * Copyright (C) 2025 MiniMax Agent
+ *
+ * Long-running git operations run off the GTK thread, so Thunar stays
+ * responsive, and in their repository's turn on the executor, so two jobs
+ * on one repository never overlap. Progress is handed to the main loop
+ * through a single pending idle source, however often the worker reports
+ * it. Paths the job rewrote get their emblems refreshed on the worker
+ * before the job is reported as done.
+ */
+
+#include "tgp-job.h"
+#include "tgp-git-utils.h"
+#include "tgp-executor.h"
+#include "tgp-plugin.h"
+#include <gio/gio.h>
+#include <string.h>
+
+struct _TgpJob
+{
+    gint            ref_count;
+    gchar          *title;
+    gchar          *repo_path;
+    TgpJobFunc      func;
+    TgpJobDoneFunc  done;
+    gpointer        user_data;
+    GDestroyNotify  destroy;
+
+    /* Progress window, main thread only */
+    GtkWidget      *window;
+    GtkWidget      *label;
+    GtkWidget      *progress_bar;
+
+    /* Shared with the worker, guarded by lock */
+    GMutex          lock;
+    gdouble         fraction;
+    gchar          *text;
+    guint           progress_source;
+    GPtrArray      *touched_paths;
+};
+
+static TgpJob*
+tgp_job_ref(TgpJob *job)
+{
+    g_atomic_int_inc(&job->ref_count);
+    return job;
+}
+
+static void
+tgp_job_unref(TgpJob *job)
+{
+    if (!g_atomic_int_dec_and_test(&job->ref_count))
+        return;
+
+    if (job->destroy)
+        job->destroy(job->user_data);
+
+    g_ptr_array_unref(job->touched_paths);
+    g_mutex_clear(&job->lock);
+    g_free(job->text);
+    g_free(job->repo_path);
+    g_free(job->title);
+    g_free(job);
+}
+
+static gboolean
+tgp_job_progress_idle(gpointer user_data)
+{
+    TgpJob *job = user_data;
+    gdouble fraction;
+    gchar *text;
+
+    g_mutex_lock(&job->lock);
+    job->progress_source = 0;
+    fraction = job->fraction;
+    text = g_strdup(job->text);
+    g_mutex_unlock(&job->lock);
+
+    if (job->window)
+    {
+        if (fraction < 0)
+            gtk_progress_bar_pulse(GTK_PROGRESS_BAR(job->progress_bar));
+        else
+            gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(job->progress_bar), fraction);
+
+        if (text)
+            gtk_label_set_text(GTK_LABEL(job->label), text);
+    }
+
+    g_free(text);
+    return G_SOURCE_REMOVE;
+}
+
+void
+tgp_job_set_progress(TgpJob *job, gdouble fraction, const gchar *text)
+{
+    g_return_if_fail(job != NULL);
+
+    g_mutex_lock(&job->lock);
+
+    job->fraction = fraction;
+    if (text)
+    {
+        g_free(job->text);
+        job->text = g_strdup(text);
+    }
+
+    if (!job->progress_source)
+    {
+        job->progress_source = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE,
+                                               tgp_job_progress_idle,
+                                               tgp_job_ref(job),
+                                               (GDestroyNotify)tgp_job_unref);
+    }
+
+    g_mutex_unlock(&job->lock);
+}
+
+void
+tgp_job_add_touched_path(TgpJob *job, const gchar *path)
+{
+    g_return_if_fail(job != NULL);
+
+    g_mutex_lock(&job->lock);
+    g_ptr_array_add(job->touched_paths, g_strdup(path));
+    g_mutex_unlock(&job->lock);
+}
+
+GPtrArray*
+tgp_job_get_touched_paths(TgpJob *job)
+{
+    return job->touched_paths;
+}
+
+void
+tgp_job_checkout_notify(const gchar *path, guint n_updated, gpointer user_data)
+{
+    (void)n_updated;
+    tgp_job_add_touched_path(user_data, path);
+}
+
+void
+tgp_job_checkout_progress(gsize completed, gsize total, gpointer user_data)
+{
+    gchar *text;
+
+    if (total == 0)
+        return;
+
+    text = g_strdup_printf("Updating files: %" G_GSIZE_FORMAT " of %" G_GSIZE_FORMAT,
+                           completed, total);
+    tgp_job_set_progress(user_data, (gdouble)completed / total, text);
+    g_free(text);
+}
+
+typedef struct {
+    TgpJob   *job;
+    gboolean  success;
+    GError   *error;
+} TgpJobRun;
+
+/* Runs in the repository's turn on its executor */
+static void
+tgp_job_execute(git_repository *repo, gpointer user_data)
+{
+    TgpJobRun *run = user_data;
+    TgpJob *job = run->job;
+
+    run->success = job->func(job, repo, job->user_data, &run->error);
+    if (!run->success)
+        return;
+
+    /* Refresh exactly the paths the job rewrote instead of rescanning */
+    if (job->touched_paths->len > 0)
+    {
+        tgp_job_set_progress(job, -1, "Updating emblems...");
+        tgp_plugin_update_emblems_for_paths(repo, job->touched_paths);
+    }
+}
+
+static void
+tgp_job_thread(GTask *task, gpointer source_object, gpointer task_data,
+               GCancellable *cancellable)
+{
+    TgpJobRun run = { task_data, FALSE, NULL };
+
+    (void)source_object;
+    (void)cancellable;
+
+    if (!tgp_executor_run(run.job->repo_path, tgp_job_execute, &run))
+    {
+        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                                "Unable to open repository");
+        return;
+    }
+
+    if (!run.success)
+    {
+        g_task_return_error(task, run.error);
+        return;
+    }
+
+    g_task_return_boolean(task, TRUE);
+}
+
+static void
+tgp_job_finished(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+    TgpJob *job = user_data;
+    GError *error = NULL;
+    gboolean success;
+
+    (void)source_object;
+
+    success = g_task_propagate_boolean(G_TASK(result), &error);
+
+    if (job->window)
+    {
+        gtk_widget_destroy(job->window);
+        job->window = NULL;
+    }
+
+    if (job->done)
+        job->done(job, success, error, job->user_data);
+
+    if (error)
+        g_error_free(error);
+
+    tgp_job_unref(job);
+}
+
+static GtkWidget*
+tgp_job_create_window(TgpJob *job, GtkWindow *parent)
+{
+    GtkWidget *window, *box;
+
+    window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_title(GTK_WINDOW(window), job->title);
+    gtk_window_set_default_size(GTK_WINDOW(window), 400, -1);
+    gtk_window_set_deletable(GTK_WINDOW(window), FALSE);
+    if (parent)
+    {
+        gtk_window_set_transient_for(GTK_WINDOW(window), parent);
+        gtk_window_set_position(GTK_WINDOW(window), GTK_WIN_POS_CENTER_ON_PARENT);
+    }
+
+    box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 10);
+    gtk_container_set_border_width(GTK_CONTAINER(box), 15);
+    gtk_container_add(GTK_CONTAINER(window), box);
+
+    job->label = gtk_label_new(job->title);
+    gtk_widget_set_halign(job->label, GTK_ALIGN_START);
+    gtk_label_set_ellipsize(GTK_LABEL(job->label), PANGO_ELLIPSIZE_MIDDLE);
+    gtk_box_pack_start(GTK_BOX(box), job->label, FALSE, FALSE, 0);
+
+    job->progress_bar = gtk_progress_bar_new();
+    gtk_box_pack_start(GTK_BOX(box), job->progress_bar, FALSE, FALSE, 0);
+
+    gtk_widget_show_all(window);
+    return window;
+}
+
+void
+tgp_job_run(GtkWindow *parent, const gchar *title, const gchar *repo_path,
+            TgpJobFunc func, TgpJobDoneFunc done,
+            gpointer user_data, GDestroyNotify destroy)
+{
+    TgpJob *job;
+    GTask *task;
+
+    g_return_if_fail(func != NULL);
+    g_return_if_fail(repo_path != NULL);
+
+    job = g_new0(TgpJob, 1);
+    job->ref_count = 1;
+    job->title = g_strdup(title);
+    job->repo_path = g_strdup(repo_path);
+    job->func = func;
+    job->done = done;
+    job->user_data = user_data;
+    job->destroy = destroy;
+    job->fraction = -1;
+    job->touched_paths = g_ptr_array_new_with_free_func(g_free);
+    g_mutex_init(&job->lock);
+
+    job->window = tgp_job_create_window(job, parent);
+
+    task = g_task_new(NULL, NULL, tgp_job_finished, job);
+    g_task_set_task_data(task, job, NULL);
+    g_task_run_in_thread(task, tgp_job_thread);
+    g_object_unref(task);
+}
@@ -0,0 +1,46 @@
+/*
+ * Thunar Git Plugin - Background Jobs
+ * Copyright (C) 2025 MiniMax Agent
+ */
+
+#ifndef __TGP_JOB_H__
+#define __TGP_JOB_H__
+
+#include <gtk/gtk.h>
+#include <git2.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TgpJob TgpJob;
+
+/*
+ * Runs on a worker thread with the repository's executor handle, which no
+ * other thread uses meanwhile.
+ * Must not touch GTK; report through tgp_job_set_progress() instead.
+ */
+typedef gboolean (*TgpJobFunc)(TgpJob *job, git_repository *repo,
+                               gpointer user_data, GError **error);
+
+/* Runs on the main thread once the job has finished */
+typedef void (*TgpJobDoneFunc)(TgpJob *job, gboolean success,
+                               const GError *error, gpointer user_data);
+
+/* Start a job, showing a progress window transient for parent */
+void         tgp_job_run(GtkWindow *parent, const gchar *title, const gchar *repo_path,
+                         TgpJobFunc func, TgpJobDoneFunc done,
+                         gpointer user_data, GDestroyNotify destroy);
+
+/* Worker side, safe to call from the job thread */
+void         tgp_job_set_progress(TgpJob *job, gdouble fraction, const gchar *text);
+void         tgp_job_add_touched_path(TgpJob *job, const gchar *path);
+
+/* Ready-made checkout callbacks, pass the job as user_data */
+void         tgp_job_checkout_notify(const gchar *path, guint n_updated, gpointer user_data);
+void         tgp_job_checkout_progress(gsize completed, gsize total, gpointer user_data);
+
+/* Paths reported through tgp_job_add_touched_path(), relative to the workdir */
+GPtrArray*   tgp_job_get_touched_paths(TgpJob *job);
+
+G_END_DECLS
+
+#endif /* __TGP_JOB_H__ */
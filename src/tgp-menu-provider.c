@@ -7,7 +7,9 @@
 #include "tgp-git-utils.h"
 #include "tgp-dialogs.h"
 #include "tgp-emblem-provider.h"
+#include "tgp-discovery.h"
 #include "tgp-plugin.h"
+#include "tgp-job.h"
 #include <string.h>
 
 /* Forward declarations */
@@ -58,10 +60,78 @@ action_data_free(ActionData *data)
     g_free(data);
 }
 
-GList*
-tgp_menu_provider_get_file_items(ThunarxMenuProvider *provider,
-                                  GtkWidget           *window,
-                                  GList               *files)
+/* Local paths of the selected files, to be freed with g_list_free_full(l, g_free) */
+static GList*
+action_data_get_paths(ActionData *data)
+{
+    GList *file_paths = NULL;
+
+    for (GList *l = data->files; l != NULL; l = l->next)
+    {
+        GFile *location = thunarx_file_info_get_location(l->data);
+        if (!location)
+        {
+            continue;
+        }
+
+        gchar *path = g_file_get_path(location);
+        g_object_unref(location);
+
+        if (!path)
+        {
+            continue;
+        }
+        file_paths = g_list_append(file_paths, path);
+    }
+
+    return file_paths;
+}
+
+/*
+ * A menu is the only hint of what the user is looking at: the folder
+ * itself, or the selected files in their folder. Their emblems go first,
+ * and their file infos are told when an emblem changes.
+ */
+static void
+menu_provider_update_view(GList *files, const gchar *file_path, gboolean folder)
+{
+    GPtrArray *visible;
+    gchar *parent;
+
+    for (GList *l = files; l != NULL; l = l->next)
+        tgp_emblem_track_file_info(l->data);
+
+    if (folder)
+    {
+        tgp_plugin_update_emblems_in_view(file_path, NULL);
+        return;
+    }
+
+    parent = g_path_get_dirname(file_path);
+    visible = g_ptr_array_new_with_free_func(g_free);
+
+    for (GList *l = files; l != NULL; l = l->next)
+    {
+        GFile *location = thunarx_file_info_get_location(l->data);
+        gchar *path = location ? g_file_get_path(location) : NULL;
+        gchar *dirname = path ? g_path_get_dirname(path) : NULL;
+
+        if (dirname && strcmp(dirname, parent) == 0)
+            g_ptr_array_add(visible, g_path_get_basename(path));
+
+        g_free(dirname);
+        g_free(path);
+        if (location)
+            g_object_unref(location);
+    }
+
+    tgp_plugin_update_emblems_in_view(parent, visible);
+    g_ptr_array_unref(visible);
+    g_free(parent);
+}
+
+static GList*
+menu_provider_get_items(GtkWidget *window, GList *files, gboolean folder)
 {
     GList *items = NULL;
     ThunarxMenuItem *item, *submenu_item;
@@ -69,8 +139,6 @@ tgp_menu_provider_get_file_items(ThunarxMenuProvider *provider,
     gchar *file_path = NULL;
     gchar *repo_root = NULL;
     git_repository *repo = NULL;
-    
-    (void)provider;
 
     if (files == NULL)
         return NULL;
@@ -92,6 +160,7 @@ tgp_menu_provider_get_file_items(ThunarxMenuProvider *provider,
     if (repo_root)
     {
         repo = tgp_git_open_repository(file_path);
+        menu_provider_update_view(files, file_path, folder);
     }
     
     /* Create main Git submenu */
@@ -243,13 +312,25 @@ tgp_menu_provider_get_file_items(ThunarxMenuProvider *provider,
     return items;
 }
 
+GList*
+tgp_menu_provider_get_file_items(ThunarxMenuProvider *provider,
+                                  GtkWidget           *window,
+                                  GList               *files)
+{
+    (void)provider;
+    return menu_provider_get_items(window, files, FALSE);
+}
+
 GList*
 tgp_menu_provider_get_folder_items(ThunarxMenuProvider *provider,
                                     GtkWidget           *window,
                                     ThunarxFileInfo     *folder)
 {
     GList *files = g_list_append(NULL, folder);
-    GList *items = tgp_menu_provider_get_file_items(provider, window, files);
+    GList *items;
+
+    (void)provider;
+    items = menu_provider_get_items(window, files, TRUE);
     g_list_free(files);
     return items;
 }
@@ -264,220 +345,305 @@ action_commit(ThunarxMenuItem *item, gpointer user_data)
     action_data_free(data);
 }
 
+/*
+ * Mutations run as background jobs, in their repository's turn on its
+ * executor queue: a branch switch or stash running there only delays them,
+ * while the window stays responsive. Results are shown once they are done.
+ */
+typedef struct {
+    GtkWidget *window;          /* Weak, NULL once destroyed */
+    GList     *paths;
+    GPtrArray *touched;
+} FilesJob;
+
+typedef struct {
+    GtkWidget *window;          /* Weak, NULL once destroyed */
+    gchar     *repo_path;
+    gchar     *remote;
+    gchar     *branch;
+    gchar     *username;        /* NULL for stored credentials */
+    gchar     *password;
+    gboolean   pull;
+    gboolean   conflicted;      /* Pull only: merged with conflicts */
+} RemoteJob;
+
+static void
+action_window_set(GtkWidget **slot, GtkWidget *window)
+{
+    *slot = window;
+    if (window)
+        g_object_add_weak_pointer(G_OBJECT(window), (gpointer *)slot);
+}
+
 static void
-action_add(ThunarxMenuItem *item, gpointer user_data)
+action_window_clear(GtkWidget **slot)
 {
-    (void)item;
-    ActionData *data = user_data;
-    git_repository *repo = tgp_git_open_repository(data->repo_path);
-    
-    if (repo)
-    {
-        GList *file_paths = NULL;
-        for (GList *l = data->files; l != NULL; l = l->next)
-        {
-            GFile *location = thunarx_file_info_get_location(l->data);
-            if (!location)
-            {
-                continue;
-            }
+    if (*slot)
+        g_object_remove_weak_pointer(G_OBJECT(*slot), (gpointer *)slot);
+    *slot = NULL;
+}
 
-            gchar *path = g_file_get_path(location);
-            g_object_unref(location);
+static FilesJob*
+files_job_new(ActionData *data)
+{
+    FilesJob *ctx = g_new0(FilesJob, 1);
 
-            if (!path)
-            {
-                continue;
-            }
-            file_paths = g_list_append(file_paths, path);
-        }
-        
-        GError *error = NULL;
-        if (tgp_git_add_files(repo, file_paths, &error))
-        {
-            tgp_show_info_dialog(GTK_WINDOW(data->window),
-                                "Files Added",
-                                "Selected files have been added to the index.");
+    action_window_set(&ctx->window, data->window);
+    ctx->paths = action_data_get_paths(data);
+    ctx->touched = g_ptr_array_new_with_free_func(g_free);
+    return ctx;
+}
 
-            /* Update emblems to reflect new status */
-            tgp_plugin_update_emblems_in_directory(data->repo_path);
-        }
-        else
-        {
-            tgp_show_error_dialog(GTK_WINDOW(data->window),
-                                 "Add Failed",
-                                 error ? error->message : "Unknown error");
-            if (error) g_error_free(error);
-        }
+static void
+files_job_free(gpointer data)
+{
+    FilesJob *ctx = data;
 
-        g_list_free_full(file_paths, g_free);
-        git_repository_free(repo);
+    action_window_clear(&ctx->window);
+    g_ptr_array_unref(ctx->touched);
+    g_list_free_full(ctx->paths, g_free);
+    g_free(ctx);
+}
+
+static void
+action_clear_secret(gchar *secret)
+{
+    if (!secret)
+        return;
+
+    memset(secret, 0, strlen(secret));
+    g_free(secret);
+}
+
+static void
+remote_job_free(gpointer data)
+{
+    RemoteJob *ctx = data;
+
+    action_window_clear(&ctx->window);
+    action_clear_secret(ctx->username);
+    action_clear_secret(ctx->password);
+    g_free(ctx->branch);
+    g_free(ctx->remote);
+    g_free(ctx->repo_path);
+    g_free(ctx);
+}
+
+static gboolean
+files_add_job_run(TgpJob *job, git_repository *repo, gpointer user_data, GError **error)
+{
+    FilesJob *ctx = user_data;
+
+    tgp_job_set_progress(job, -1, "Adding files...");
+    if (!tgp_git_add_files(repo, ctx->paths, ctx->touched, error))
+        return FALSE;
+
+    /* Update emblems once the batched index write has landed */
+    tgp_plugin_update_emblems_when_flushed(repo, ctx->touched);
+    return TRUE;
+}
+
+static void
+files_add_job_done(TgpJob *job, gboolean success, const GError *error, gpointer user_data)
+{
+    FilesJob *ctx = user_data;
+
+    (void)job;
+
+    if (success)
+        tgp_show_info_dialog(GTK_WINDOW(ctx->window),
+                            "Files Added",
+                            "Selected files have been added to the index.");
+    else
+        tgp_show_error_dialog(GTK_WINDOW(ctx->window),
+                             "Add Failed",
+                             error ? error->message : "Unknown error");
+}
+
+static gboolean
+remote_job_run(TgpJob *job, git_repository *repo, gpointer user_data, GError **error)
+{
+    RemoteJob *ctx = user_data;
+    GPtrArray *touched;
+    gboolean success;
+
+    if (!ctx->pull)
+    {
+        tgp_job_set_progress(job, -1, "Pushing...");
+        return tgp_git_push_with_auth(repo, ctx->remote, ctx->branch,
+                                      ctx->username, ctx->password, error);
     }
-    
-    action_data_free(data);
+
+    tgp_job_set_progress(job, -1, "Pulling...");
+    touched = g_ptr_array_new_with_free_func(g_free);
+    success = tgp_git_pull_with_auth(repo, ctx->remote, ctx->branch,
+                                     ctx->username, ctx->password, touched, error);
+    ctx->conflicted = success && tgp_git_has_conflicts(repo);
+
+    /* A failed merge may still have rewritten files */
+    tgp_plugin_update_emblems_when_flushed(repo, touched);
+    g_ptr_array_unref(touched);
+    return success;
+}
+
+static gboolean
+remote_fetch_job_run(TgpJob *job, git_repository *repo, gpointer user_data, GError **error)
+{
+    RemoteJob *ctx = user_data;
+
+    tgp_job_set_progress(job, -1, "Fetching...");
+    return tgp_git_fetch(repo, ctx->remote, error);
 }
 
+static void remote_job_done(TgpJob *job, gboolean success, const GError *error,
+                            gpointer user_data);
+
 static void
-action_push(ThunarxMenuItem *item, gpointer user_data)
+remote_job_start(RemoteJob *ctx)
 {
-    (void)item;
-    ActionData *data = user_data;
-    git_repository *repo;
-    GList *remotes;
-    gchar *remote_name = NULL;
-    gchar *branch_name = NULL;
-    gchar *username = NULL;
-    gchar *password = NULL;
-    gboolean save_credentials = FALSE;
-    GError *error = NULL;
+    tgp_job_run(GTK_WINDOW(ctx->window), ctx->pull ? "Pulling" : "Pushing", ctx->repo_path,
+                remote_job_run, remote_job_done, ctx, remote_job_free);
+}
 
-    repo = tgp_git_open_repository(data->repo_path);
-    if (repo)
+static void
+show_pull_result(GtkWindow *window, const RemoteJob *ctx)
+{
+    if (ctx->conflicted)
     {
-        remotes = tgp_git_get_remotes(repo);
-        if (remotes)
-        {
-            remote_name = (gchar *)remotes->data;
-            branch_name = tgp_git_get_current_branch(repo);
+        tgp_show_error_dialog(window,
+                             "Pull Conflicts",
+                             "The pull was merged with conflicts. Use Git > Resolve Conflicts... and commit the result.");
+    }
+    else
+    {
+        tgp_show_info_dialog(window,
+                            "Pull Successful",
+                            "Changes pulled from remote successfully.");
+    }
+}
 
-            if (remote_name && branch_name)
-            {
-                /* Try to push with stored credentials first */
-                if (!tgp_git_push_with_auth(repo, remote_name, branch_name,
-                                           NULL, NULL, &error))
-                {
-                    /* Authentication likely failed - ask user for credentials */
-                    if (tgp_show_login_dialog(GTK_WINDOW(data->window), remote_name,
-                                             &username, &password, &save_credentials))
-                    {
-                        /* Try again with provided credentials */
-                        g_error_free(error);
-                        error = NULL;
-                        if (tgp_git_push_with_auth(repo, remote_name, branch_name,
-                                                   username, password, &error))
-                        {
-                            tgp_show_info_dialog(GTK_WINDOW(data->window),
-                                                "Push Successful",
-                                                "Changes pushed to remote successfully.");
-                        }
-                        else
-                        {
-                            tgp_show_error_dialog(GTK_WINDOW(data->window),
-                                                 "Push Failed",
-                                                 error ? error->message : "Unknown error");
-                        }
-                    }
-                }
-                else
-                {
-                    tgp_show_info_dialog(GTK_WINDOW(data->window),
-                                        "Push Successful",
-                                        "Changes pushed to remote successfully.");
-                }
-            }
+static void
+remote_job_done(TgpJob *job, gboolean success, const GError *error, gpointer user_data)
+{
+    RemoteJob *ctx = user_data;
+    GtkWindow *window = GTK_WINDOW(ctx->window);
+    RemoteJob *retry;
+    gboolean save_credentials = FALSE;
 
-            g_list_free_full(remotes, g_free);
-            g_free(branch_name);
-        }
+    (void)job;
 
-        git_repository_free(repo);
+    if (success)
+    {
+        if (ctx->pull)
+            show_pull_result(window, ctx);
+        else
+            tgp_show_info_dialog(window,
+                                "Push Successful",
+                                "Changes pushed to remote successfully.");
+        return;
     }
 
-    if (error)
-        g_error_free(error);
-    if (username)
+    if (ctx->username)
     {
-        memset(username, 0, strlen(username));
-        g_free(username);
+        tgp_show_error_dialog(window,
+                             ctx->pull ? "Pull Failed" : "Push Failed",
+                             error ? error->message : "Unknown error");
+        return;
     }
-    if (password)
+
+    /* Stored credentials failed, most likely - ask the user and try once more */
+    retry = g_new0(RemoteJob, 1);
+    if (!tgp_show_login_dialog(window, ctx->remote,
+                               &retry->username, &retry->password, &save_credentials))
     {
-        memset(password, 0, strlen(password));
-        g_free(password);
+        remote_job_free(retry);
+        return;
     }
 
-    action_data_free(data);
+    action_window_set(&retry->window, ctx->window);
+    retry->repo_path = g_strdup(ctx->repo_path);
+    retry->remote = g_strdup(ctx->remote);
+    retry->branch = g_strdup(ctx->branch);
+    retry->pull = ctx->pull;
+    remote_job_start(retry);
 }
 
 static void
-action_pull(ThunarxMenuItem *item, gpointer user_data)
+fetch_job_done(TgpJob *job, gboolean success, const GError *error, gpointer user_data)
+{
+    RemoteJob *ctx = user_data;
+
+    (void)job;
+
+    if (success)
+    {
+        tgp_show_info_dialog(GTK_WINDOW(ctx->window), 
+                            "Fetch Complete", 
+                            "Successfully fetched from remote.");
+    }
+    else
+    {
+        tgp_show_error_dialog(GTK_WINDOW(ctx->window), 
+                             "Fetch Failed", 
+                             error ? error->message : "Unknown error");
+    }
+}
+
+static void
+action_add(ThunarxMenuItem *item, gpointer user_data)
 {
     (void)item;
     ActionData *data = user_data;
-    git_repository *repo;
-    GList *remotes;
-    gchar *remote_name = NULL;
-    gchar *branch_name = NULL;
-    gchar *username = NULL;
-    gchar *password = NULL;
-    gboolean save_credentials = FALSE;
-    GError *error = NULL;
 
-    repo = tgp_git_open_repository(data->repo_path);
-    if (repo)
+    tgp_job_run(GTK_WINDOW(data->window), "Adding Files", data->repo_path,
+                files_add_job_run, files_add_job_done,
+                files_job_new(data), files_job_free);
+    action_data_free(data);
+}
+
+/* Push or pull the current branch to or from the first remote */
+static void
+action_remote(ActionData *data, gboolean pull)
+{
+    git_repository *repo = tgp_git_open_repository(data->repo_path);
+    GList *remotes = repo ? tgp_git_get_remotes(repo) : NULL;
+    gchar *branch = remotes ? tgp_git_get_current_branch(repo) : NULL;
+
+    if (remotes && remotes->data && branch)
     {
-        remotes = tgp_git_get_remotes(repo);
-        if (remotes)
-        {
-            remote_name = (gchar *)remotes->data;
-            branch_name = tgp_git_get_current_branch(repo);
+        RemoteJob *ctx = g_new0(RemoteJob, 1);
 
-            if (remote_name && branch_name)
-            {
-                /* Try to pull with stored credentials first */
-                if (!tgp_git_pull_with_auth(repo, remote_name, branch_name,
-                                           NULL, NULL, &error))
-                {
-                    /* Authentication likely failed - ask user for credentials */
-                    if (tgp_show_login_dialog(GTK_WINDOW(data->window), remote_name,
-                                             &username, &password, &save_credentials))
-                    {
-                        /* Try again with provided credentials */
-                        g_error_free(error);
-                        error = NULL;
-                        if (tgp_git_pull_with_auth(repo, remote_name, branch_name,
-                                                   username, password, &error))
-                        {
-                            tgp_show_info_dialog(GTK_WINDOW(data->window),
-                                                "Pull Successful",
-                                                "Changes pulled from remote successfully.");
-                        }
-                        else
-                        {
-                            tgp_show_error_dialog(GTK_WINDOW(data->window),
-                                                 "Pull Failed",
-                                                 error ? error->message : "Unknown error");
-                        }
-                    }
-                }
-                else
-                {
-                    tgp_show_info_dialog(GTK_WINDOW(data->window),
-                                        "Pull Successful",
-                                        "Changes pulled from remote successfully.");
-                }
-            }
+        action_window_set(&ctx->window, data->window);
+        ctx->repo_path = g_strdup(data->repo_path);
+        ctx->remote = g_strdup(remotes->data);
+        ctx->branch = g_steal_pointer(&branch);
+        ctx->pull = pull;
 
-            g_list_free_full(remotes, g_free);
-            g_free(branch_name);
-        }
+        /* Stored credentials first */
+        remote_job_start(ctx);
+    }
 
+    g_free(branch);
+    g_list_free_full(remotes, g_free);
+    if (repo)
         git_repository_free(repo);
-    }
+}
 
-    if (error)
-        g_error_free(error);
-    if (username)
-    {
-        memset(username, 0, strlen(username));
-        g_free(username);
-    }
-    if (password)
-    {
-        memset(password, 0, strlen(password));
-        g_free(password);
-    }
+static void
+action_push(ThunarxMenuItem *item, gpointer user_data)
+{
+    (void)item;
+    ActionData *data = user_data;
+    action_remote(data, FALSE);
+    action_data_free(data);
+}
 
+static void
+action_pull(ThunarxMenuItem *item, gpointer user_data)
+{
+    (void)item;
+    ActionData *data = user_data;
+    action_remote(data, TRUE);
     action_data_free(data);
 }
 
@@ -551,6 +717,9 @@ action_init(ThunarxMenuItem *item, gpointer user_data)
     
     if (git_repository_init(&repo, data->repo_path, 0) == 0)
     {
+        /* Don't wait for the directory monitor to notice the new .git */
+        tgp_discovery_invalidate(data->repo_path);
+        
         tgp_show_info_dialog(GTK_WINDOW(data->window), 
                             "Repository Created", 
                             "Git repository initialized successfully.");
@@ -566,6 +735,38 @@ action_init(ThunarxMenuItem *item, gpointer user_data)
     action_data_free(data);
 }
 
+static gboolean
+files_revert_job_run(TgpJob *job, git_repository *repo, gpointer user_data, GError **error)
+{
+    FilesJob *ctx = user_data;
+
+    tgp_job_set_progress(job, -1, "Discarding changes...");
+    return tgp_git_revert_files(repo, ctx->paths,
+                                tgp_job_checkout_notify, tgp_job_checkout_progress,
+                                job, error);
+}
+
+static void
+files_revert_job_done(TgpJob *job, gboolean success, const GError *error, gpointer user_data)
+{
+    FilesJob *ctx = user_data;
+
+    if (success)
+    {
+        guint n_reverted = tgp_job_get_touched_paths(job)->len;
+        gchar *message = g_strdup_printf("Local changes have been discarded (%u file%s restored).",
+                                         n_reverted, n_reverted == 1 ? "" : "s");
+        tgp_show_info_dialog(GTK_WINDOW(ctx->window), "Changes Reverted", message);
+        g_free(message);
+    }
+    else
+    {
+        tgp_show_error_dialog(GTK_WINDOW(ctx->window),
+                             "Revert Failed",
+                             error ? error->message : "Unknown error");
+    }
+}
+
 static void
 action_revert(ThunarxMenuItem *item, gpointer user_data)
 {
@@ -576,17 +777,17 @@ action_revert(ThunarxMenuItem *item, gpointer user_data)
                                                 GTK_DIALOG_MODAL,
                                                 GTK_MESSAGE_WARNING,
                                                 GTK_BUTTONS_YES_NO,
-                                                "Are you sure you want to discard all local changes?");
+                                                "Are you sure you want to discard local changes to the selected files?");
+    gint response = gtk_dialog_run(GTK_DIALOG(dialog));
+    gtk_widget_destroy(dialog);
     
-    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_YES)
+    if (response == GTK_RESPONSE_YES)
     {
-        /* TODO: Implement revert */
-        tgp_show_info_dialog(GTK_WINDOW(data->window), 
-                            "Changes Reverted", 
-                            "Local changes have been discarded.");
+        tgp_job_run(GTK_WINDOW(data->window), "Reverting Changes", data->repo_path,
+                    files_revert_job_run, files_revert_job_done,
+                    files_job_new(data), files_job_free);
     }
     
-    gtk_widget_destroy(dialog);
     action_data_free(data);
 }
 
@@ -604,27 +805,14 @@ action_fetch(ThunarxMenuItem *item, gpointer user_data)
 {
     (void)item;
     ActionData *data = user_data;
-    git_repository *repo = tgp_git_open_repository(data->repo_path);
-    
-    if (repo)
-    {
-        GError *error = NULL;
-        if (tgp_git_pull(repo, "origin", NULL, &error))
-        {
-            tgp_show_info_dialog(GTK_WINDOW(data->window), 
-                                "Fetch Complete", 
-                                "Successfully fetched from remote.");
-        }
-        else
-        {
-            tgp_show_error_dialog(GTK_WINDOW(data->window), 
-                                 "Fetch Failed", 
-                                 error ? error->message : "Unknown error");
-            if (error) g_error_free(error);
-        }
-        git_repository_free(repo);
-    }
-    
+    RemoteJob *ctx = g_new0(RemoteJob, 1);
+
+    action_window_set(&ctx->window, data->window);
+    ctx->repo_path = g_strdup(data->repo_path);
+    ctx->remote = g_strdup("origin");
+
+    tgp_job_run(GTK_WINDOW(data->window), "Fetching", data->repo_path,
+                remote_fetch_job_run, fetch_job_done, ctx, remote_job_free);
     action_data_free(data);
 }
 
@@ -6,8 +6,19 @@
 #include "tgp-plugin.h"
 #include "tgp-menu-provider.h"
 #include "tgp-emblem-provider.h"
+#include "tgp-dialogs.h"
 #include "tgp-git-utils.h"
 #include "tgp-credentials.h"
+#include "tgp-index-session.h"
+#include "tgp-status-table.h"
+#include "tgp-discovery.h"
+#include "tgp-config.h"
+#include "tgp-index-snapshot.h"
+#include "tgp-watch.h"
+#include "tgp-scheduler.h"
+#include "tgp-flight.h"
+#include "tgp-executor.h"
+#include "tgp-scanner.h"
 #include <string.h>
 #include <gio/gio.h>
 
@@ -62,8 +73,6 @@ static void
 tgp_plugin_init(TgpPlugin *plugin, gpointer user_data)
 {
     (void)user_data;
-    plugin->repo_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
-    plugin->status_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
     plugin->cache_timeout = 0;
 }
 
@@ -74,30 +83,174 @@ tgp_plugin_init_adapter(GTypeInstance *instance, gpointer user_data)
 }
 
 /*
- * Helper function to recursively update GVFS emblems for files in a repository
- * This ensures that the file manager displays correct Git status emblems
+ * Absolute and workdir-relative path of one entry of a folder at a time,
+ * built in two buffers reused for every entry
  */
-void
-tgp_plugin_update_emblems_in_directory(const gchar *repo_path)
+typedef struct {
+    GString *file;
+    gsize    file_base;       /* Length of the folder path and its slash */
+    GString *relative;
+    gsize    relative_base;
+} TgpEntryPaths;
+
+static void
+tgp_entry_paths_init(TgpEntryPaths *paths, const gchar *repo_path, const gchar *prefix)
 {
-    git_repository *repo;
-    GDir *dir;
-    const gchar *entry;
-    gchar *file_path;
+    paths->file = g_string_sized_new(256);
+    g_string_append(paths->file, repo_path);
+    if (!g_str_has_suffix(repo_path, "/"))
+        g_string_append_c(paths->file, '/');
+    paths->file_base = paths->file->len;
+
+    paths->relative = g_string_sized_new(256);
+    if (*prefix)
+    {
+        g_string_append(paths->relative, prefix);
+        g_string_append_c(paths->relative, '/');
+    }
+    paths->relative_base = paths->relative->len;
+}
+
+static void
+tgp_entry_paths_set(TgpEntryPaths *paths, const gchar *entry)
+{
+    g_string_truncate(paths->file, paths->file_base);
+    g_string_append(paths->file, entry);
+    g_string_truncate(paths->relative, paths->relative_base);
+    g_string_append(paths->relative, entry);
+}
+
+static void
+tgp_entry_paths_clear(TgpEntryPaths *paths)
+{
+    g_string_free(paths->file, TRUE);
+    g_string_free(paths->relative, TRUE);
+}
+
+/* TRUE if the entry is a directory worth prefetching (not ignored) */
+static gboolean
+tgp_plugin_update_emblem_for_entry(TgpStatusTable *table, TgpIndexSnapshot *snapshot,
+                                   TgpEntryPaths *paths, const gchar *entry, gboolean ignored,
+                                   TgpStatusFlags marker)
+{
+    TgpPackedStatus status;
     TgpStatusFlags flags;
+    gboolean is_dir;
 
-    if (!repo_path)
-        return;
+    tgp_entry_paths_set(paths, entry);
 
-    repo = tgp_git_open_repository(repo_path);
-    if (!repo)
-        return;
+    /* Everything below an ignored directory is ignored, don't look closer */
+    if (ignored)
+    {
+        tgp_emblem_set_git_status_on_file(paths->file->str, TGP_STATUS_IGNORED | marker);
+        return FALSE;
+    }
+
+    is_dir = g_file_test(paths->file->str, G_FILE_TEST_IS_DIR);
+
+    /* Get the Git status for this file */
+    if (is_dir)
+        status = tgp_status_table_aggregate(table, paths->relative->str, snapshot);
+    else if (!tgp_status_table_lookup(table, paths->relative->str, &status))
+        status = 0;
+
+    flags = status ? tgp_status_to_flags(status) : TGP_STATUS_CLEAN;
+
+    /* Update the GVFS attribute to display the emblem */
+    tgp_emblem_set_git_status_on_file(paths->file->str, flags | marker);
+
+    return is_dir && !(flags & TGP_STATUS_IGNORED);
+}
+
+/* Warm the parent and the first subfolders of a shown folder */
+static void
+tgp_plugin_prefetch_around(const gchar *repo_path, const gchar *prefix, GPtrArray *children)
+{
+    if (*prefix)
+    {
+        gchar *parent = g_path_get_dirname(repo_path);
+        tgp_scheduler_push(parent, TGP_PRIORITY_PREFETCH, NULL);
+        g_free(parent);
+    }
+
+    for (guint i = 0; i < children->len; i++)
+    {
+        gchar *child = g_build_filename(repo_path, g_ptr_array_index(children, i), NULL);
+        tgp_scheduler_push(child, TGP_PRIORITY_PREFETCH, NULL);
+        g_free(child);
+    }
+}
+
+/*
+ * Write the emblems of the entries of repo_path from table, visible ones
+ * first, and collect up to TGP_SCHEDULER_PREFETCH_MAX subfolders into
+ * children if given. A quick pass, from the last known table, skips what
+ * would need a walk of its own.
+ */
+static void
+tgp_plugin_write_emblems(git_repository *repo, TgpStatusTable *table, const gchar *repo_path,
+                         const gchar *prefix, GPtrArray *visible, GPtrArray *children,
+                         TgpStatusFlags marker, gboolean quick)
+{
+    GDir *dir;
+    const gchar *entry;
+    GHashTable *done = NULL;
+    TgpEntryPaths paths;
+    TgpIndexSnapshot *snapshot;
+    TgpPackedStatus collapsed_status = 0;
+    gboolean collapsed;
 
     dir = g_dir_open(repo_path, 0, NULL);
     if (!dir)
-    {
-        git_repository_free(repo);
         return;
+
+    table = tgp_status_table_ref(table);
+
+    /* Inside a directory the walk collapsed into one record */
+    collapsed = *prefix && tgp_status_table_lookup_collapsed(table, prefix, &collapsed_status);
+    if (collapsed && !(tgp_status_to_flags(collapsed_status) & TGP_STATUS_IGNORED))
+    {
+        tgp_status_table_unref(table);
+        if (quick)
+        {
+            g_dir_close(dir);
+            return;
+        }
+
+        /* An untracked directory the user opened: list just its contents */
+        table = tgp_status_table_new_for_directory(repo, prefix, TRUE);
+        if (!table)
+        {
+            g_dir_close(dir);
+            return;
+        }
+        collapsed = FALSE;
+    }
+
+    /* Tells a folder of ignored files apart from a tracked one holding some */
+    snapshot = collapsed ? NULL : tgp_index_snapshot_get(repo);
+    tgp_entry_paths_init(&paths, repo_path, prefix);
+
+    if (visible && visible->len > 0)
+    {
+        done = g_hash_table_new(g_str_hash, g_str_equal);
+        for (guint i = 0; i < visible->len; i++)
+        {
+            const gchar *name = g_ptr_array_index(visible, i);
+
+            if (name[0] == '.')
+                continue;
+
+            tgp_entry_paths_set(&paths, name);
+            if (g_file_test(paths.file->str, G_FILE_TEST_EXISTS))
+            {
+                if (tgp_plugin_update_emblem_for_entry(table, snapshot, &paths, name, collapsed,
+                                                       marker) &&
+                    children && children->len < TGP_SCHEDULER_PREFETCH_MAX)
+                    g_ptr_array_add(children, g_strdup(name));
+                g_hash_table_add(done, (gpointer)name);
+            }
+        }
     }
 
     while ((entry = g_dir_read_name(dir)) != NULL)
@@ -106,40 +259,266 @@ tgp_plugin_update_emblems_in_directory(const gchar *repo_path)
         if (entry[0] == '.')
             continue;
 
-        file_path = g_build_filename(repo_path, entry, NULL);
+        if (done && g_hash_table_contains(done, entry))
+            continue;
+
+        if (tgp_plugin_update_emblem_for_entry(table, snapshot, &paths, entry, collapsed, marker) &&
+            children && children->len < TGP_SCHEDULER_PREFETCH_MAX)
+            g_ptr_array_add(children, g_strdup(entry));
+    }
 
-        /* Get the Git status for this file */
-        flags = tgp_git_get_file_status(repo, file_path);
+    tgp_entry_paths_clear(&paths);
+    if (done)
+        g_hash_table_destroy(done);
+    if (snapshot)
+        tgp_index_snapshot_unref(snapshot);
+    tgp_status_table_unref(table);
+    g_dir_close(dir);
+}
 
-        if (flags)
-        {
-            /* Update the GVFS attribute to display the emblem */
-            tgp_emblem_set_git_status_on_file(file_path, flags);
-        }
+/* What tgp_plugin_update_emblems_with_repo() is asked to refresh */
+typedef struct {
+    const gchar *repo_path;
+    TgpPriority  priority;
+    GPtrArray   *visible;
+} TgpDirectoryUpdate;
 
-        g_free(file_path);
+/*
+ * Helper function to update GVFS emblems for the entries of a directory
+ * This ensures that the file manager displays correct Git status emblems.
+ * One status walk fills the repository's status table; every entry is then
+ * a lookup, and subdirectories show the combined state of their contents.
+ * Visible entries are written first. On network mounts the walk covers
+ * only this directory. Prefetches don't rescan or watch the directory,
+ * and only local folders in view cause prefetches.
+ *
+ * While a local repository's status is being revalidated, the last known
+ * one is written first, so emblems show up without waiting for the walk;
+ * the fresh pass then only rewrites the entries whose state changed.
+ */
+static void
+tgp_plugin_update_emblems_with_repo(git_repository *repo, gpointer user_data)
+{
+    TgpDirectoryUpdate *update = user_data;
+    const gchar *repo_path = update->repo_path;
+    TgpPriority priority = update->priority;
+    GPtrArray *visible = update->visible;
+    TgpStatusTable *table;
+    TgpStatusTable *last;
+    const gchar *workdir;
+    const gchar *prefix;
+    GPtrArray *children = NULL;
+    gboolean network;
+    gboolean stale = FALSE;
+
+    workdir = git_repository_workdir(repo);
+    if (!workdir || !g_file_test(repo_path, G_FILE_TEST_IS_DIR))
+        return;
+
+    prefix = g_str_has_prefix(repo_path, workdir) ? repo_path + strlen(workdir) : "";
+
+    network = tgp_config_is_network_path(repo_path);
+    if (network)
+    {
+        table = tgp_status_cache_get_directory(repo, prefix);
+    }
+    else
+    {
+        /* Serve the last known status right away, marked stale only if it is */
+        last = tgp_status_cache_peek(workdir, &stale);
+        if (last && (stale || priority != TGP_PRIORITY_PREFETCH))
+            tgp_plugin_write_emblems(repo, last, repo_path, prefix, visible, NULL,
+                                     stale ? TGP_STATUS_STALE : 0, TRUE);
+        if (last)
+            tgp_status_table_unref(last);
+
+        /* The directory was asked for on purpose, so look at it again */
+        if (priority != TGP_PRIORITY_PREFETCH)
+            tgp_status_cache_mark_dirty(workdir, prefix);
+        table = tgp_status_cache_get(repo);
     }
 
-    g_dir_close(dir);
-    git_repository_free(repo);
+    if (priority != TGP_PRIORITY_PREFETCH)
+        tgp_watch_directory(workdir, git_repository_path(repo), repo_path);
+
+    /* The walk failed; keep whatever emblems are shown */
+    if (!table)
+        return;
+
+    if (priority == TGP_PRIORITY_VISIBLE && !network)
+        children = g_ptr_array_new_with_free_func(g_free);
+
+    tgp_plugin_write_emblems(repo, table, repo_path, prefix, visible, children, 0, FALSE);
+
+    if (children)
+    {
+        tgp_plugin_prefetch_around(repo_path, prefix, children);
+        g_ptr_array_unref(children);
+    }
+
+    tgp_status_table_unref(table);
 }
 
+/* Scheduler entry point; status work only reads, so it may run in parallel */
 static void
-tgp_plugin_finalize(GObject *object)
+tgp_plugin_update_emblems_in_directory_sync(const gchar *repo_path, TgpPriority priority,
+                                            GPtrArray *visible)
 {
-    TgpPlugin *plugin = TGP_PLUGIN(object);
-    
-    if (plugin->repo_cache)
+    TgpDirectoryUpdate update = { repo_path, priority, visible };
+
+    tgp_executor_run_read(repo_path, tgp_plugin_update_emblems_with_repo, &update);
+}
+
+/* Queued emblem work for folders that aren't in front of the user */
+void
+tgp_plugin_update_emblems_in_directory(const gchar *repo_path)
+{
+    if (!repo_path)
+        return;
+
+    tgp_scheduler_push(repo_path, TGP_PRIORITY_FOLDER, NULL);
+}
+
+/*
+ * The user is looking at a folder, and at the named entries in it (or
+ * NULL): update those emblems before anything else
+ */
+void
+tgp_plugin_update_emblems_in_view(const gchar *folder, GPtrArray *visible)
+{
+    if (!folder)
+        return;
+
+    tgp_scheduler_set_current_folder(folder);
+    tgp_scheduler_push(folder, TGP_PRIORITY_VISIBLE, visible);
+}
+
+/*
+ * Refresh the emblems of exactly the given paths (relative to workdir),
+ * e.g. the files a mutation touched, instead of rescanning the repository.
+ * Their folders, and touched folders themselves, are marked dirty, and so
+ * are the folders above them, whose aggregated emblems may change. Only
+ * those of the folders that are shown are redrawn; that rewrites just the
+ * entries whose state changed. Nothing here asks git for a status, so it
+ * is cheap on any thread.
+ */
+static void
+tgp_plugin_refresh_paths(const gchar *workdir, GPtrArray *paths)
+{
+    GHashTable *seen;
+    GHashTable *folders;      /* Set of workdir-relative folders to redraw */
+    GHashTableIter iter;
+    GPtrArray *shown;
+    gpointer key;
+
+    seen = g_hash_table_new(g_str_hash, g_str_equal);
+    folders = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    for (guint i = 0; i < paths->len; i++)
+    {
+        const gchar *path = g_ptr_array_index(paths, i);
+        gchar *file_path;
+        gchar *parent;
+
+        if (!g_hash_table_add(seen, (gpointer)path))
+            continue;
+
+        /* A touched folder is listed again as a whole */
+        file_path = g_build_filename(workdir, path, NULL);
+        if (g_file_test(file_path, G_FILE_TEST_IS_DIR))
+            g_hash_table_add(folders, g_strdup(path));
+        g_free(file_path);
+
+        parent = g_path_get_dirname(path);
+        if (strcmp(parent, ".") == 0)
+        {
+            g_free(parent);
+            parent = g_strdup("");
+        }
+
+        /* Every folder up to the workdir aggregates this path; the set owns parent */
+        while (g_hash_table_add(folders, parent) && *parent)
+        {
+            gchar *up = g_path_get_dirname(parent);
+
+            if (strcmp(up, ".") == 0)
+            {
+                g_free(up);
+                up = g_strdup("");
+            }
+            parent = up;
+        }
+    }
+
+    shown = g_ptr_array_new_with_free_func(g_free);
+    g_hash_table_iter_init(&iter, folders);
+    while (g_hash_table_iter_next(&iter, &key, NULL))
     {
-        g_hash_table_destroy(plugin->repo_cache);
-        plugin->repo_cache = NULL;
+        tgp_status_cache_mark_dirty(workdir, key);
+        g_ptr_array_add(shown, g_build_filename(workdir, key, NULL));
     }
-    
-    if (plugin->status_cache)
+    tgp_watch_refresh_shown(shown);
+
+    g_ptr_array_unref(shown);
+    g_hash_table_destroy(folders);
+    g_hash_table_destroy(seen);
+}
+
+void
+tgp_plugin_update_emblems_for_paths(git_repository *repo, GPtrArray *paths)
+{
+    const gchar *workdir;
+
+    if (!repo || !paths || paths->len == 0)
+        return;
+
+    workdir = git_repository_workdir(repo);
+    if (workdir)
+        tgp_plugin_refresh_paths(workdir, paths);
+}
+
+static gboolean
+tgp_plugin_report_index_error(gpointer user_data)
+{
+    tgp_show_error_dialog(NULL, "Index Not Written", user_data);
+    g_free(user_data);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+tgp_plugin_update_emblems_flushed(const gchar *workdir, const GError *error, gpointer user_data)
+{
+    /* The changes are still queued, but the user should know git doesn't see them yet */
+    if (error)
     {
-        g_hash_table_destroy(plugin->status_cache);
-        plugin->status_cache = NULL;
+        g_idle_add(tgp_plugin_report_index_error,
+                   g_strdup_printf("The index of %s could not be written: %s",
+                                   workdir, error->message));
+        return;
     }
+
+    tgp_plugin_refresh_paths(workdir, user_data);
+}
+
+/*
+ * Like tgp_plugin_update_emblems_for_paths(), for a mutation that went
+ * through the batched index session: wait for its write to land first
+ */
+void
+tgp_plugin_update_emblems_when_flushed(git_repository *repo, GPtrArray *paths)
+{
+    if (!repo || !paths || paths->len == 0)
+        return;
+
+    tgp_index_session_when_flushed(repo, tgp_plugin_update_emblems_flushed,
+                                   g_ptr_array_ref(paths),
+                                   (GDestroyNotify)g_ptr_array_unref);
+}
+
+static void
+tgp_plugin_finalize(GObject *object)
+{
+    TgpPlugin *plugin = TGP_PLUGIN(object);
     
     if (plugin->cache_timeout)
     {
@@ -219,6 +598,30 @@ thunar_extension_initialize(ThunarxProviderPlugin *plugin)
     /* Initialize libgit2 */
     tgp_git_init();
 
+    /* Load settings */
+    tgp_config_init();
+
+    /* Let concurrent identical queries share one computation */
+    tgp_flight_init();
+
+    /* Initialize repository discovery cache */
+    tgp_discovery_init();
+
+    /* Keep repository handles open, one user at a time */
+    tgp_executor_init();
+
+    /* Initialize batched index writes and shared index snapshots */
+    tgp_index_session_init();
+    tgp_index_snapshot_init();
+
+    /* Initialize per-repository status tables and the watches feeding them */
+    tgp_status_cache_init();
+    tgp_watch_init();
+
+    /* Emblem updates run in the background, most visible first */
+    tgp_emblem_init();
+    tgp_scheduler_init(tgp_plugin_update_emblems_in_directory_sync);
+
     /* Register the plugin types */
     tgp_plugin_register_type(plugin);
 
@@ -228,6 +631,17 @@ thunar_extension_initialize(ThunarxProviderPlugin *plugin)
 G_MODULE_EXPORT void
 thunar_extension_shutdown(void)
 {
+    tgp_scheduler_shutdown();
+    tgp_executor_shutdown();
+    tgp_emblem_shutdown();
+    tgp_watch_shutdown();
+    tgp_status_cache_shutdown();
+    tgp_scanner_shutdown();
+    tgp_index_snapshot_shutdown();
+    tgp_index_session_shutdown();
+    tgp_discovery_shutdown();
+    tgp_flight_shutdown();
+    tgp_config_shutdown();
     tgp_git_shutdown();
     tgp_credentials_cleanup();
     g_message("Thunar Git Plugin shut down");
@@ -32,8 +32,6 @@ struct _TgpPlugin
     GObject __parent__;
     
     /* Plugin state */
-    GHashTable *repo_cache;     /* Cache of git repositories */
-    GHashTable *status_cache;   /* Cache of file statuses */
     guint       cache_timeout;  /* Timeout for cache invalidation */
 };
 
@@ -45,6 +43,9 @@ struct _TgpPluginClass
 GType tgp_plugin_get_type(void) G_GNUC_CONST;
 void  tgp_plugin_register_type(ThunarxProviderPlugin *plugin);
 void  tgp_plugin_update_emblems_in_directory(const gchar *repo_path);
+void  tgp_plugin_update_emblems_in_view(const gchar *folder, GPtrArray *visible);
+void  tgp_plugin_update_emblems_for_paths(git_repository *repo, GPtrArray *paths);
+void  tgp_plugin_update_emblems_when_flushed(git_repository *repo, GPtrArray *paths);
 
 /* Git status flags */
 typedef enum {
@@ -59,6 +60,7 @@ typedef enum {
     TGP_STATUS_CLEAN       = 1 << 8,
     TGP_STATUS_AHEAD       = 1 << 9,
     TGP_STATUS_BEHIND      = 1 << 10,
+    TGP_STATUS_STALE       = 1 << 11,   /* Last known state, being revalidated */
 } TgpStatusFlags;
 
 G_END_DECLS
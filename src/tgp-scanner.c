@@ -0,0 +1,733 @@
+/*
+ * Thunar Git Plugin - Parallel Worktree Scanner Implementation
+ * Copyright (C) 2025 MiniMax Agent
+ *
+ * libgit2 walks the worktree on one thread. Most of that walk is stat()
+ * calls whose answer only has to be compared with the index, so the
+ * scanner does that part itself: every directory is one task on a thread
+ * pool shared by all scans, and each task queues its subdirectories as new tasks, so a large
+ * top-level directory is split up while it is being scanned and idle
+ * threads always find work.
+ *
+ * Files whose stat data changed but whose size did not (a checkout, a
+ * build touching everything) are then hashed on the same pool, which is
+ * kept for the life of the plugin, large ones through mmap. Those found unchanged get their fresh stat
+ * data written back to the index, so the next scan is stat-only again.
+ *
+ * The same machinery re-scans a set of changed directories: then only
+ * their direct entries are looked at, and records below them are left to
+ * the caller's existing table.
+ *
+ * Workers never touch the git_repository, which is not thread-safe. What
+ * the scan can't settle (untracked files and directories, symlinks,
+ * submodules, conflicts, files whose raw hash differs and that may just
+ * need a filter such as autocrlf) is handed to libgit2 on the calling
+ * thread afterwards, in one status pass limited to exactly those paths.
+ */
+
+#include "tgp-scanner.h"
+#include "tgp-git-utils.h"
+#include "tgp-index-snapshot.h"
+#include "tgp-index-session.h"
+#include "tgp-config.h"
+#include <sys/stat.h>
+#include <string.h>
+
+typedef struct {
+    gchar        *path;
+    unsigned int  status;     /* git_status_t */
+} ScanRecord;
+
+typedef struct {
+    gchar        *path;
+    guint         entry;      /* Index into the snapshot entries */
+    GStatBuf      st;
+    gboolean      clean;      /* Set by the hashing worker */
+} ScanRacyFile;
+
+typedef struct {
+    const gchar      *workdir;
+    TgpIndexSnapshot *snapshot;
+    guint8           *seen;            /* Per index entry, set by one worker each */
+    gboolean          recursive;
+    GHashTable       *scope_dirs;      /* Directories re-scanned, NULL for all */
+    GPtrArray        *vanished;        /* Scope directories that no longer exist */
+
+    GMutex            mutex;
+    GCond             done;
+    gint              pending;         /* Directories queued or being scanned */
+
+    GArray           *records;         /* ScanRecord */
+    GPtrArray        *unsure_files;    /* Relative paths for libgit2 to classify */
+    GPtrArray        *untracked_dirs;  /* Relative paths, untracked or ignored */
+    GArray           *racy_files;      /* ScanRacyFile */
+} Scan;
+
+typedef struct {
+    GArray    *records;
+    GPtrArray *unsure_files;
+    GPtrArray *untracked_dirs;
+    GArray    *racy_files;
+} ScanResults;
+
+/* One unit of work of some scan on the shared pool */
+typedef struct {
+    GFunc     func;
+    gpointer  data;
+    Scan     *scan;
+} ScanTask;
+
+static GThreadPool *scan_pool = NULL;
+static GMutex scan_pool_mutex;
+
+/* Files at least this large are hashed from a mapping instead of a copy */
+#define SCAN_MMAP_THRESHOLD (64 * 1024)
+
+/* First index entry whose path does not sort before path */
+static guint
+scan_lower_bound(TgpIndexSnapshot *snapshot, const gchar *path)
+{
+    guint lo = 0, hi = snapshot->entries->len;
+
+    while (lo < hi)
+    {
+        guint mid = lo + (hi - lo) / 2;
+        const TgpIndexEntry *entry = &g_array_index(snapshot->entries, TgpIndexEntry, mid);
+
+        if (strcmp(tgp_index_snapshot_entry_path(snapshot, entry), path) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/* Whether the index tracks anything below dir ("dir/" prefix) */
+static gboolean
+scan_has_entries_below(TgpIndexSnapshot *snapshot, const gchar *dir_slash)
+{
+    guint i = scan_lower_bound(snapshot, dir_slash);
+
+    return i < snapshot->entries->len &&
+           g_str_has_prefix(tgp_index_snapshot_entry_path(snapshot,
+                                &g_array_index(snapshot->entries, TgpIndexEntry, i)),
+                            dir_slash);
+}
+
+/* libgit2 doesn't report empty untracked directories either */
+static gboolean
+scan_dir_is_empty(const gchar *path)
+{
+    GDir *dir = g_dir_open(path, 0, NULL);
+    gboolean empty;
+
+    if (!dir)
+        return TRUE;
+
+    empty = g_dir_read_name(dir) == NULL;
+    g_dir_close(dir);
+    return empty;
+}
+
+static void
+scan_add_record(ScanResults *results, gchar *path, unsigned int status)
+{
+    ScanRecord record = { path, status };
+
+    g_array_append_val(results->records, record);
+}
+
+static void scan_push(Scan *scan, GFunc func, gpointer data);
+static void scan_directory(gpointer data, gpointer user_data);
+
+static void
+scan_queue_directory(Scan *scan, gchar *relative_dir)
+{
+    g_atomic_int_inc(&scan->pending);
+    scan_push(scan, scan_directory, relative_dir);
+}
+
+static void
+scan_file(Scan *scan, ScanResults *results, gchar *relative_path, const GStatBuf *st)
+{
+    TgpIndexSnapshot *snapshot = scan->snapshot;
+    guint i = scan_lower_bound(snapshot, relative_path);
+    const TgpIndexEntry *entry;
+
+    if (i >= snapshot->entries->len ||
+        strcmp(tgp_index_snapshot_entry_path(snapshot,
+                   &g_array_index(snapshot->entries, TgpIndexEntry, i)), relative_path) != 0)
+    {
+        /* Untracked, or ignored */
+        g_ptr_array_add(results->unsure_files, relative_path);
+        return;
+    }
+
+    entry = &g_array_index(snapshot->entries, TgpIndexEntry, i);
+    if (GIT_INDEX_ENTRY_STAGE(entry) != 0)
+    {
+        /* Conflicts are looked up from the snapshot afterwards */
+        g_free(relative_path);
+        return;
+    }
+
+    scan->seen[i] = 1;
+
+    switch (tgp_index_snapshot_match_stat(snapshot, entry, st))
+    {
+        case TGP_INDEX_STAT_CLEAN:
+            if (entry->staged)
+                scan_add_record(results, relative_path, entry->staged);
+            else
+                g_free(relative_path);
+            break;
+        case TGP_INDEX_STAT_MODIFIED:
+            scan_add_record(results, relative_path, entry->staged | GIT_STATUS_WT_MODIFIED);
+            break;
+        case TGP_INDEX_STAT_RACY:
+        {
+            ScanRacyFile racy = { relative_path, i, *st, FALSE };
+            g_array_append_val(results->racy_files, racy);
+            break;
+        }
+        case TGP_INDEX_STAT_UNKNOWN:
+            g_ptr_array_add(results->unsure_files, relative_path);
+            break;
+    }
+}
+
+static void
+scan_subdirectory(Scan *scan, ScanResults *results, gchar *relative_path)
+{
+    TgpIndexSnapshot *snapshot = scan->snapshot;
+    gchar *dir_slash = g_strconcat(relative_path, "/", NULL);
+    guint i = scan_lower_bound(snapshot, relative_path);
+    gchar *full_path;
+
+    /* A submodule is a gitlink entry, not a directory of entries */
+    if (i < snapshot->entries->len)
+    {
+        const TgpIndexEntry *entry = &g_array_index(snapshot->entries, TgpIndexEntry, i);
+
+        if (entry->mode == GIT_FILEMODE_COMMIT &&
+            strcmp(tgp_index_snapshot_entry_path(snapshot, entry), relative_path) == 0)
+        {
+            scan->seen[i] = 1;
+            g_ptr_array_add(results->unsure_files, relative_path);
+            g_free(dir_slash);
+            return;
+        }
+    }
+
+    if (scan_has_entries_below(snapshot, dir_slash))
+    {
+        /* Without recursion the caller's records below stay valid */
+        if (scan->recursive)
+            scan_queue_directory(scan, relative_path);
+        else
+            g_free(relative_path);
+        g_free(dir_slash);
+        return;
+    }
+
+    /* Nothing tracked below: one collapsed untracked or ignored record */
+    full_path = g_build_filename(scan->workdir, relative_path, NULL);
+    if (scan_dir_is_empty(full_path))
+        g_free(relative_path);
+    else
+        g_ptr_array_add(results->untracked_dirs, relative_path);
+
+    g_free(full_path);
+    g_free(dir_slash);
+}
+
+static void
+scan_directory(gpointer data, gpointer user_data)
+{
+    Scan *scan = user_data;
+    gchar *relative_dir = data;
+    gchar *full_dir = g_build_filename(scan->workdir, relative_dir, NULL);
+    ScanResults results;
+    const gchar *name;
+    GDir *dir;
+
+    results.records = g_array_new(FALSE, FALSE, sizeof(ScanRecord));
+    results.unsure_files = g_ptr_array_new();
+    results.untracked_dirs = g_ptr_array_new();
+    results.racy_files = g_array_new(FALSE, FALSE, sizeof(ScanRacyFile));
+
+    dir = g_dir_open(full_dir, 0, NULL);
+    while (dir && (name = g_dir_read_name(dir)) != NULL)
+    {
+        gchar *relative_path;
+        gchar *full_path;
+        GStatBuf st;
+
+        if (strcmp(name, ".git") == 0)
+            continue;
+
+        relative_path = *relative_dir ? g_strconcat(relative_dir, "/", name, NULL)
+                                      : g_strdup(name);
+        full_path = g_build_filename(full_dir, name, NULL);
+
+        if (g_lstat(full_path, &st) != 0)
+            g_free(relative_path);
+        else if (S_ISDIR(st.st_mode))
+            scan_subdirectory(scan, &results, relative_path);
+        else
+            scan_file(scan, &results, relative_path, &st);
+
+        g_free(full_path);
+    }
+
+    if (dir)
+        g_dir_close(dir);
+
+    g_mutex_lock(&scan->mutex);
+    g_array_append_vals(scan->records, results.records->data, results.records->len);
+    for (guint i = 0; i < results.unsure_files->len; i++)
+        g_ptr_array_add(scan->unsure_files, g_ptr_array_index(results.unsure_files, i));
+    for (guint i = 0; i < results.untracked_dirs->len; i++)
+        g_ptr_array_add(scan->untracked_dirs, g_ptr_array_index(results.untracked_dirs, i));
+    g_array_append_vals(scan->racy_files, results.racy_files->data, results.racy_files->len);
+
+    if (g_atomic_int_dec_and_test(&scan->pending))
+        g_cond_signal(&scan->done);
+    g_mutex_unlock(&scan->mutex);
+
+    g_array_unref(results.records);
+    g_ptr_array_unref(results.unsure_files);
+    g_ptr_array_unref(results.untracked_dirs);
+    g_array_unref(results.racy_files);
+    g_free(full_dir);
+    g_free(relative_dir);
+}
+
+/* Whether the raw content of path hashes to the blob id, without filters */
+static gboolean
+scan_blob_matches(const gchar *path, goffset size, const git_oid *id)
+{
+    GMappedFile *mapped = NULL;
+    gchar *contents = NULL;
+    const gchar *data;
+    gsize length;
+    GChecksum *checksum;
+    gchar header[32];
+    guint8 digest[GIT_OID_RAWSZ];
+    gsize digest_len = sizeof(digest);
+
+    if (size >= SCAN_MMAP_THRESHOLD)
+    {
+        mapped = g_mapped_file_new(path, FALSE, NULL);
+        if (!mapped)
+            return FALSE;
+
+        data = g_mapped_file_get_contents(mapped);
+        length = g_mapped_file_get_length(mapped);
+    }
+    else
+    {
+        if (!g_file_get_contents(path, &contents, &length, NULL))
+            return FALSE;
+
+        data = contents;
+    }
+
+    checksum = g_checksum_new(G_CHECKSUM_SHA1);
+    g_snprintf(header, sizeof(header), "blob %" G_GSIZE_FORMAT, length);
+    g_checksum_update(checksum, (const guchar *)header, strlen(header) + 1);
+    if (length > 0)
+        g_checksum_update(checksum, (const guchar *)data, length);
+    g_checksum_get_digest(checksum, digest, &digest_len);
+    g_checksum_free(checksum);
+
+    if (mapped)
+        g_mapped_file_unref(mapped);
+    g_free(contents);
+
+    return memcmp(digest, id->id, GIT_OID_RAWSZ) == 0;
+}
+
+static void
+scan_hash_file(gpointer data, gpointer user_data)
+{
+    Scan *scan = user_data;
+    ScanRacyFile *racy = data;
+    const TgpIndexEntry *entry = &g_array_index(scan->snapshot->entries, TgpIndexEntry,
+                                                racy->entry);
+    gchar *full_path = g_build_filename(scan->workdir, racy->path, NULL);
+
+    racy->clean = scan_blob_matches(full_path, racy->st.st_size, &entry->id);
+    g_free(full_path);
+
+    g_mutex_lock(&scan->mutex);
+    if (g_atomic_int_dec_and_test(&scan->pending))
+        g_cond_signal(&scan->done);
+    g_mutex_unlock(&scan->mutex);
+}
+
+static void
+scan_wait(Scan *scan)
+{
+    g_mutex_lock(&scan->mutex);
+    while (g_atomic_int_get(&scan->pending) > 0)
+        g_cond_wait(&scan->done, &scan->mutex);
+    g_mutex_unlock(&scan->mutex);
+}
+
+static void
+scan_task_run(gpointer data, gpointer user_data)
+{
+    ScanTask *task = data;
+
+    (void)user_data;
+
+    task->func(task->data, task->scan);
+    g_free(task);
+}
+
+/* Run func(data, scan) on the shared pool; tasks never wait, so scans can share it */
+static void
+scan_push(Scan *scan, GFunc func, gpointer data)
+{
+    ScanTask *task = g_new(ScanTask, 1);
+
+    task->func = func;
+    task->data = data;
+    task->scan = scan;
+
+    g_mutex_lock(&scan_pool_mutex);
+    if (!scan_pool)
+        scan_pool = g_thread_pool_new(scan_task_run, NULL,
+                                      MAX(g_get_num_processors(), 2), FALSE, NULL);
+    g_thread_pool_push(scan_pool, task, NULL);
+    g_mutex_unlock(&scan_pool_mutex);
+}
+
+/* Hash the racily clean candidates in parallel */
+static void
+scan_hash_racy_files(Scan *scan)
+{
+    if (scan->racy_files->len == 0)
+        return;
+
+    g_atomic_int_set(&scan->pending, scan->racy_files->len);
+    for (guint i = 0; i < scan->racy_files->len; i++)
+        scan_push(scan, scan_hash_file, &g_array_index(scan->racy_files, ScanRacyFile, i));
+
+    scan_wait(scan);
+}
+
+static void
+scan_record_clear(gpointer data)
+{
+    g_free(((ScanRecord *)data)->path);
+}
+
+static void
+scan_racy_file_clear(gpointer data)
+{
+    g_free(((ScanRacyFile *)data)->path);
+}
+
+/* Whether path is a direct entry of a re-scanned directory, or below a vanished one */
+static gboolean
+scan_in_scope(Scan *scan, const gchar *path)
+{
+    const gchar *slash;
+    gchar *parent;
+    gboolean found;
+
+    if (!scan->scope_dirs)
+        return TRUE;
+
+    for (guint i = 0; i < scan->vanished->len; i++)
+    {
+        const gchar *dir = g_ptr_array_index(scan->vanished, i);
+        gsize len = strlen(dir);
+
+        if (len == 0 || (strncmp(path, dir, len) == 0 && path[len] == '/'))
+            return TRUE;
+    }
+
+    slash = strrchr(path, '/');
+    parent = slash ? g_strndup(path, slash - path) : g_strdup("");
+    found = g_hash_table_contains(scan->scope_dirs, parent);
+    g_free(parent);
+
+    return found;
+}
+
+/*
+ * Add libgit2's answer for each of paths, which git_status_file() would
+ * give, from a single status pass: the index and ignore rules are loaded
+ * once and only the named paths are looked at.
+ */
+static void
+scan_resolve_files(git_repository *repo, TgpStatusTableBuilder *builder, GPtrArray *paths)
+{
+    git_status_options opts;
+    git_status_list *list = NULL;
+    gsize count;
+
+    if (paths->len == 0)
+        return;
+
+    git_status_options_init(&opts, GIT_STATUS_OPTIONS_VERSION);
+    opts.show = GIT_STATUS_SHOW_INDEX_AND_WORKDIR;
+    opts.flags = GIT_STATUS_OPT_INCLUDE_UNTRACKED |
+                 GIT_STATUS_OPT_INCLUDE_IGNORED |
+                 GIT_STATUS_OPT_RECURSE_UNTRACKED_DIRS |
+                 GIT_STATUS_OPT_RECURSE_IGNORED_DIRS |
+                 GIT_STATUS_OPT_DISABLE_PATHSPEC_MATCH;
+    opts.pathspec.strings = (char **)paths->pdata;
+    opts.pathspec.count = paths->len;
+
+    if (git_status_list_new(&list, repo, &opts) != 0)
+        return;
+
+    count = git_status_list_entrycount(list);
+    for (gsize i = 0; i < count; i++)
+    {
+        const git_status_entry *entry = git_status_byindex(list, i);
+        const git_diff_delta *delta = entry->index_to_workdir ? entry->index_to_workdir
+                                                              : entry->head_to_index;
+        const gchar *path;
+
+        if (!delta || entry->status == GIT_STATUS_CURRENT)
+            continue;
+
+        path = delta->new_file.path ? delta->new_file.path : delta->old_file.path;
+        tgp_status_table_builder_add(builder, path, entry->status);
+    }
+
+    git_status_list_free(list);
+}
+
+static TgpStatusTable*
+scanner_run(git_repository *repo, GPtrArray *dirs, GPtrArray **vanished)
+{
+    TgpStatusTableBuilder *builder;
+    TgpIndexSnapshot *snapshot;
+    GArray *refreshes;
+    GPtrArray *resolve;
+    GError *error = NULL;
+    const gchar *workdir;
+    gint64 start;
+    Scan scan;
+
+    workdir = git_repository_workdir(repo);
+    if (!workdir)
+        return NULL;
+
+    /* Without collapsed directories there is nothing to gain over libgit2 */
+    if (tgp_config_get_repo_options(workdir) != TGP_CONFIG_DEFAULT_REPO_OPTIONS)
+        return NULL;
+
+    tgp_index_session_flush(repo, NULL);
+
+    snapshot = tgp_index_snapshot_get(repo);
+    if (!snapshot)
+        return NULL;
+
+    start = g_get_monotonic_time();
+
+    memset(&scan, 0, sizeof(scan));
+    scan.workdir = workdir;
+    scan.snapshot = snapshot;
+    scan.seen = g_new0(guint8, MAX(snapshot->entries->len, 1));
+    scan.records = g_array_new(FALSE, FALSE, sizeof(ScanRecord));
+    g_array_set_clear_func(scan.records, scan_record_clear);
+    scan.unsure_files = g_ptr_array_new_with_free_func(g_free);
+    scan.untracked_dirs = g_ptr_array_new_with_free_func(g_free);
+    scan.racy_files = g_array_new(FALSE, FALSE, sizeof(ScanRacyFile));
+    g_array_set_clear_func(scan.racy_files, scan_racy_file_clear);
+    g_mutex_init(&scan.mutex);
+    g_cond_init(&scan.done);
+
+    scan.vanished = g_ptr_array_new_with_free_func(g_free);
+
+    if (!dirs)
+    {
+        scan.recursive = TRUE;
+        scan_queue_directory(&scan, g_strdup(""));
+    }
+    else
+    {
+        scan.scope_dirs = g_hash_table_new(g_str_hash, g_str_equal);
+
+        for (guint i = 0; i < dirs->len; i++)
+        {
+            const gchar *dir = g_ptr_array_index(dirs, i);
+            gchar *full_dir = g_build_filename(workdir, dir, NULL);
+
+            g_hash_table_add(scan.scope_dirs, (gpointer)dir);
+
+            if (g_file_test(full_dir, G_FILE_TEST_IS_DIR))
+                scan_queue_directory(&scan, g_strdup(dir));
+            else
+                g_ptr_array_add(scan.vanished, g_strdup(dir));
+
+            g_free(full_dir);
+        }
+    }
+
+    scan_wait(&scan);
+
+    scan_hash_racy_files(&scan);
+
+    builder = tgp_status_table_builder_new();
+
+    for (guint i = 0; i < scan.records->len; i++)
+    {
+        const ScanRecord *record = &g_array_index(scan.records, ScanRecord, i);
+        tgp_status_table_builder_add(builder, record->path, record->status);
+    }
+
+    /* Tracked entries the walk never met are gone from the worktree */
+    for (guint i = 0; i < snapshot->entries->len; i++)
+    {
+        const TgpIndexEntry *entry = &g_array_index(snapshot->entries, TgpIndexEntry, i);
+
+        const gchar *path = tgp_index_snapshot_entry_path(snapshot, entry);
+
+        if (!scan.seen[i] && GIT_INDEX_ENTRY_STAGE(entry) == 0 && scan_in_scope(&scan, path))
+            tgp_status_table_builder_add(builder, path, entry->staged | GIT_STATUS_WT_DELETED);
+    }
+
+    /* Verified files keep their staged state only and get fresh stat data */
+    refreshes = g_array_new(FALSE, FALSE, sizeof(TgpIndexRefresh));
+    resolve = g_ptr_array_new();
+    for (guint i = 0; i < scan.racy_files->len; i++)
+    {
+        const ScanRacyFile *racy = &g_array_index(scan.racy_files, ScanRacyFile, i);
+        const TgpIndexEntry *entry = &g_array_index(snapshot->entries, TgpIndexEntry,
+                                                    racy->entry);
+        TgpIndexRefresh refresh;
+
+        if (!racy->clean)
+        {
+            g_ptr_array_add(resolve, racy->path);
+            continue;
+        }
+
+        if (entry->staged)
+            tgp_status_table_builder_add(builder, racy->path, entry->staged);
+
+        refresh.path = racy->path;
+        git_oid_cpy(&refresh.id, &entry->id);
+        refresh.st = racy->st;
+        g_array_append_val(refreshes, refresh);
+    }
+
+    if (!tgp_index_session_refresh(repo, (const TgpIndexRefresh *)refreshes->data,
+                                   refreshes->len, &error))
+    {
+        g_warning("%s", error->message);
+        g_error_free(error);
+    }
+
+    /* The rest needs libgit2: filters, ignore rules, submodules */
+    for (guint i = 0; i < scan.unsure_files->len; i++)
+        g_ptr_array_add(resolve, g_ptr_array_index(scan.unsure_files, i));
+
+    for (guint i = 0; i < snapshot->conflicts->len; i++)
+    {
+        const gchar *path = g_array_index(snapshot->conflicts, TgpConflict, i).path;
+
+        if (scan_in_scope(&scan, path))
+            g_ptr_array_add(resolve, (gpointer)path);
+    }
+
+    scan_resolve_files(repo, builder, resolve);
+
+    for (guint i = 0; i < scan.untracked_dirs->len; i++)
+    {
+        gchar *dir_slash = g_strconcat(g_ptr_array_index(scan.untracked_dirs, i), "/", NULL);
+        int ignored = 0;
+
+        git_ignore_path_is_ignored(&ignored, repo, dir_slash);
+        tgp_status_table_builder_add(builder, dir_slash,
+                                     ignored ? GIT_STATUS_IGNORED : GIT_STATUS_WT_NEW);
+        g_free(dir_slash);
+    }
+
+    /* Deleted from the index; a file still on disk was resolved above */
+    for (guint i = 0; i < snapshot->staged_deletions->len; i++)
+    {
+        const gchar *path = g_ptr_array_index(snapshot->staged_deletions, i);
+        gchar *full_path;
+        GStatBuf st;
+
+        if (!scan_in_scope(&scan, path))
+            continue;
+
+        full_path = g_build_filename(workdir, path, NULL);
+        if (g_lstat(full_path, &st) != 0)
+            tgp_status_table_builder_add(builder, path, GIT_STATUS_INDEX_DELETED);
+        g_free(full_path);
+    }
+
+    g_debug("Scanned %s: %u index entries, %u files hashed (%u refreshed), "
+            "%u files and %u directories left to libgit2, %" G_GINT64_FORMAT " ms",
+            workdir, snapshot->entries->len, scan.racy_files->len, refreshes->len,
+            resolve->len, scan.untracked_dirs->len,
+            (g_get_monotonic_time() - start) / 1000);
+
+    if (vanished)
+        *vanished = g_ptr_array_ref(scan.vanished);
+    g_ptr_array_unref(scan.vanished);
+    if (scan.scope_dirs)
+        g_hash_table_destroy(scan.scope_dirs);
+
+    g_ptr_array_unref(resolve);
+    g_array_unref(refreshes);
+    g_array_unref(scan.racy_files);
+
+    g_array_unref(scan.records);
+    g_ptr_array_unref(scan.unsure_files);
+    g_ptr_array_unref(scan.untracked_dirs);
+    g_mutex_clear(&scan.mutex);
+    g_cond_clear(&scan.done);
+    g_free(scan.seen);
+    tgp_index_snapshot_unref(snapshot);
+
+    return tgp_status_table_builder_finish(builder);
+}
+
+void
+tgp_scanner_shutdown(void)
+{
+    GThreadPool *old_pool;
+
+    g_mutex_lock(&scan_pool_mutex);
+    old_pool = scan_pool;
+    scan_pool = NULL;
+    g_mutex_unlock(&scan_pool_mutex);
+
+    if (old_pool)
+        g_thread_pool_free(old_pool, FALSE, TRUE);
+}
+
+TgpStatusTable*
+tgp_scanner_scan(git_repository *repo)
+{
+    g_return_val_if_fail(repo != NULL, NULL);
+
+    return scanner_run(repo, NULL, NULL);
+}
+
+/*
+ * Records for the direct entries of dirs (relative to the workdir, "" is
+ * the top level), for merging into a table with
+ * tgp_status_table_replace_dirs(). dirs that no longer exist are returned
+ * in vanished; the table covers everything that was tracked below them.
+ */
+TgpStatusTable*
+tgp_scanner_scan_directories(git_repository *repo, GPtrArray *dirs, GPtrArray **vanished)
+{
+    g_return_val_if_fail(repo != NULL && dirs != NULL && vanished != NULL, NULL);
+
+    return scanner_run(repo, dirs, vanished);
+}
@@ -0,0 +1,32 @@
+/*
+ * Thunar Git Plugin - Parallel Worktree Scanner
+ * Copyright (C) 2025 MiniMax Agent
+ */
+
+#ifndef __TGP_SCANNER_H__
+#define __TGP_SCANNER_H__
+
+#include <glib.h>
+#include <git2.h>
+#include "tgp-status-table.h"
+
+G_BEGIN_DECLS
+
+/* Wait for the shared worker pool, created on first use, and free it */
+void             tgp_scanner_shutdown(void);
+
+/*
+ * Status of the whole worktree, computed by stat()ing files on several
+ * threads against the index snapshot. NULL if the repository can't be
+ * scanned this way (no index yet, or directory options that need
+ * libgit2's own walk); fall back to a libgit2 status walk then.
+ */
+TgpStatusTable*  tgp_scanner_scan(git_repository *repo);
+
+/* Re-scan of the direct entries of some directories only, same fallback */
+TgpStatusTable*  tgp_scanner_scan_directories(git_repository *repo, GPtrArray *dirs,
+                                              GPtrArray **vanished);
+
+G_END_DECLS
+
+#endif /* __TGP_SCANNER_H__ */
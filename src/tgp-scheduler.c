@@ -0,0 +1,271 @@
+/*
+ * Thunar Git Plugin - Emblem Work Scheduler Implementation
+ * Copyright (C) 2025 MiniMax Agent
+ *
+ * Emblem updates used to run in the order they were asked for, on the
+ * GTK thread. They now go through a small thread pool whose queue is
+ * kept sorted: the entries the user is looking at first, then the rest
+ * of the current folder, then folders being prefetched. Thunar tells
+ * extensions nothing about scrolling, so "looking at" means the folder
+ * and the selection a context menu was opened for.
+ *
+ * A folder is queued at most once. When the user moves on, work still
+ * queued for the folder left behind sorts after the new one, and the
+ * prefetches made for it are dropped when they come up.
+ *
+ * Prefetches warm the folders the user is likely to open next. They have
+ * a pool of their own with a single thread, which waits for the other
+ * pool to be idle before each one, so speculation never competes with
+ * what is on screen. A prefetched folder asked for for real is moved
+ * over to the main pool.
+ */
+
+#include "tgp-scheduler.h"
+#include <string.h>
+
+typedef struct {
+    gchar       *path;
+    TgpPriority  priority;
+    guint        generation;   /* Of the current folder when queued */
+    guint64      seq;          /* Queue order among equals */
+    GPtrArray   *visible;
+    gboolean     cancelled;    /* Prefetch superseded by a real request */
+} SchedulerJob;
+
+static GThreadPool *pool = NULL;
+static GThreadPool *prefetch_pool = NULL;
+static gint running = 0;                   /* Jobs of the main pool being run */
+static TgpSchedulerFunc run_func = NULL;
+static GHashTable *queued = NULL;          /* path -> SchedulerJob, not started */
+static gchar *current_folder = NULL;
+static guint generation = 0;
+static guint64 next_seq = 0;
+static gboolean shutting_down = FALSE;
+static GMutex scheduler_mutex;
+
+static void
+scheduler_job_free(SchedulerJob *job)
+{
+    if (job->visible)
+        g_ptr_array_unref(job->visible);
+    g_free(job->path);
+    g_free(job);
+}
+
+/* Priority after demoting work for folders the user left; scheduler_mutex held */
+static TgpPriority
+scheduler_effective_priority(const SchedulerJob *job)
+{
+    if (job->priority == TGP_PRIORITY_PREFETCH || !current_folder)
+        return job->priority;
+
+    if (strcmp(job->path, current_folder) != 0)
+        return TGP_PRIORITY_PREFETCH;
+
+    return job->priority;
+}
+
+static gint
+scheduler_compare(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    const SchedulerJob *job_a = a;
+    const SchedulerJob *job_b = b;
+    TgpPriority effective_a, effective_b;
+    gint result;
+
+    (void)user_data;
+
+    g_mutex_lock(&scheduler_mutex);
+    effective_a = scheduler_effective_priority(job_a);
+    effective_b = scheduler_effective_priority(job_b);
+
+    if (effective_a != effective_b)
+        result = effective_a < effective_b ? -1 : 1;
+    else if (job_a->priority != job_b->priority)
+        result = job_a->priority < job_b->priority ? -1 : 1;
+    else
+        result = job_a->seq < job_b->seq ? -1 : (job_a->seq > job_b->seq);
+    g_mutex_unlock(&scheduler_mutex);
+
+    return result;
+}
+
+/* Sort the queue again after priorities changed; scheduler_mutex not held */
+static void
+scheduler_resort(void)
+{
+    g_thread_pool_set_sort_function(pool, scheduler_compare, NULL);
+    g_thread_pool_set_sort_function(prefetch_pool, scheduler_compare, NULL);
+}
+
+/* Prefetch queued for a folder the user has left, or no longer needed */
+static gboolean
+scheduler_is_stale(const SchedulerJob *job)
+{
+    gboolean stale;
+
+    g_mutex_lock(&scheduler_mutex);
+    stale = shutting_down || job->cancelled || job->generation != generation;
+    g_mutex_unlock(&scheduler_mutex);
+
+    return stale;
+}
+
+static void
+scheduler_run(gpointer data, gpointer user_data)
+{
+    SchedulerJob *job = data;
+    gboolean skip;
+
+    (void)user_data;
+
+    g_atomic_int_inc(&running);
+
+    g_mutex_lock(&scheduler_mutex);
+    g_hash_table_remove(queued, job->path);
+    skip = shutting_down;
+    g_mutex_unlock(&scheduler_mutex);
+
+    if (!skip)
+        run_func(job->path, job->priority, job->visible);
+
+    g_atomic_int_add(&running, -1);
+    scheduler_job_free(job);
+}
+
+static void
+scheduler_run_prefetch(gpointer data, gpointer user_data)
+{
+    SchedulerJob *job = data;
+    gboolean skip;
+
+    (void)user_data;
+
+    /* Only use what the foreground leaves idle */
+    while (!(skip = scheduler_is_stale(job)) &&
+           (g_atomic_int_get(&running) > 0 || g_thread_pool_unprocessed(pool) > 0))
+        g_usleep(TGP_SCHEDULER_PREFETCH_BACKOFF_MS * 1000);
+
+    g_mutex_lock(&scheduler_mutex);
+    if (!job->cancelled)
+        g_hash_table_remove(queued, job->path);
+    skip = skip || shutting_down || job->cancelled || job->generation != generation;
+    g_mutex_unlock(&scheduler_mutex);
+
+    if (!skip)
+        run_func(job->path, job->priority, job->visible);
+
+    scheduler_job_free(job);
+}
+
+void
+tgp_scheduler_init(TgpSchedulerFunc func)
+{
+    g_return_if_fail(func != NULL);
+
+    if (pool)
+        return;
+
+    run_func = func;
+    shutting_down = FALSE;
+    queued = g_hash_table_new(g_str_hash, g_str_equal);
+    pool = g_thread_pool_new(scheduler_run, NULL, TGP_SCHEDULER_THREADS, FALSE, NULL);
+    prefetch_pool = g_thread_pool_new(scheduler_run_prefetch, NULL, 1, FALSE, NULL);
+    scheduler_resort();
+}
+
+void
+tgp_scheduler_shutdown(void)
+{
+    if (!pool)
+        return;
+
+    /* Queued jobs still pass through scheduler_run, which only frees them now */
+    g_mutex_lock(&scheduler_mutex);
+    shutting_down = TRUE;
+    g_mutex_unlock(&scheduler_mutex);
+
+    g_thread_pool_free(prefetch_pool, FALSE, TRUE);
+    g_thread_pool_free(pool, FALSE, TRUE);
+    prefetch_pool = NULL;
+    pool = NULL;
+
+    g_hash_table_destroy(queued);
+    queued = NULL;
+    g_free(current_folder);
+    current_folder = NULL;
+    run_func = NULL;
+}
+
+void
+tgp_scheduler_set_current_folder(const gchar *path)
+{
+    g_return_if_fail(path != NULL);
+
+    if (!pool)
+        return;
+
+    g_mutex_lock(&scheduler_mutex);
+    if (g_strcmp0(current_folder, path) == 0)
+    {
+        g_mutex_unlock(&scheduler_mutex);
+        return;
+    }
+
+    g_free(current_folder);
+    current_folder = g_strdup(path);
+    generation++;
+    g_mutex_unlock(&scheduler_mutex);
+
+    scheduler_resort();
+}
+
+void
+tgp_scheduler_push(const gchar *path, TgpPriority priority, GPtrArray *visible)
+{
+    SchedulerJob *job;
+
+    g_return_if_fail(path != NULL);
+
+    if (!pool)
+        return;
+
+    g_mutex_lock(&scheduler_mutex);
+    job = g_hash_table_lookup(queued, path);
+    if (job && job->priority == TGP_PRIORITY_PREFETCH && priority != TGP_PRIORITY_PREFETCH)
+    {
+        /* Wanted for real now, leave the prefetch pool behind */
+        job->cancelled = TRUE;
+        g_hash_table_remove(queued, path);
+        job = NULL;
+    }
+    if (job)
+    {
+        gboolean promoted = priority < job->priority;
+
+        job->priority = MIN(job->priority, priority);
+        job->generation = generation;
+        if (visible)
+        {
+            if (job->visible)
+                g_ptr_array_unref(job->visible);
+            job->visible = g_ptr_array_ref(visible);
+        }
+        g_mutex_unlock(&scheduler_mutex);
+
+        if (promoted)
+            scheduler_resort();
+        return;
+    }
+
+    job = g_new0(SchedulerJob, 1);
+    job->path = g_strdup(path);
+    job->priority = priority;
+    job->generation = generation;
+    job->seq = next_seq++;
+    job->visible = visible ? g_ptr_array_ref(visible) : NULL;
+    g_hash_table_insert(queued, job->path, job);
+    g_mutex_unlock(&scheduler_mutex);
+
+    g_thread_pool_push(priority == TGP_PRIORITY_PREFETCH ? prefetch_pool : pool, job, NULL);
+}
@@ -0,0 +1,54 @@
+/*
+ * Thunar Git Plugin - Emblem Work Scheduler
+ * Copyright (C) 2025 MiniMax Agent
+ */
+
+#ifndef __TGP_SCHEDULER_H__
+#define __TGP_SCHEDULER_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Threads updating emblems; status tables are shared, so few are needed */
+#define TGP_SCHEDULER_THREADS 2
+
+/*
+ * Prefetching runs on one more thread, and only while no other work is
+ * queued or running; it checks again every TGP_SCHEDULER_PREFETCH_BACKOFF_MS.
+ * A shown folder prefetches its parent and at most TGP_SCHEDULER_PREFETCH_MAX
+ * of its subfolders.
+ */
+#define TGP_SCHEDULER_PREFETCH_BACKOFF_MS 50
+#define TGP_SCHEDULER_PREFETCH_MAX        16
+
+/* Most urgent first */
+typedef enum {
+    TGP_PRIORITY_VISIBLE,   /* Entries the user is looking at */
+    TGP_PRIORITY_FOLDER,    /* The rest of a shown folder */
+    TGP_PRIORITY_PREFETCH   /* Folders the user may open next */
+} TgpPriority;
+
+/* Updates the emblems of a folder, the visible entry names (or NULL) first */
+typedef void (*TgpSchedulerFunc)(const gchar *path, TgpPriority priority, GPtrArray *visible);
+
+/* Initialize/cleanup */
+void     tgp_scheduler_init(TgpSchedulerFunc func);
+void     tgp_scheduler_shutdown(void);
+
+/*
+ * The folder the user is in. Queued work for other folders is demoted
+ * behind it, and prefetches queued for an earlier folder are dropped.
+ */
+void     tgp_scheduler_set_current_folder(const gchar *path);
+
+/*
+ * Queue an emblem update of a folder. A folder already queued is not
+ * queued twice; it keeps the more urgent priority. Takes a reference on
+ * visible. May be called from any thread.
+ */
+void     tgp_scheduler_push(const gchar *path, TgpPriority priority, GPtrArray *visible);
+
+G_END_DECLS
+
+#endif /* __TGP_SCHEDULER_H__ */
@@ -0,0 +1,1168 @@
+/*
+ * Thunar Git Plugin - Compact Status Table Implementation
+ * Copyright (C) 2025 MiniMax Agent
+ *
+ * A status table is built once from a status walk and then only read.
+ * Directory paths are interned in one arena and file names are appended
+ * to it; records are kept as parallel arrays (directory id, name offset,
+ * packed status) sorted by directory and name, so a record costs 10 bytes
+ * plus its name, and lookups are two binary searches.
+ *
+ * Directories sort with '/' below every other character, which keeps a
+ * directory and everything beneath it in one contiguous run of records.
+ *
+ * Ignored and untracked directories are normally not descended into: the
+ * walk reports them as one "dir/" record, which stands for everything
+ * below it (see tgp_status_table_lookup_collapsed()).
+ *
+ * The cache keeps each table up to date incrementally: directories whose
+ * entries changed are collected in a dirty set (from the watches, from
+ * plugin actions, and by comparing the index snapshot the table was built
+ * from with the current one), and only those are re-scanned and merged in.
+ * When a table has to be built from scratch, callers asking at the same
+ * time for the same index share a single walk. Invalidating a table only
+ * marks it for rebuilding: until the new one is in, the old one can still
+ * be peeked at, so emblems never have to wait for a walk.
+ */
+
+#include "tgp-status-table.h"
+#include "tgp-git-utils.h"
+#include "tgp-index-session.h"
+#include "tgp-config.h"
+#include "tgp-scanner.h"
+#include "tgp-index-snapshot.h"
+#include "tgp-flight.h"
+#include <string.h>
+
+/* Bits of git_status_t kept in each byte of a packed record */
+#define INDEX_BITS     (GIT_STATUS_INDEX_NEW | GIT_STATUS_INDEX_MODIFIED | \
+                        GIT_STATUS_INDEX_DELETED | GIT_STATUS_INDEX_RENAMED | \
+                        GIT_STATUS_INDEX_TYPECHANGE)
+#define WORKTREE_SHIFT 7
+#define WORKTREE_BITS  (GIT_STATUS_WT_NEW | GIT_STATUS_WT_MODIFIED | \
+                        GIT_STATUS_WT_DELETED | GIT_STATUS_WT_TYPECHANGE | \
+                        GIT_STATUS_WT_RENAMED | GIT_STATUS_WT_UNREADABLE)
+#define PACKED_CONFLICTED 0x0080
+#define PACKED_IGNORED    0x4000
+
+struct _TgpStatusTableBuilder
+{
+    GByteArray *arena;
+    GHashTable *dir_ids;      /* Directory -> id + 1, build time only */
+    GArray     *dir_offsets;  /* guint32 arena offset per directory id */
+    GArray     *entry_dirs;   /* guint32 */
+    GArray     *entry_names;  /* guint32 */
+    GArray     *entry_status; /* TgpPackedStatus */
+    GString    *scratch;
+    gsize       hash_key_bytes;
+};
+
+struct _TgpStatusTable
+{
+    gint             ref_count;
+    gchar           *arena;
+    gsize            arena_size;
+    guint            n_dirs;
+    guint32         *dir_offsets;   /* Sorted by directory */
+    guint            n_entries;
+    guint32         *entry_dirs;    /* Rank into dir_offsets */
+    guint32         *entry_names;
+    TgpPackedStatus *entry_status;
+    gsize            hash_key_bytes;
+};
+
+typedef struct {
+    TgpStatusTable   *table;
+    gint64            expires;      /* Monotonic time in microseconds */
+    TgpIndexSnapshot *snapshot;     /* Index the table reflects, NULL if unknown */
+    GHashTable       *dirty;        /* Relative directories to re-scan */
+    gboolean          invalidated;  /* Expired on purpose since the last request */
+} StatusCacheEntry;
+
+/* Table of one directory on a network mount, see tgp_status_cache_get_directory() */
+typedef struct {
+    TgpStatusTable   *table;
+    gint64            expires;
+    TgpIndexSnapshot *snapshot;     /* Index the table reflects, NULL if unknown */
+} DirectoryCacheEntry;
+
+static GHashTable *status_cache = NULL;
+static GHashTable *directory_cache = NULL;   /* workdir + relative dir -> DirectoryCacheEntry */
+static GMutex status_cache_mutex;
+
+TgpPackedStatus
+tgp_status_pack(unsigned int git_status)
+{
+    TgpPackedStatus status;
+
+    status = git_status & INDEX_BITS;
+    status |= ((git_status & WORKTREE_BITS) >> WORKTREE_SHIFT) << 8;
+
+    if (git_status & GIT_STATUS_CONFLICTED)
+        status |= PACKED_CONFLICTED;
+    if (git_status & GIT_STATUS_IGNORED)
+        status |= PACKED_IGNORED;
+
+    return status;
+}
+
+unsigned int
+tgp_status_unpack(TgpPackedStatus status)
+{
+    unsigned int git_status;
+
+    git_status = status & INDEX_BITS;
+    git_status |= ((status >> 8) << WORKTREE_SHIFT) & WORKTREE_BITS;
+
+    if (status & PACKED_CONFLICTED)
+        git_status |= GIT_STATUS_CONFLICTED;
+    if (status & PACKED_IGNORED)
+        git_status |= GIT_STATUS_IGNORED;
+
+    return git_status;
+}
+
+TgpStatusFlags
+tgp_status_to_flags(TgpPackedStatus status)
+{
+    return tgp_git_status_to_flags(tgp_status_unpack(status));
+}
+
+/* strcmp() with '/' ordered before any other character */
+static gint
+path_cmp_len(const gchar *a, gsize a_len, const gchar *b)
+{
+    gsize i = 0;
+
+    for (; i < a_len && b[i] && a[i] == b[i]; i++)
+        ;
+
+    if (i == a_len)
+        return b[i] ? -1 : 0;
+    if (!b[i])
+        return 1;
+
+    return (a[i] == '/' ? 1 : (guchar)a[i]) - (b[i] == '/' ? 1 : (guchar)b[i]);
+}
+
+static gboolean
+path_is_within(const gchar *path, const gchar *dir, gsize dir_len)
+{
+    return strncmp(path, dir, dir_len) == 0 &&
+           (path[dir_len] == '\0' || path[dir_len] == '/');
+}
+
+/* glibc chunk size of a malloc'd string, for the hash table baseline */
+static gsize
+malloc_chunk_size(gsize len)
+{
+    return MAX(32, (len + 1 + 8 + 15) & ~(gsize)15);
+}
+
+static guint32
+arena_append(GByteArray *arena, const gchar *str, gsize len)
+{
+    guint32 offset = arena->len;
+
+    g_byte_array_append(arena, (const guint8 *)str, len);
+    g_byte_array_append(arena, (const guint8 *)"", 1);
+    return offset;
+}
+
+TgpStatusTableBuilder*
+tgp_status_table_builder_new(void)
+{
+    TgpStatusTableBuilder *builder = g_new0(TgpStatusTableBuilder, 1);
+
+    builder->arena = g_byte_array_new();
+    builder->dir_ids = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    builder->dir_offsets = g_array_new(FALSE, FALSE, sizeof(guint32));
+    builder->entry_dirs = g_array_new(FALSE, FALSE, sizeof(guint32));
+    builder->entry_names = g_array_new(FALSE, FALSE, sizeof(guint32));
+    builder->entry_status = g_array_new(FALSE, FALSE, sizeof(TgpPackedStatus));
+    builder->scratch = g_string_new(NULL);
+
+    return builder;
+}
+
+void
+tgp_status_table_builder_add(TgpStatusTableBuilder *builder,
+                             const gchar *path, unsigned int git_status)
+{
+    const gchar *slash, *name;
+    gsize len = strlen(path);
+    gsize name_len;
+    TgpPackedStatus status = tgp_status_pack(git_status);
+    guint32 dir_id, name_offset;
+    gpointer id;
+
+    /* Collapsed untracked or ignored directories are reported as "dir/" */
+    while (len > 0 && path[len - 1] == '/')
+        len--;
+    if (len == 0)
+        return;
+
+    builder->hash_key_bytes += malloc_chunk_size(len);
+
+    g_string_truncate(builder->scratch, 0);
+    g_string_append_len(builder->scratch, path, len);
+
+    slash = strrchr(builder->scratch->str, '/');
+    name = slash ? slash + 1 : builder->scratch->str;
+    name_len = len - (name - builder->scratch->str);
+    g_string_truncate(builder->scratch, slash ? (gsize)(slash - builder->scratch->str) : 0);
+
+    id = g_hash_table_lookup(builder->dir_ids, builder->scratch->str);
+    if (id)
+    {
+        dir_id = GPOINTER_TO_UINT(id) - 1;
+    }
+    else
+    {
+        guint32 offset = arena_append(builder->arena, builder->scratch->str,
+                                      builder->scratch->len);
+
+        dir_id = builder->dir_offsets->len;
+        g_array_append_val(builder->dir_offsets, offset);
+        g_hash_table_insert(builder->dir_ids, g_strdup(builder->scratch->str),
+                            GUINT_TO_POINTER(dir_id + 1));
+    }
+
+    name_offset = arena_append(builder->arena, name, name_len);
+
+    g_array_append_val(builder->entry_dirs, dir_id);
+    g_array_append_val(builder->entry_names, name_offset);
+    g_array_append_val(builder->entry_status, status);
+}
+
+typedef struct {
+    const gchar *arena;
+    guint32     *dirs;
+    guint32     *names;
+} SortContext;
+
+static gint
+dir_order_cmp(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    const gchar *arena = user_data;
+    const gchar *dir_a = arena + *(const guint32 *)a;
+
+    return path_cmp_len(dir_a, strlen(dir_a), arena + *(const guint32 *)b);
+}
+
+static gint
+entry_order_cmp(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    SortContext *ctx = user_data;
+    guint32 i = *(const guint32 *)a, j = *(const guint32 *)b;
+
+    if (ctx->dirs[i] != ctx->dirs[j])
+        return ctx->dirs[i] < ctx->dirs[j] ? -1 : 1;
+
+    return strcmp(ctx->arena + ctx->names[i], ctx->arena + ctx->names[j]);
+}
+
+TgpStatusTable*
+tgp_status_table_builder_finish(TgpStatusTableBuilder *builder)
+{
+    TgpStatusTable *table = g_new0(TgpStatusTable, 1);
+    GArray *order;
+    guint32 *rank;
+    SortContext ctx;
+
+    table->ref_count = 1;
+    table->n_dirs = builder->dir_offsets->len;
+    table->n_entries = builder->entry_dirs->len;
+    table->hash_key_bytes = builder->hash_key_bytes;
+
+    /* Directory ids become ranks in path order */
+    g_array_sort_with_data(builder->dir_offsets, dir_order_cmp, builder->arena->data);
+    rank = g_new(guint32, MAX(table->n_dirs, 1));
+    for (guint32 r = 0; r < table->n_dirs; r++)
+    {
+        const gchar *dir = (const gchar *)builder->arena->data +
+                           g_array_index(builder->dir_offsets, guint32, r);
+        guint32 id = GPOINTER_TO_UINT(g_hash_table_lookup(builder->dir_ids, dir)) - 1;
+        rank[id] = r;
+    }
+    for (guint i = 0; i < table->n_entries; i++)
+    {
+        guint32 *dir = &g_array_index(builder->entry_dirs, guint32, i);
+        *dir = rank[*dir];
+    }
+    g_free(rank);
+
+    /* Sort the records through a permutation, then lay them out in that order */
+    order = g_array_sized_new(FALSE, FALSE, sizeof(guint32), table->n_entries);
+    for (guint32 i = 0; i < table->n_entries; i++)
+        g_array_append_val(order, i);
+
+    ctx.arena = (const gchar *)builder->arena->data;
+    ctx.dirs = (guint32 *)builder->entry_dirs->data;
+    ctx.names = (guint32 *)builder->entry_names->data;
+    g_array_sort_with_data(order, entry_order_cmp, &ctx);
+
+    table->entry_dirs = g_new(guint32, table->n_entries);
+    table->entry_names = g_new(guint32, table->n_entries);
+    table->entry_status = g_new(TgpPackedStatus, table->n_entries);
+    for (guint i = 0; i < table->n_entries; i++)
+    {
+        guint32 from = g_array_index(order, guint32, i);
+
+        table->entry_dirs[i] = ctx.dirs[from];
+        table->entry_names[i] = ctx.names[from];
+        table->entry_status[i] = g_array_index(builder->entry_status, TgpPackedStatus, from);
+    }
+    g_array_unref(order);
+
+    table->dir_offsets = (guint32 *)g_array_free(builder->dir_offsets, FALSE);
+    table->arena_size = builder->arena->len;
+    table->arena = g_realloc(g_byte_array_free(builder->arena, FALSE), MAX(table->arena_size, 1));
+
+    g_array_unref(builder->entry_dirs);
+    g_array_unref(builder->entry_names);
+    g_array_unref(builder->entry_status);
+    g_hash_table_destroy(builder->dir_ids);
+    g_string_free(builder->scratch, TRUE);
+    g_free(builder);
+
+    return table;
+}
+
+static int
+status_table_collect(const char *path, unsigned int status_flags, void *payload)
+{
+    tgp_status_table_builder_add(payload, path, status_flags);
+    return 0;
+}
+
+static TgpStatusTable*
+status_table_walk(git_repository *repo, const gchar *dir, unsigned int flags)
+{
+    TgpStatusTableBuilder *builder;
+    git_status_options opts;
+    char *pathspec = (char *)dir;
+    int error;
+    TgpRepoOptions options = tgp_config_get_repo_options(git_repository_workdir(repo));
+
+    tgp_index_session_flush(repo, NULL);
+
+    if ((flags & GIT_STATUS_OPT_INCLUDE_IGNORED) && !(options & TGP_REPO_PRUNE_IGNORED_DIRS))
+        flags |= GIT_STATUS_OPT_RECURSE_IGNORED_DIRS;
+    if (!(options & TGP_REPO_COLLAPSE_UNTRACKED_DIRS))
+        flags |= GIT_STATUS_OPT_RECURSE_UNTRACKED_DIRS;
+
+    git_status_options_init(&opts, GIT_STATUS_OPTIONS_VERSION);
+    opts.show = GIT_STATUS_SHOW_INDEX_AND_WORKDIR;
+    opts.flags = flags;
+    if (dir && *dir)
+    {
+        opts.pathspec.strings = &pathspec;
+        opts.pathspec.count = 1;
+    }
+
+    builder = tgp_status_table_builder_new();
+    error = git_status_foreach_ext(repo, &opts, status_table_collect, builder);
+    if (error < 0)
+    {
+        /* A partial table would show everything it missed as clean */
+        const git_error *e = git_error_last();
+
+        g_warning("Status walk of %s failed: %s", git_repository_workdir(repo),
+                  e ? e->message : "unknown error");
+        tgp_status_table_unref(tgp_status_table_builder_finish(builder));
+        return NULL;
+    }
+
+    return tgp_status_table_builder_finish(builder);
+}
+
+TgpStatusTable*
+tgp_status_table_new_from_repo(git_repository *repo)
+{
+    TgpStatusTable *table;
+
+    g_return_val_if_fail(repo != NULL, NULL);
+
+    table = tgp_scanner_scan(repo);
+    if (table)
+        return table;
+
+    return status_table_walk(repo, NULL,
+                             GIT_STATUS_OPT_INCLUDE_UNTRACKED | GIT_STATUS_OPT_INCLUDE_IGNORED);
+}
+
+/*
+ * Records at and below one directory (relative to the workdir) only, for
+ * repositories where walking the whole tree is too expensive. Ignored
+ * files are left out, they would only add work.
+ *
+ * With expand_untracked, dir is a collapsed untracked directory the user
+ * opened: its contents are listed one by one, ignored files included.
+ */
+TgpStatusTable*
+tgp_status_table_new_for_directory(git_repository *repo, const gchar *dir,
+                                   gboolean expand_untracked)
+{
+    g_return_val_if_fail(repo != NULL, NULL);
+
+    if (expand_untracked)
+        return status_table_walk(repo, dir, GIT_STATUS_OPT_INCLUDE_UNTRACKED |
+                                            GIT_STATUS_OPT_RECURSE_UNTRACKED_DIRS |
+                                            GIT_STATUS_OPT_INCLUDE_IGNORED);
+
+    return status_table_walk(repo, dir, GIT_STATUS_OPT_INCLUDE_UNTRACKED);
+}
+
+TgpStatusTable*
+tgp_status_table_ref(TgpStatusTable *table)
+{
+    g_atomic_int_inc(&table->ref_count);
+    return table;
+}
+
+void
+tgp_status_table_unref(TgpStatusTable *table)
+{
+    if (!table || !g_atomic_int_dec_and_test(&table->ref_count))
+        return;
+
+    g_free(table->entry_status);
+    g_free(table->entry_names);
+    g_free(table->entry_dirs);
+    g_free(table->dir_offsets);
+    g_free(table->arena);
+    g_free(table);
+}
+
+/* First directory rank that does not sort before dir */
+static guint
+find_dir(TgpStatusTable *table, const gchar *dir, gsize dir_len)
+{
+    guint lo = 0, hi = table->n_dirs;
+
+    while (lo < hi)
+    {
+        guint mid = lo + (hi - lo) / 2;
+
+        if (path_cmp_len(dir, dir_len, table->arena + table->dir_offsets[mid]) > 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/* First record whose directory rank is not below dir_rank */
+static guint
+find_entries(TgpStatusTable *table, guint dir_rank)
+{
+    guint lo = 0, hi = table->n_entries;
+
+    while (lo < hi)
+    {
+        guint mid = lo + (hi - lo) / 2;
+
+        if (table->entry_dirs[mid] < dir_rank)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+gboolean
+tgp_status_table_lookup(TgpStatusTable *table, const gchar *path, TgpPackedStatus *status)
+{
+    const gchar *slash, *name;
+    gsize dir_len;
+    guint rank, lo, hi;
+
+    g_return_val_if_fail(table != NULL && path != NULL, FALSE);
+
+    slash = strrchr(path, '/');
+    name = slash ? slash + 1 : path;
+    dir_len = slash ? (gsize)(slash - path) : 0;
+
+    rank = find_dir(table, path, dir_len);
+    if (rank >= table->n_dirs ||
+        path_cmp_len(path, dir_len, table->arena + table->dir_offsets[rank]) != 0)
+        return FALSE;
+
+    lo = find_entries(table, rank);
+    hi = find_entries(table, rank + 1);
+
+    while (lo < hi)
+    {
+        guint mid = lo + (hi - lo) / 2;
+        gint cmp = strcmp(name, table->arena + table->entry_names[mid]);
+
+        if (cmp == 0)
+        {
+            if (status)
+                *status = table->entry_status[mid];
+            return TRUE;
+        }
+
+        if (cmp > 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return FALSE;
+}
+
+/*
+ * Whether path is, or lies below, a directory the walk collapsed into a
+ * single untracked or ignored record; status is that record's.
+ */
+gboolean
+tgp_status_table_lookup_collapsed(TgpStatusTable *table, const gchar *path,
+                                  TgpPackedStatus *status)
+{
+    gchar *prefix;
+    gsize len;
+    gboolean found = FALSE;
+
+    g_return_val_if_fail(table != NULL && path != NULL, FALSE);
+
+    if (table->n_entries == 0)
+        return FALSE;
+
+    prefix = g_strdup(path);
+    len = strlen(prefix);
+
+    /* Outermost directory first, a collapsed record hides everything below */
+    for (gsize i = 0; i <= len && !found; i++)
+    {
+        if (prefix[i] != '/' && prefix[i] != '\0')
+            continue;
+
+        prefix[i] = '\0';
+        found = i > 0 && tgp_status_table_lookup(table, prefix, status);
+        prefix[i] = path[i];
+    }
+
+    g_free(prefix);
+    return found;
+}
+
+TgpPackedStatus
+tgp_status_table_aggregate(TgpStatusTable *table, const gchar *dir, TgpIndexSnapshot *snapshot)
+{
+    TgpPackedStatus result = 0, below = 0;
+    gboolean all_ignored = TRUE;
+    gsize dir_len;
+    guint first, last, lo, hi;
+
+    g_return_val_if_fail(table != NULL && dir != NULL, 0);
+
+    dir_len = strlen(dir);
+
+    if (dir_len == 0)
+    {
+        first = 0;
+        last = table->n_dirs;
+    }
+    else
+    {
+        /* The directory itself may be a record, e.g. a collapsed untracked one */
+        tgp_status_table_lookup(table, dir, &result);
+
+        first = find_dir(table, dir, dir_len);
+
+        /* Directories within dir form one run starting at first */
+        lo = first;
+        hi = table->n_dirs;
+        while (lo < hi)
+        {
+            guint mid = lo + (hi - lo) / 2;
+
+            if (path_is_within(table->arena + table->dir_offsets[mid], dir, dir_len))
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        last = lo;
+    }
+
+    if (first == last)
+        return result;
+
+    lo = find_entries(table, first);
+    hi = find_entries(table, last);
+
+    for (guint i = lo; i < hi; i++)
+    {
+        below |= table->entry_status[i];
+        if (!(table->entry_status[i] & PACKED_IGNORED))
+            all_ignored = FALSE;
+    }
+
+    /* A tracked folder holding build output is not ignored itself */
+    result |= below & ~PACKED_IGNORED;
+    if (lo < hi && all_ignored && dir_len > 0 && snapshot &&
+        !tgp_index_snapshot_tracks_below(snapshot, dir))
+        result |= PACKED_IGNORED;
+
+    return result;
+}
+
+static gboolean
+path_in_dirs(GPtrArray *dirs, const gchar *path)
+{
+    for (guint i = 0; dirs && i < dirs->len; i++)
+    {
+        const gchar *dir = g_ptr_array_index(dirs, i);
+
+        if (path_is_within(path, dir, strlen(dir)))
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+static void
+status_table_add_records(TgpStatusTableBuilder *builder, TgpStatusTable *table,
+                         GHashTable *skip_dirs, GPtrArray *vanished)
+{
+    GString *path = g_string_new(NULL);
+
+    for (guint i = 0; i < table->n_entries; i++)
+    {
+        const gchar *dir = table->arena + table->dir_offsets[table->entry_dirs[i]];
+
+        if (skip_dirs && g_hash_table_contains(skip_dirs, dir))
+            continue;
+
+        g_string_assign(path, dir);
+        if (path->len > 0)
+            g_string_append_c(path, '/');
+        g_string_append(path, table->arena + table->entry_names[i]);
+
+        if (skip_dirs && path_in_dirs(vanished, path->str))
+            continue;
+
+        tgp_status_table_builder_add(builder, path->str,
+                                     tgp_status_unpack(table->entry_status[i]));
+    }
+
+    g_string_free(path, TRUE);
+}
+
+TgpStatusTable*
+tgp_status_table_replace_dirs(TgpStatusTable *table, GPtrArray *dirs,
+                              GPtrArray *vanished, TgpStatusTable *fresh)
+{
+    TgpStatusTableBuilder *builder;
+    GHashTable *skip_dirs;
+
+    g_return_val_if_fail(table != NULL && dirs != NULL && fresh != NULL, NULL);
+
+    skip_dirs = g_hash_table_new(g_str_hash, g_str_equal);
+    for (guint i = 0; i < dirs->len; i++)
+        g_hash_table_add(skip_dirs, g_ptr_array_index(dirs, i));
+
+    builder = tgp_status_table_builder_new();
+    status_table_add_records(builder, table, skip_dirs, vanished);
+    status_table_add_records(builder, fresh, NULL, NULL);
+
+    g_hash_table_destroy(skip_dirs);
+
+    return tgp_status_table_builder_finish(builder);
+}
+
+guint
+tgp_status_table_get_length(TgpStatusTable *table)
+{
+    return table->n_entries;
+}
+
+gsize
+tgp_status_table_get_memory_size(TgpStatusTable *table)
+{
+    return sizeof(TgpStatusTable) +
+           table->arena_size +
+           table->n_dirs * sizeof(guint32) +
+           table->n_entries * (2 * sizeof(guint32) + sizeof(TgpPackedStatus));
+}
+
+/*
+ * What the same records would cost as a GHashTable with one g_strdup'd
+ * path per key and the status packed into the value pointer.
+ */
+gsize
+tgp_status_table_get_hash_table_estimate(TgpStatusTable *table)
+{
+    gsize buckets = 8;
+
+    while (buckets < table->n_entries + table->n_entries / 3)
+        buckets <<= 1;
+
+    /* keys, values and hashes arrays */
+    return buckets * (2 * sizeof(gpointer) + sizeof(guint)) + table->hash_key_bytes;
+}
+
+static void
+status_cache_entry_free(gpointer data)
+{
+    StatusCacheEntry *entry = data;
+    tgp_status_table_unref(entry->table);
+    tgp_index_snapshot_unref(entry->snapshot);
+    g_hash_table_destroy(entry->dirty);
+    g_free(entry);
+}
+
+static void
+directory_cache_entry_free(gpointer data)
+{
+    DirectoryCacheEntry *entry = data;
+    tgp_status_table_unref(entry->table);
+    tgp_index_snapshot_unref(entry->snapshot);
+    g_free(entry);
+}
+
+void
+tgp_status_cache_init(void)
+{
+    g_mutex_lock(&status_cache_mutex);
+    if (!status_cache)
+    {
+        status_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                             status_cache_entry_free);
+        directory_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                                directory_cache_entry_free);
+    }
+    g_mutex_unlock(&status_cache_mutex);
+}
+
+void
+tgp_status_cache_shutdown(void)
+{
+    g_mutex_lock(&status_cache_mutex);
+    if (status_cache)
+    {
+        g_hash_table_destroy(status_cache);
+        g_hash_table_destroy(directory_cache);
+        status_cache = NULL;
+        directory_cache = NULL;
+    }
+    g_mutex_unlock(&status_cache_mutex);
+}
+
+static StatusCacheEntry*
+status_cache_entry_new(TgpStatusTable *table, TgpIndexSnapshot *snapshot, gint64 expires)
+{
+    StatusCacheEntry *entry = g_new0(StatusCacheEntry, 1);
+
+    entry->table = tgp_status_table_ref(table);
+    entry->snapshot = snapshot ? tgp_index_snapshot_ref(snapshot) : NULL;
+    entry->expires = expires;
+    entry->dirty = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    return entry;
+}
+
+/*
+ * Re-scan the dirty directories of a cached table and merge the result.
+ * Takes ownership of dirty; NULL if only a full walk will do.
+ */
+static TgpStatusTable*
+status_cache_update(git_repository *repo, TgpStatusTable *table, GHashTable *dirty)
+{
+    TgpStatusTable *fresh, *merged;
+    GPtrArray *dirs, *vanished = NULL;
+    GHashTableIter iter;
+    gpointer dir;
+
+    if (g_hash_table_size(dirty) > TGP_STATUS_CACHE_MAX_DIRTY)
+    {
+        g_hash_table_destroy(dirty);
+        return NULL;
+    }
+
+    dirs = g_ptr_array_new_with_free_func(g_free);
+    g_hash_table_iter_init(&iter, dirty);
+    while (g_hash_table_iter_next(&iter, &dir, NULL))
+    {
+        g_hash_table_iter_steal(&iter);
+        g_ptr_array_add(dirs, dir);
+    }
+    g_hash_table_destroy(dirty);
+
+    fresh = tgp_scanner_scan_directories(repo, dirs, &vanished);
+    if (!fresh)
+    {
+        g_ptr_array_unref(dirs);
+        return NULL;
+    }
+
+    merged = tgp_status_table_replace_dirs(table, dirs, vanished, fresh);
+
+    g_debug("Status table for %s: re-scanned %u directories, %u records",
+            git_repository_workdir(repo), dirs->len, merged->n_entries);
+
+    tgp_status_table_unref(fresh);
+    g_ptr_array_unref(vanished);
+    g_ptr_array_unref(dirs);
+
+    return merged;
+}
+
+/*
+ * Cached table of repo, built on first use and once it is older than the
+ * configured TTL (longer on network mounts), and otherwise brought up to
+ * date by re-scanning only the directories that changed. Release with
+ * tgp_status_table_unref().
+ */
+static gpointer
+status_cache_build_flight(gpointer user_data)
+{
+    return tgp_status_table_new_from_repo(user_data);
+}
+
+/*
+ * Full status of the worktree; concurrent callers for the same index and
+ * HEAD share one walk. HEAD is part of the key because a commit or reset
+ * can move it without touching the index.
+ */
+static TgpStatusTable*
+status_cache_build(git_repository *repo, TgpIndexSnapshot *snapshot)
+{
+    gchar checksum[2 * GIT_OID_RAWSZ + 1] = "-";
+    gchar head[GIT_OID_HEXSZ + 1] = "-";
+    git_oid head_id;
+    TgpStatusTable *table;
+    gchar key[4096 + 2 * GIT_OID_HEXSZ + 16];
+
+    if (snapshot)
+    {
+        for (guint i = 0; i < GIT_OID_RAWSZ; i++)
+            g_snprintf(checksum + 2 * i, 3, "%02x", snapshot->checksum[i]);
+        git_oid_tostr(head, sizeof(head), &snapshot->head_id);
+    }
+    else if (git_reference_name_to_id(&head_id, repo, "HEAD") == 0)
+    {
+        git_oid_tostr(head, sizeof(head), &head_id);
+    }
+
+    g_snprintf(key, sizeof(key), "status:%s:%s:%s", git_repository_workdir(repo), checksum, head);
+    table = tgp_flight_do(key, status_cache_build_flight, repo,
+                          (GBoxedCopyFunc)tgp_status_table_ref,
+                          (GDestroyNotify)tgp_status_table_unref);
+
+    return table;
+}
+
+TgpStatusTable*
+tgp_status_cache_get(git_repository *repo)
+{
+    const gchar *workdir = git_repository_workdir(repo);
+    TgpStatusTable *table = NULL;
+    TgpStatusTable *updated = NULL;
+    TgpIndexSnapshot *snapshot;
+    StatusCacheEntry *entry;
+    GHashTable *dirty = NULL;
+    gint64 expires = 0;
+    gboolean network;
+
+    if (!workdir)
+        return NULL;
+
+    snapshot = tgp_index_snapshot_get(repo);
+
+    g_mutex_lock(&status_cache_mutex);
+    entry = status_cache ? g_hash_table_lookup(status_cache, workdir) : NULL;
+    if (entry && entry->expires > g_get_monotonic_time() &&
+        (entry->snapshot != NULL) == (snapshot != NULL))
+    {
+        table = tgp_status_table_ref(entry->table);
+        expires = entry->expires;
+
+        if (snapshot)
+        {
+            tgp_index_snapshot_collect_changed_dirs(entry->snapshot, snapshot, entry->dirty);
+            tgp_index_snapshot_unref(entry->snapshot);
+            entry->snapshot = tgp_index_snapshot_ref(snapshot);
+        }
+
+        if (g_hash_table_size(entry->dirty) > 0)
+        {
+            dirty = entry->dirty;
+            entry->dirty = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        }
+        entry->invalidated = FALSE;
+    }
+    else if (entry)
+    {
+        /* The full walk below covers everything marked so far */
+        g_hash_table_remove_all(entry->dirty);
+        entry->invalidated = FALSE;
+    }
+    g_mutex_unlock(&status_cache_mutex);
+
+    if (table && !dirty)
+    {
+        tgp_index_snapshot_unref(snapshot);
+        return table;
+    }
+
+    if (table)
+    {
+        updated = status_cache_update(repo, table, dirty);
+        tgp_status_table_unref(table);
+        table = updated;
+    }
+
+    if (!table)
+    {
+        network = tgp_config_is_network_path(workdir);
+        table = status_cache_build(repo, snapshot);
+        if (!table)
+        {
+            tgp_index_snapshot_unref(snapshot);
+            return NULL;
+        }
+        expires = g_get_monotonic_time() +
+                  (gint64)tgp_config_get_status_ttl(network) * G_USEC_PER_SEC;
+
+        g_debug("Status table for %s: %u records in %" G_GSIZE_FORMAT " bytes "
+                "(GHashTable of paths: ~%" G_GSIZE_FORMAT " bytes)",
+                workdir, table->n_entries,
+                tgp_status_table_get_memory_size(table),
+                tgp_status_table_get_hash_table_estimate(table));
+    }
+
+    g_mutex_lock(&status_cache_mutex);
+    if (status_cache)
+    {
+        StatusCacheEntry *old = g_hash_table_lookup(status_cache, workdir);
+        GHashTable *marked;
+
+        entry = status_cache_entry_new(table, snapshot, expires);
+
+        /* Marks and invalidations that came in while this table was computed */
+        if (old)
+        {
+            marked = old->dirty;
+            old->dirty = entry->dirty;
+            entry->dirty = marked;
+            if (old->invalidated)
+            {
+                entry->expires = 0;
+                entry->invalidated = TRUE;
+            }
+        }
+
+        g_hash_table_replace(status_cache, g_strdup(workdir), entry);
+    }
+    g_mutex_unlock(&status_cache_mutex);
+
+    tgp_index_snapshot_unref(snapshot);
+    return table;
+}
+
+static gboolean
+snapshot_same_index(TgpIndexSnapshot *a, TgpIndexSnapshot *b)
+{
+    if (!a || !b)
+        return a == b;
+
+    return memcmp(a->checksum, b->checksum, GIT_OID_RAWSZ) == 0 &&
+           git_oid_equal(&a->head_id, &b->head_id);
+}
+
+/* Make room for one more directory table; status_cache_mutex held */
+static void
+directory_cache_evict(gint64 now)
+{
+    GHashTableIter iter;
+    gpointer key, value;
+    gpointer oldest = NULL;
+    gint64 oldest_expires = G_MAXINT64;
+
+    if (g_hash_table_size(directory_cache) < TGP_STATUS_CACHE_MAX_DIRECTORIES)
+        return;
+
+    g_hash_table_iter_init(&iter, directory_cache);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+    {
+        DirectoryCacheEntry *entry = value;
+
+        if (entry->expires <= now)
+            g_hash_table_iter_remove(&iter);
+        else if (entry->expires < oldest_expires)
+        {
+            oldest = key;
+            oldest_expires = entry->expires;
+        }
+    }
+
+    if (oldest && g_hash_table_size(directory_cache) >= TGP_STATUS_CACHE_MAX_DIRECTORIES)
+        g_hash_table_remove(directory_cache, oldest);
+}
+
+/*
+ * Cached table of the records at and below dir (relative to the workdir),
+ * for network mounts where the whole worktree is too far away to walk.
+ * Reused for NetworkCacheTTL seconds while the index and HEAD stay the
+ * same and nothing at or below dir is marked dirty. Release with
+ * tgp_status_table_unref().
+ */
+TgpStatusTable*
+tgp_status_cache_get_directory(git_repository *repo, const gchar *dir)
+{
+    const gchar *workdir = git_repository_workdir(repo);
+    TgpStatusTable *table = NULL;
+    TgpIndexSnapshot *snapshot;
+    DirectoryCacheEntry *entry;
+    gchar *key;
+    gint64 now;
+
+    g_return_val_if_fail(repo != NULL && dir != NULL, NULL);
+
+    if (!workdir)
+        return NULL;
+
+    snapshot = tgp_index_snapshot_get(repo);
+    key = g_strconcat(workdir, dir, NULL);
+    now = g_get_monotonic_time();
+
+    g_mutex_lock(&status_cache_mutex);
+    entry = directory_cache ? g_hash_table_lookup(directory_cache, key) : NULL;
+    if (entry && entry->expires > now && snapshot_same_index(entry->snapshot, snapshot))
+        table = tgp_status_table_ref(entry->table);
+    g_mutex_unlock(&status_cache_mutex);
+
+    if (table)
+    {
+        tgp_index_snapshot_unref(snapshot);
+        g_free(key);
+        return table;
+    }
+
+    table = tgp_status_table_new_for_directory(repo, dir, FALSE);
+    if (!table)
+    {
+        tgp_index_snapshot_unref(snapshot);
+        g_free(key);
+        return NULL;
+    }
+
+    g_mutex_lock(&status_cache_mutex);
+    if (directory_cache)
+    {
+        now = g_get_monotonic_time();
+        directory_cache_evict(now);
+
+        entry = g_new0(DirectoryCacheEntry, 1);
+        entry->table = tgp_status_table_ref(table);
+        entry->snapshot = snapshot ? tgp_index_snapshot_ref(snapshot) : NULL;
+        entry->expires = now + (gint64)tgp_config_get_status_ttl(TRUE) * G_USEC_PER_SEC;
+        g_hash_table_replace(directory_cache, key, entry);
+        key = NULL;
+    }
+    g_mutex_unlock(&status_cache_mutex);
+
+    tgp_index_snapshot_unref(snapshot);
+    g_free(key);
+    return table;
+}
+
+/* Drop the directory tables of workdir covering dir, or all of them; status_cache_mutex held */
+static void
+directory_cache_drop(const gchar *workdir, const gchar *dir)
+{
+    GHashTableIter iter;
+    gpointer key;
+    gsize workdir_len = strlen(workdir);
+
+    if (!directory_cache)
+        return;
+
+    g_hash_table_iter_init(&iter, directory_cache);
+    while (g_hash_table_iter_next(&iter, &key, NULL))
+    {
+        const gchar *cached = key;
+        const gchar *cached_dir;
+        gsize len;
+
+        if (strncmp(cached, workdir, workdir_len) != 0)
+            continue;
+
+        /* A table covers its directory and everything below it */
+        cached_dir = cached + workdir_len;
+        len = strlen(cached_dir);
+        if (!dir || len == 0 ||
+            (strncmp(dir, cached_dir, len) == 0 && (dir[len] == '\0' || dir[len] == '/')))
+            g_hash_table_iter_remove(&iter);
+    }
+}
+
+void
+tgp_status_cache_mark_dirty(const gchar *workdir, const gchar *dir)
+{
+    StatusCacheEntry *entry;
+
+    if (!workdir || !dir)
+        return;
+
+    g_mutex_lock(&status_cache_mutex);
+    directory_cache_drop(workdir, dir);
+    entry = status_cache ? g_hash_table_lookup(status_cache, workdir) : NULL;
+    if (entry)
+    {
+        if (g_hash_table_size(entry->dirty) >= TGP_STATUS_CACHE_MAX_DIRTY)
+        {
+            /* Rebuilt on the next request, still there to peek at until then */
+            entry->expires = 0;
+            entry->invalidated = TRUE;
+            g_hash_table_remove_all(entry->dirty);
+        }
+        else
+            g_hash_table_add(entry->dirty, g_strdup(dir));
+    }
+    g_mutex_unlock(&status_cache_mutex);
+}
+
+void
+tgp_status_cache_invalidate(const gchar *workdir)
+{
+    StatusCacheEntry *entry;
+
+    g_mutex_lock(&status_cache_mutex);
+    if (workdir)
+        directory_cache_drop(workdir, NULL);
+    entry = status_cache && workdir ? g_hash_table_lookup(status_cache, workdir) : NULL;
+    if (entry)
+    {
+        entry->expires = 0;
+        entry->invalidated = TRUE;
+    }
+    g_mutex_unlock(&status_cache_mutex);
+}
+
+TgpStatusTable*
+tgp_status_cache_peek(const gchar *workdir, gboolean *stale)
+{
+    StatusCacheEntry *entry;
+    TgpStatusTable *table = NULL;
+
+    g_return_val_if_fail(workdir != NULL, NULL);
+
+    g_mutex_lock(&status_cache_mutex);
+    entry = status_cache ? g_hash_table_lookup(status_cache, workdir) : NULL;
+    if (entry)
+    {
+        table = tgp_status_table_ref(entry->table);
+        if (stale)
+            *stale = entry->expires <= g_get_monotonic_time() ||
+                     g_hash_table_size(entry->dirty) > 0;
+    }
+    g_mutex_unlock(&status_cache_mutex);
+
+    return table;
+}
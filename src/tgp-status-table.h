@@ -0,0 +1,101 @@
+/*
+ * Thunar Git Plugin - Compact Status Table
+ * Copyright (C) 2025 MiniMax Agent
+ */
+
+#ifndef __TGP_STATUS_TABLE_H__
+#define __TGP_STATUS_TABLE_H__
+
+#include <glib.h>
+#include <git2.h>
+#include "tgp-plugin.h"
+#include "tgp-index-snapshot.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Packed status record: the low byte holds the index (staged) state, the
+ * high byte the worktree state, so neither side is lost when packing.
+ */
+typedef guint16 TgpPackedStatus;
+
+#define TGP_PACKED_INDEX(s)      ((guint8)((s) & 0xff))
+#define TGP_PACKED_WORKTREE(s)   ((guint8)((s) >> 8))
+
+typedef struct _TgpStatusTable        TgpStatusTable;
+typedef struct _TgpStatusTableBuilder TgpStatusTableBuilder;
+
+/* Packing */
+TgpPackedStatus  tgp_status_pack(unsigned int git_status);
+unsigned int     tgp_status_unpack(TgpPackedStatus status);
+TgpStatusFlags   tgp_status_to_flags(TgpPackedStatus status);
+
+/* Building, paths are relative to the workdir */
+TgpStatusTableBuilder* tgp_status_table_builder_new(void);
+void             tgp_status_table_builder_add(TgpStatusTableBuilder *builder,
+                                              const gchar *path, unsigned int git_status);
+TgpStatusTable*  tgp_status_table_builder_finish(TgpStatusTableBuilder *builder);
+
+/* One status walk of the whole repository, or of a single directory; NULL if it failed */
+TgpStatusTable*  tgp_status_table_new_from_repo(git_repository *repo);
+TgpStatusTable*  tgp_status_table_new_for_directory(git_repository *repo, const gchar *dir,
+                                                    gboolean expand_untracked);
+
+TgpStatusTable*  tgp_status_table_ref(TgpStatusTable *table);
+void             tgp_status_table_unref(TgpStatusTable *table);
+
+/* Lookup, FALSE if path has no record (i.e. it is clean) */
+gboolean         tgp_status_table_lookup(TgpStatusTable *table, const gchar *path,
+                                         TgpPackedStatus *status);
+
+/* Record of a collapsed untracked/ignored directory at or above path */
+gboolean         tgp_status_table_lookup_collapsed(TgpStatusTable *table, const gchar *path,
+                                                   TgpPackedStatus *status);
+
+/*
+ * All records at or below dir ("" for the whole tree) OR'ed together.
+ * Ignored files don't make the folder holding them ignored: dir is only if
+ * it has a record of its own (collapsed), or if every record below it is
+ * ignored and snapshot tracks nothing there. snapshot may be NULL.
+ */
+TgpPackedStatus  tgp_status_table_aggregate(TgpStatusTable *table, const gchar *dir,
+                                            TgpIndexSnapshot *snapshot);
+
+/*
+ * Copy of table with the records directly in dirs, and everything at or
+ * below vanished, replaced by the records of fresh
+ */
+TgpStatusTable*  tgp_status_table_replace_dirs(TgpStatusTable *table, GPtrArray *dirs,
+                                               GPtrArray *vanished, TgpStatusTable *fresh);
+
+/* Footprint */
+guint            tgp_status_table_get_length(TgpStatusTable *table);
+gsize            tgp_status_table_get_memory_size(TgpStatusTable *table);
+gsize            tgp_status_table_get_hash_table_estimate(TgpStatusTable *table);
+
+/* Beyond this many changed directories a full walk is cheaper */
+#define TGP_STATUS_CACHE_MAX_DIRTY 512
+
+/* Directory tables of network mounts kept at once */
+#define TGP_STATUS_CACHE_MAX_DIRECTORIES 64
+
+/* Per-repository cache, keyed by workdir; failed walks give NULL and aren't cached */
+void             tgp_status_cache_init(void);
+void             tgp_status_cache_shutdown(void);
+TgpStatusTable*  tgp_status_cache_get(git_repository *repo);
+TgpStatusTable*  tgp_status_cache_get_directory(git_repository *repo, const gchar *dir);
+void             tgp_status_cache_invalidate(const gchar *workdir);
+
+/*
+ * Last table of workdir however outdated, without waiting for a walk;
+ * *stale is set if tgp_status_cache_get() would rebuild or update it.
+ * NULL if the repository has no table yet.
+ */
+TgpStatusTable*  tgp_status_cache_peek(const gchar *workdir, gboolean *stale);
+
+/* Entries of dir (relative to workdir, "" for the top) changed on disk */
+void             tgp_status_cache_mark_dirty(const gchar *workdir, const gchar *dir);
+
+G_END_DECLS
+
+#endif /* __TGP_STATUS_TABLE_H__ */
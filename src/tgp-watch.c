@@ -0,0 +1,1093 @@
+/*
+ * Thunar Git Plugin - Worktree Watches Implementation
+ * Copyright (C) 2025 MiniMax Agent
+ *
+ * Directories whose emblems were drawn, and their ancestors up to the
+ * repository root, get a (non-recursive) monitor. A change in one only
+ * marks that directory dirty in the status cache, so the next status
+ * request re-scans just the directories that changed, and the emblems of
+ * the affected directories are redrawn shortly after. An entry that went
+ * away or appeared is marked too, and for one that appeared every
+ * directory below it: a tree moved in may bring tracked files along.
+ *
+ * inotify watches are a scarce, system-wide resource, so at most
+ * MaxWatches directories are monitored. The least recently shown ones
+ * lose their monitor and are polled instead: every PollInterval seconds
+ * their mtime is compared, which catches entries being created, removed
+ * or renamed.
+ *
+ * The emblem of a subfolder sums up everything below it, which no watch
+ * covers. So the same poll compares the mtimes of the directories below
+ * shown ones, at most TGP_WATCH_SUBTREE_POLL_MAX per round, most recently
+ * shown first. Content changes are left to the status cache TTL: once a
+ * repository's table has expired, the poll redraws its shown directories,
+ * which brings the table up to date.
+ *
+ * The gitdir of each repository is watched too, along with the directory
+ * holding the ref of its current branch: a new index or HEAD can change
+ * the status of any file, so all shown directories of that repository are
+ * redrawn. Which entries actually changed is worked out by the status
+ * cache from the index snapshots, which resolve HEAD again only when
+ * these monitors fire.
+ *
+ * Events are not acted on one by one: they are collected per directory
+ * and flushed together after a short window, which widens while events
+ * keep pouring in. When a repository sees an event storm (a build, an
+ * npm install), its per-directory work is suspended altogether and the
+ * whole repository is rescanned once the storm has calmed down.
+ *
+ * Monitors are created and their signals delivered on the main loop.
+ */
+
+#include "tgp-watch.h"
+#include "tgp-plugin.h"
+#include "tgp-status-table.h"
+#include "tgp-index-snapshot.h"
+#include "tgp-config.h"
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+/* Polled directories beyond this many times the watch budget are forgotten */
+#define WATCH_POLLED_FACTOR 4
+
+typedef struct {
+    gchar        *workdir;   /* With trailing '/', as libgit2 reports it */
+    gchar        *path;      /* Directory, absolute */
+    GFileMonitor *monitor;   /* NULL while polled */
+    gint64        mtime;     /* As last polled, nanoseconds */
+    gboolean      shown;     /* Emblems drawn, not only an ancestor of such */
+    GList        *link;      /* In watch_lru, or in polled_dirs while polled */
+    GHashTable   *subtree;   /* Directories below a shown one -> mtime, NULL until polled */
+} WatchedDir;
+
+/* Monitors telling a repository's index or HEAD may have moved */
+typedef struct {
+    gchar        *workdir;
+    gchar        *gitdir;       /* As git_repository_path() has it */
+    GFileMonitor *monitor;      /* On the gitdir */
+    gchar        *ref_dir;      /* Holding the current branch's ref, NULL if detached */
+    GFileMonitor *ref_monitor;
+} GitWatch;
+
+typedef struct {
+    gchar *workdir;
+    gchar *gitdir;
+    gchar *path;
+} WatchRequest;
+
+/* Changes seen in one directory since the last flush */
+typedef struct {
+    gchar      *workdir;
+    gchar      *path;
+    GHashTable *removed;   /* Names of entries that went away, or NULL */
+    GHashTable *created;   /* Names of entries that appeared, or NULL */
+} PendingDir;
+
+/* Events of one repository since the last flush */
+typedef struct {
+    guint    events;
+    gboolean git_changed;  /* Index or HEAD, everything may have changed */
+    gboolean storm;        /* Per-directory work suspended */
+} PendingRepo;
+
+/* Main thread only */
+static GHashTable *watched_dirs = NULL;   /* path -> WatchedDir, monitored or polled */
+static GQueue watch_lru = G_QUEUE_INIT;   /* Monitored, most recently shown first */
+static GQueue polled_dirs = G_QUEUE_INIT; /* Polled, most recently evicted first */
+static GHashTable *git_monitors = NULL;   /* workdir -> GitWatch */
+static guint poll_source = 0;
+
+/* Event coalescing, main thread only */
+static GHashTable *pending_dirs = NULL;   /* path -> PendingDir */
+static GHashTable *pending_repos = NULL;  /* workdir -> PendingRepo */
+static guint flush_source = 0;
+static guint flush_window = TGP_WATCH_REFRESH_DELAY_MS;
+static gint64 last_flush = 0;
+
+/* Requests from other threads */
+static GPtrArray *pending_requests = NULL;
+static GPtrArray *pending_refreshes = NULL; /* Directories to redraw if shown */
+static guint request_source = 0;
+static GMutex requests_mutex;
+
+static void watch_dir_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+                              GFileMonitorEvent event_type, gpointer user_data);
+
+/* Directories are keyed without trailing slashes */
+static void
+watch_strip_slashes(gchar *path)
+{
+    for (gsize len = strlen(path); len > 1 && path[len - 1] == '/'; len--)
+        path[len - 1] = '\0';
+}
+
+static void
+watch_request_free(gpointer data)
+{
+    WatchRequest *request = data;
+
+    g_free(request->workdir);
+    g_free(request->gitdir);
+    g_free(request->path);
+    g_free(request);
+}
+
+static void
+watch_stop_monitor(WatchedDir *dir)
+{
+    if (!dir->monitor)
+        return;
+
+    g_signal_handlers_disconnect_by_data(dir->monitor, dir);
+    g_file_monitor_cancel(dir->monitor);
+    g_object_unref(dir->monitor);
+    dir->monitor = NULL;
+}
+
+static void
+watched_dir_free(gpointer data)
+{
+    WatchedDir *dir = data;
+
+    if (dir->link)
+        g_queue_delete_link(dir->monitor ? &watch_lru : &polled_dirs, dir->link);
+
+    watch_stop_monitor(dir);
+    if (dir->subtree)
+        g_hash_table_destroy(dir->subtree);
+    g_free(dir->workdir);
+    g_free(dir->path);
+    g_free(dir);
+}
+
+static void
+watch_monitor_free(gpointer data)
+{
+    g_file_monitor_cancel(data);
+    g_object_unref(data);
+}
+
+static void
+git_watch_free(gpointer data)
+{
+    GitWatch *watch = data;
+
+    if (watch->ref_monitor)
+        watch_monitor_free(watch->ref_monitor);
+    if (watch->monitor)
+        watch_monitor_free(watch->monitor);
+    g_free(watch->ref_dir);
+    g_free(watch->gitdir);
+    g_free(watch->workdir);
+    g_free(watch);
+}
+
+static void
+pending_dir_free(gpointer data)
+{
+    PendingDir *pending = data;
+
+    if (pending->removed)
+        g_hash_table_destroy(pending->removed);
+    if (pending->created)
+        g_hash_table_destroy(pending->created);
+    g_free(pending->workdir);
+    g_free(pending->path);
+    g_free(pending);
+}
+
+/* The shown directories of a repository, or at and below a path if given */
+static void
+watch_collect_shown(GHashTable *refresh, const gchar *workdir, const gchar *path)
+{
+    GHashTableIter iter;
+    gpointer value;
+    gsize len = path ? strlen(path) : 0;
+
+    g_hash_table_iter_init(&iter, watched_dirs);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+    {
+        WatchedDir *dir = value;
+
+        if (!dir->shown || strcmp(dir->workdir, workdir) != 0)
+            continue;
+        if (path && (strncmp(dir->path, path, len) != 0 ||
+                     (dir->path[len] != '\0' && dir->path[len] != '/')))
+            continue;
+
+        g_hash_table_add(refresh, dir->path);
+    }
+}
+
+/* Workdir-relative form of an absolute path inside it, "" for the top */
+static const gchar*
+watch_relative(const gchar *workdir, const gchar *path)
+{
+    gsize len = strlen(workdir);
+
+    if (strncmp(path, workdir, len) == 0)
+        return path + len;
+    if (len > 0 && strncmp(path, workdir, len - 1) == 0 && path[len - 1] == '\0')
+        return "";
+
+    return NULL;
+}
+
+/*
+ * A directory that appeared (created, or moved in from elsewhere) may
+ * bring a whole tree along: mark every directory in it. Takes from budget
+ * and gives up once it runs out.
+ */
+static void
+watch_mark_subtree_dirty(const gchar *workdir, const gchar *relative, guint *budget)
+{
+    gchar *path = g_build_filename(workdir, relative, NULL);
+    GDir *dir;
+    const gchar *name;
+    GStatBuf st;
+
+    /* Not followed through symlinks, status doesn't either */
+    if (*budget == 0 || g_lstat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+    {
+        g_free(path);
+        return;
+    }
+
+    (*budget)--;
+    tgp_status_cache_mark_dirty(workdir, relative);
+
+    dir = g_dir_open(path, 0, NULL);
+    while (dir && *budget > 0 && (name = g_dir_read_name(dir)) != NULL)
+    {
+        gchar *child;
+
+        if (strcmp(name, ".git") == 0)
+            continue;
+
+        child = g_strconcat(relative, "/", name, NULL);
+        watch_mark_subtree_dirty(workdir, child, budget);
+        g_free(child);
+    }
+
+    if (dir)
+        g_dir_close(dir);
+    g_free(path);
+}
+
+/* Mark a directory dirty in the status cache, with the entries that came and went */
+static void
+watch_mark_dirty(const PendingDir *pending)
+{
+    const gchar *relative = watch_relative(pending->workdir, pending->path);
+    guint budget = TGP_STATUS_CACHE_MAX_DIRTY;
+    GHashTableIter iter;
+    gpointer name;
+
+    if (!relative)
+        return;
+
+    tgp_status_cache_mark_dirty(pending->workdir, relative);
+
+    /* They may have been directories, with tracked entries below them */
+    if (pending->removed)
+    {
+        g_hash_table_iter_init(&iter, pending->removed);
+        while (g_hash_table_iter_next(&iter, &name, NULL))
+        {
+            gchar *child = *relative ? g_strconcat(relative, "/", name, NULL) : g_strdup(name);
+            tgp_status_cache_mark_dirty(pending->workdir, child);
+            g_free(child);
+        }
+    }
+
+    if (pending->created)
+    {
+        g_hash_table_iter_init(&iter, pending->created);
+        while (budget > 0 && g_hash_table_iter_next(&iter, &name, NULL))
+        {
+            gchar *child = *relative ? g_strconcat(relative, "/", name, NULL) : g_strdup(name);
+            watch_mark_subtree_dirty(pending->workdir, child, &budget);
+            g_free(child);
+        }
+
+        /* Too big a tree to go through directory by directory */
+        if (budget == 0)
+            tgp_status_cache_invalidate(pending->workdir);
+    }
+}
+
+static gboolean
+watch_flush(gpointer user_data)
+{
+    GHashTable *refresh = g_hash_table_new(g_str_hash, g_str_equal);
+    gdouble seconds = flush_window / 1000.0;
+    GHashTableIter iter;
+    gpointer key, value;
+    GPtrArray *paths;
+    guint events = 0;
+
+    (void)user_data;
+
+    flush_source = 0;
+
+    /* Repositories entering or leaving an event storm */
+    g_hash_table_iter_init(&iter, pending_repos);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+    {
+        PendingRepo *repo = value;
+
+        events += repo->events;
+
+        if (repo->events >= TGP_WATCH_STORM_RATE * seconds)
+        {
+            if (!repo->storm)
+                g_debug("Event storm in %s, deferring to one rescan", (const gchar *)key);
+            repo->storm = TRUE;
+            repo->events = 0;
+            continue;
+        }
+
+        if (repo->storm)
+        {
+            /* Over: whatever changed, one full status walk finds it */
+            tgp_status_cache_invalidate(key);
+            watch_collect_shown(refresh, key, NULL);
+            repo->storm = FALSE;
+        }
+        else if (repo->git_changed)
+        {
+            watch_collect_shown(refresh, key, NULL);
+        }
+    }
+
+    /* Per-directory changes, unless their repository is in a storm */
+    g_hash_table_iter_init(&iter, pending_dirs);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+    {
+        PendingDir *pending = value;
+        PendingRepo *repo = g_hash_table_lookup(pending_repos, pending->workdir);
+        WatchedDir *dir;
+
+        if (repo && repo->storm)
+            continue;
+
+        watch_mark_dirty(pending);
+
+        /* A shown directory, or an ancestor of some */
+        dir = g_hash_table_lookup(watched_dirs, pending->path);
+        if (dir && dir->shown)
+            g_hash_table_add(refresh, dir->path);
+        else if (dir)
+            watch_collect_shown(refresh, dir->workdir, dir->path);
+    }
+    g_hash_table_remove_all(pending_dirs);
+
+    g_hash_table_iter_init(&iter, pending_repos);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+    {
+        if (!((PendingRepo *)value)->storm)
+            g_hash_table_iter_remove(&iter);
+    }
+
+    /* Wait longer while busy, come back to the short delay once it's quiet */
+    if (events >= TGP_WATCH_BUSY_RATE * seconds)
+        flush_window = MIN(flush_window * 2, TGP_WATCH_MAX_DELAY_MS);
+    else
+        flush_window = MAX(flush_window / 2, TGP_WATCH_REFRESH_DELAY_MS);
+    last_flush = g_get_monotonic_time();
+
+    /* Redrawing may change the watched set, so collect the paths first */
+    paths = g_ptr_array_new_with_free_func(g_free);
+    g_hash_table_iter_init(&iter, refresh);
+    while (g_hash_table_iter_next(&iter, &key, NULL))
+        g_ptr_array_add(paths, g_strdup(key));
+    g_hash_table_destroy(refresh);
+
+    for (guint i = 0; i < paths->len; i++)
+    {
+        const gchar *path = g_ptr_array_index(paths, i);
+
+        if (g_hash_table_contains(watched_dirs, path))
+            tgp_plugin_update_emblems_in_directory(path);
+    }
+    g_ptr_array_unref(paths);
+
+    /* Keep looking at storms until they are over */
+    if (g_hash_table_size(pending_repos) > 0)
+        flush_source = g_timeout_add(flush_window, watch_flush, NULL);
+
+    return G_SOURCE_REMOVE;
+}
+
+static PendingRepo*
+watch_queue_event(const gchar *workdir)
+{
+    PendingRepo *repo = g_hash_table_lookup(pending_repos, workdir);
+
+    if (!repo)
+    {
+        repo = g_new0(PendingRepo, 1);
+        g_hash_table_insert(pending_repos, g_strdup(workdir), repo);
+    }
+    repo->events++;
+
+    if (!flush_source)
+    {
+        /* The first event after a quiet spell */
+        if (g_get_monotonic_time() - last_flush > TGP_WATCH_MAX_DELAY_MS * G_TIME_SPAN_MILLISECOND)
+            flush_window = TGP_WATCH_REFRESH_DELAY_MS;
+        flush_source = g_timeout_add(flush_window, watch_flush, NULL);
+    }
+
+    return repo;
+}
+
+/* Something in dir changed; name is the entry if known, and may be gone */
+static void
+watch_mark_changed(WatchedDir *dir, const gchar *name, GFileMonitorEvent event_type)
+{
+    PendingRepo *repo = watch_queue_event(dir->workdir);
+    PendingDir *pending;
+
+    if (repo->storm)
+        return;
+
+    pending = g_hash_table_lookup(pending_dirs, dir->path);
+    if (!pending)
+    {
+        pending = g_new0(PendingDir, 1);
+        pending->workdir = g_strdup(dir->workdir);
+        pending->path = g_strdup(dir->path);
+        g_hash_table_insert(pending_dirs, pending->path, pending);
+    }
+
+    if (!name)
+        return;
+
+    if (event_type == G_FILE_MONITOR_EVENT_DELETED ||
+        event_type == G_FILE_MONITOR_EVENT_MOVED_OUT)
+    {
+        if (!pending->removed)
+            pending->removed = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        g_hash_table_add(pending->removed, g_strdup(name));
+    }
+    else if (event_type == G_FILE_MONITOR_EVENT_CREATED ||
+             event_type == G_FILE_MONITOR_EVENT_MOVED_IN)
+    {
+        if (!pending->created)
+            pending->created = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        g_hash_table_add(pending->created, g_strdup(name));
+    }
+}
+
+static void
+watch_dir_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+                  GFileMonitorEvent event_type, gpointer user_data)
+{
+    gchar *name;
+
+    (void)monitor;
+
+    if (event_type == G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED ||
+        event_type == G_FILE_MONITOR_EVENT_PRE_UNMOUNT)
+        return;
+
+    /* A rename inside the directory: the old name goes, the new one comes */
+    if (event_type == G_FILE_MONITOR_EVENT_RENAMED && other_file)
+    {
+        name = g_file_get_basename(other_file);
+        watch_mark_changed(user_data, name, G_FILE_MONITOR_EVENT_MOVED_IN);
+        g_free(name);
+        event_type = G_FILE_MONITOR_EVENT_MOVED_OUT;
+    }
+
+    name = g_file_get_basename(file);
+    if (g_strcmp0(name, ".git") != 0)
+        watch_mark_changed(user_data, name, event_type);
+    g_free(name);
+}
+
+static gint64
+watch_get_mtime(const gchar *path)
+{
+    GStatBuf st;
+
+    if (g_stat(path, &st) != 0)
+        return -1;
+
+    return (gint64)st.st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) + st.st_mtim.tv_nsec;
+}
+
+/* Record the directories below a shown one, breadth first, taking from budget */
+static void
+watch_collect_subtree(WatchedDir *dir, guint *budget)
+{
+    GQueue queue = G_QUEUE_INIT;
+    gchar *path;
+
+    dir->subtree = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    g_queue_push_tail(&queue, g_strdup(dir->path));
+
+    while ((path = g_queue_pop_head(&queue)) != NULL)
+    {
+        GDir *handle = *budget > 0 ? g_dir_open(path, 0, NULL) : NULL;
+        const gchar *name;
+
+        while (handle && *budget > 0 && (name = g_dir_read_name(handle)) != NULL)
+        {
+            gchar *child;
+            gint64 *mtime;
+            GStatBuf st;
+
+            if (strcmp(name, ".git") == 0)
+                continue;
+
+            /* Not followed through symlinks, status doesn't either */
+            child = g_build_filename(path, name, NULL);
+            if (g_lstat(child, &st) != 0 || !S_ISDIR(st.st_mode))
+            {
+                g_free(child);
+                continue;
+            }
+
+            mtime = g_new(gint64, 1);
+            *mtime = (gint64)st.st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) + st.st_mtim.tv_nsec;
+            g_hash_table_insert(dir->subtree, g_strdup(child), mtime);
+            g_queue_push_tail(&queue, child);
+            (*budget)--;
+        }
+
+        if (handle)
+            g_dir_close(handle);
+        g_free(path);
+    }
+}
+
+/*
+ * Compare the mtimes below a shown directory. A directory that changed is
+ * marked dirty and the shown one redrawn; the set is collected again on
+ * the next round, since directories may have come or gone.
+ */
+static void
+watch_poll_subtree(WatchedDir *dir, guint *budget)
+{
+    GHashTableIter iter;
+    gpointer key, value;
+    gboolean changed = FALSE;
+
+    if (!dir->subtree)
+    {
+        watch_collect_subtree(dir, budget);
+        return;
+    }
+
+    g_hash_table_iter_init(&iter, dir->subtree);
+    while (*budget > 0 && g_hash_table_iter_next(&iter, &key, &value))
+    {
+        gint64 *mtime = value;
+        gint64 now = watch_get_mtime(key);
+        const gchar *relative;
+
+        (*budget)--;
+        if (now == *mtime)
+            continue;
+
+        relative = watch_relative(dir->workdir, key);
+        if (relative)
+            tgp_status_cache_mark_dirty(dir->workdir, relative);
+        changed = TRUE;
+    }
+
+    if (changed)
+    {
+        watch_mark_changed(dir, NULL, G_FILE_MONITOR_EVENT_CHANGED);
+        g_hash_table_destroy(dir->subtree);
+        dir->subtree = NULL;
+    }
+}
+
+/* Redraw the shown directories of repositories whose status table has expired */
+static void
+watch_refresh_expired(void)
+{
+    GHashTable *workdirs = g_hash_table_new(g_str_hash, g_str_equal);
+    GHashTable *refresh = g_hash_table_new(g_str_hash, g_str_equal);
+    GHashTableIter iter;
+    gpointer key, value;
+    GPtrArray *paths;
+
+    g_hash_table_iter_init(&iter, watched_dirs);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+    {
+        WatchedDir *dir = value;
+
+        if (dir->shown)
+            g_hash_table_add(workdirs, dir->workdir);
+    }
+
+    g_hash_table_iter_init(&iter, workdirs);
+    while (g_hash_table_iter_next(&iter, &key, NULL))
+    {
+        TgpStatusTable *table;
+        gboolean stale = FALSE;
+
+        /* A repository in a storm gets its rescan once the storm is over */
+        if (g_hash_table_contains(pending_repos, key))
+            continue;
+
+        table = tgp_status_cache_peek(key, &stale);
+        if (table && stale)
+            watch_collect_shown(refresh, key, NULL);
+        if (table)
+            tgp_status_table_unref(table);
+    }
+
+    /* Redrawing may change the watched set, so collect the paths first */
+    paths = g_ptr_array_new_with_free_func(g_free);
+    g_hash_table_iter_init(&iter, refresh);
+    while (g_hash_table_iter_next(&iter, &key, NULL))
+        g_ptr_array_add(paths, g_strdup(key));
+
+    for (guint i = 0; i < paths->len; i++)
+        tgp_plugin_update_emblems_in_directory(g_ptr_array_index(paths, i));
+
+    g_ptr_array_unref(paths);
+    g_hash_table_destroy(refresh);
+    g_hash_table_destroy(workdirs);
+}
+
+static gboolean
+watch_poll(gpointer user_data)
+{
+    guint budget = TGP_WATCH_SUBTREE_POLL_MAX;
+
+    (void)user_data;
+
+    for (GList *l = polled_dirs.head; l != NULL; l = l->next)
+    {
+        WatchedDir *dir = l->data;
+        gint64 mtime = watch_get_mtime(dir->path);
+
+        if (mtime != dir->mtime)
+        {
+            dir->mtime = mtime;
+            watch_mark_changed(dir, NULL, G_FILE_MONITOR_EVENT_CHANGED);
+        }
+    }
+
+    /* Below shown directories, most recently shown first */
+    for (GList *l = watch_lru.head; l != NULL && budget > 0; l = l->next)
+    {
+        WatchedDir *dir = l->data;
+
+        if (dir->shown)
+            watch_poll_subtree(dir, &budget);
+    }
+    for (GList *l = polled_dirs.head; l != NULL && budget > 0; l = l->next)
+    {
+        WatchedDir *dir = l->data;
+
+        if (dir->shown)
+            watch_poll_subtree(dir, &budget);
+    }
+
+    watch_refresh_expired();
+
+    if (g_hash_table_size(watched_dirs) > 0)
+        return G_SOURCE_CONTINUE;
+
+    poll_source = 0;
+    return G_SOURCE_REMOVE;
+}
+
+static void
+watch_ensure_poll(void)
+{
+    if (!poll_source)
+        poll_source = g_timeout_add_seconds(tgp_config_get_poll_interval(), watch_poll, NULL);
+}
+
+/* Trade the monitor of the least recently shown directories for polling */
+static void
+watch_evict(guint keep)
+{
+    guint budget = MAX(tgp_config_get_watch_budget(), keep);
+
+    while (watch_lru.length > budget)
+    {
+        WatchedDir *dir = g_queue_pop_tail(&watch_lru);
+
+        watch_stop_monitor(dir);
+        dir->mtime = watch_get_mtime(dir->path);
+        g_queue_push_head(&polled_dirs, dir);
+        dir->link = polled_dirs.head;
+    }
+
+    while (polled_dirs.length > budget * WATCH_POLLED_FACTOR)
+    {
+        WatchedDir *dir = polled_dirs.tail->data;
+        g_hash_table_remove(watched_dirs, dir->path);
+    }
+
+    if (polled_dirs.length > 0)
+        watch_ensure_poll();
+}
+
+static gboolean
+watch_start_monitor(WatchedDir *dir)
+{
+    GFile *file = g_file_new_for_path(dir->path);
+
+    dir->monitor = g_file_monitor_directory(file, G_FILE_MONITOR_WATCH_MOVES, NULL, NULL);
+    g_object_unref(file);
+
+    if (!dir->monitor)
+        return FALSE;
+
+    g_signal_connect(dir->monitor, "changed", G_CALLBACK(watch_dir_changed), dir);
+    return TRUE;
+}
+
+/* Make dir the most recently shown monitored directory */
+static void
+watch_touch(const gchar *workdir, const gchar *path, gboolean shown)
+{
+    WatchedDir *dir = g_hash_table_lookup(watched_dirs, path);
+
+    if (dir && dir->monitor)
+    {
+        g_queue_unlink(&watch_lru, dir->link);
+        g_queue_push_head_link(&watch_lru, dir->link);
+        dir->shown |= shown;
+        if (dir->shown)
+            watch_ensure_poll();
+        return;
+    }
+
+    if (dir)
+    {
+        /* Polled so far, try to watch it again */
+        g_queue_delete_link(&polled_dirs, dir->link);
+        dir->link = NULL;
+    }
+    else
+    {
+        dir = g_new0(WatchedDir, 1);
+        dir->workdir = g_strdup(workdir);
+        dir->path = g_strdup(path);
+        g_hash_table_insert(watched_dirs, dir->path, dir);
+    }
+
+    dir->shown |= shown;
+    if (dir->shown)
+        watch_ensure_poll();
+
+    if (watch_start_monitor(dir))
+    {
+        g_queue_push_head(&watch_lru, dir);
+    }
+    else
+    {
+        dir->mtime = watch_get_mtime(dir->path);
+        g_queue_push_head(&polled_dirs, dir);
+        dir->link = polled_dirs.head;
+        return;
+    }
+
+    dir->link = watch_lru.head;
+}
+
+/*
+ * The directory holding the ref HEAD points to, in the common dir of
+ * linked worktrees; loose refs of nested branch names live further down.
+ * NULL if HEAD is detached or can't be read.
+ */
+static gchar*
+watch_get_ref_dir(const gchar *gitdir)
+{
+    gchar *head_path = g_build_filename(gitdir, "HEAD", NULL);
+    gchar *common_path = g_build_filename(gitdir, "commondir", NULL);
+    gchar *head = NULL;
+    gchar *common = NULL;
+    gchar *ref_dir = NULL;
+
+    if (g_file_get_contents(head_path, &head, NULL, NULL) &&
+        g_str_has_prefix(head, "ref: "))
+    {
+        gchar *ref_path;
+
+        g_strstrip(head);
+        if (g_file_get_contents(common_path, &common, NULL, NULL))
+            g_strstrip(common);
+
+        if (!common)
+            ref_path = g_build_filename(gitdir, head + 5, NULL);
+        else if (g_path_is_absolute(common))
+            ref_path = g_build_filename(common, head + 5, NULL);
+        else
+            ref_path = g_build_filename(gitdir, common, head + 5, NULL);
+
+        ref_dir = g_path_get_dirname(ref_path);
+        g_free(ref_path);
+    }
+
+    g_free(common);
+    g_free(head);
+    g_free(common_path);
+    g_free(head_path);
+    return ref_dir;
+}
+
+static void watch_git_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+                              GFileMonitorEvent event_type, gpointer user_data);
+
+/* Point the ref monitor at the current branch's directory */
+static void
+watch_follow_head(GitWatch *watch)
+{
+    gchar *ref_dir = watch_get_ref_dir(watch->gitdir);
+    GFile *file;
+
+    if (g_strcmp0(ref_dir, watch->ref_dir) == 0)
+    {
+        g_free(ref_dir);
+        return;
+    }
+
+    if (watch->ref_monitor)
+        watch_monitor_free(watch->ref_monitor);
+    watch->ref_monitor = NULL;
+    g_free(watch->ref_dir);
+    watch->ref_dir = ref_dir;
+
+    if (!ref_dir)
+        return;
+
+    file = g_file_new_for_path(ref_dir);
+    watch->ref_monitor = g_file_monitor_directory(file, G_FILE_MONITOR_WATCH_MOVES, NULL, NULL);
+    g_object_unref(file);
+
+    if (watch->ref_monitor)
+        g_signal_connect(watch->ref_monitor, "changed", G_CALLBACK(watch_git_changed), watch);
+}
+
+static void
+watch_git_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+                  GFileMonitorEvent event_type, gpointer user_data)
+{
+    GitWatch *watch = user_data;
+    gchar *name;
+    gboolean head;
+
+    if (event_type == G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED)
+        return;
+
+    /* Lock files come and go around every write, the rename is what counts */
+    if (event_type == G_FILE_MONITOR_EVENT_RENAMED && other_file)
+        name = g_file_get_basename(other_file);
+    else
+        name = g_file_get_basename(file);
+    if (g_str_has_suffix(name, ".lock"))
+    {
+        g_free(name);
+        return;
+    }
+    head = monitor == watch->monitor && g_str_has_prefix(name, "HEAD");
+    g_free(name);
+
+    tgp_index_snapshot_head_changed(watch->gitdir);
+
+    /* Switched branches */
+    if (head)
+        watch_follow_head(watch);
+
+    watch_queue_event(watch->workdir)->git_changed = TRUE;
+}
+
+static void
+watch_add(const WatchRequest *request)
+{
+    const gchar *relative = watch_relative(request->workdir, request->path);
+    GFileMonitor *monitor;
+    GPtrArray *chain;
+
+    if (!relative)
+        return;
+
+    if (!g_hash_table_contains(git_monitors, request->workdir))
+    {
+        GFile *file = g_file_new_for_path(request->gitdir);
+
+        monitor = g_file_monitor_directory(file, G_FILE_MONITOR_WATCH_MOVES, NULL, NULL);
+        g_object_unref(file);
+
+        if (monitor)
+        {
+            GitWatch *watch = g_new0(GitWatch, 1);
+
+            watch->workdir = g_strdup(request->workdir);
+            watch->gitdir = g_strdup(request->gitdir);
+            watch->monitor = monitor;
+            g_hash_table_insert(git_monitors, watch->workdir, watch);
+            g_signal_connect(monitor, "changed", G_CALLBACK(watch_git_changed), watch);
+
+            /* From here on changes to HEAD are reported */
+            watch_follow_head(watch);
+            tgp_index_snapshot_watch_head(watch->gitdir);
+        }
+    }
+
+    /* The directory and its ancestors up to the top of the worktree */
+    chain = g_ptr_array_new_with_free_func(g_free);
+    g_ptr_array_add(chain, g_strdup(request->path));
+    while (strlen(g_ptr_array_index(chain, chain->len - 1)) + 1 > strlen(request->workdir))
+        g_ptr_array_add(chain, g_path_get_dirname(g_ptr_array_index(chain, chain->len - 1)));
+
+    /* Top first, so the directory itself ends up most recently shown */
+    for (guint i = chain->len; i > 0; i--)
+        watch_touch(request->workdir, g_ptr_array_index(chain, i - 1), i == 1);
+
+    watch_evict(chain->len);
+    g_ptr_array_unref(chain);
+}
+
+static gboolean
+watch_add_pending(gpointer user_data)
+{
+    GPtrArray *requests;
+    GPtrArray *refreshes;
+
+    (void)user_data;
+
+    g_mutex_lock(&requests_mutex);
+    request_source = 0;
+    requests = pending_requests;
+    pending_requests = g_ptr_array_new_with_free_func(watch_request_free);
+    refreshes = pending_refreshes;
+    pending_refreshes = g_ptr_array_new_with_free_func(g_free);
+    g_mutex_unlock(&requests_mutex);
+
+    if (watched_dirs)
+    {
+        for (guint i = 0; i < requests->len; i++)
+            watch_add(g_ptr_array_index(requests, i));
+
+        for (guint i = 0; i < refreshes->len; i++)
+        {
+            WatchedDir *dir = g_hash_table_lookup(watched_dirs,
+                                                  g_ptr_array_index(refreshes, i));
+
+            if (dir && dir->shown)
+                tgp_plugin_update_emblems_in_directory(dir->path);
+        }
+    }
+
+    g_ptr_array_unref(refreshes);
+    g_ptr_array_unref(requests);
+    return G_SOURCE_REMOVE;
+}
+
+void
+tgp_watch_init(void)
+{
+    g_mutex_lock(&requests_mutex);
+    if (!watched_dirs)
+    {
+        watched_dirs = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, watched_dir_free);
+        g_queue_init(&watch_lru);
+        g_queue_init(&polled_dirs);
+        git_monitors = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, git_watch_free);
+        pending_dirs = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, pending_dir_free);
+        pending_repos = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+        pending_requests = g_ptr_array_new_with_free_func(watch_request_free);
+        pending_refreshes = g_ptr_array_new_with_free_func(g_free);
+    }
+    g_mutex_unlock(&requests_mutex);
+}
+
+void
+tgp_watch_shutdown(void)
+{
+    g_mutex_lock(&requests_mutex);
+    if (request_source)
+    {
+        g_source_remove(request_source);
+        request_source = 0;
+    }
+    if (flush_source)
+    {
+        g_source_remove(flush_source);
+        flush_source = 0;
+    }
+    if (poll_source)
+    {
+        g_source_remove(poll_source);
+        poll_source = 0;
+    }
+    flush_window = TGP_WATCH_REFRESH_DELAY_MS;
+    if (watched_dirs)
+    {
+        g_hash_table_destroy(watched_dirs);
+        g_hash_table_destroy(git_monitors);
+        g_hash_table_destroy(pending_dirs);
+        g_hash_table_destroy(pending_repos);
+        g_ptr_array_unref(pending_requests);
+        g_ptr_array_unref(pending_refreshes);
+        watched_dirs = NULL;
+        git_monitors = NULL;
+        pending_dirs = NULL;
+        pending_repos = NULL;
+        pending_requests = NULL;
+        pending_refreshes = NULL;
+    }
+    g_mutex_unlock(&requests_mutex);
+}
+
+void
+tgp_watch_directory(const gchar *workdir, const gchar *gitdir, const gchar *path)
+{
+    WatchRequest *request;
+
+    g_return_if_fail(workdir != NULL && gitdir != NULL && path != NULL);
+
+    request = g_new0(WatchRequest, 1);
+    request->workdir = g_strdup(workdir);
+    request->gitdir = g_strdup(gitdir);
+    request->path = g_strdup(path);
+    watch_strip_slashes(request->path);
+
+    g_mutex_lock(&requests_mutex);
+    if (pending_requests)
+    {
+        g_ptr_array_add(pending_requests, request);
+        request = NULL;
+        if (!request_source)
+            request_source = g_idle_add(watch_add_pending, NULL);
+    }
+    g_mutex_unlock(&requests_mutex);
+
+    if (request)
+        watch_request_free(request);
+}
+
+void
+tgp_watch_refresh_shown(GPtrArray *paths)
+{
+    g_return_if_fail(paths != NULL);
+
+    g_mutex_lock(&requests_mutex);
+    if (pending_refreshes)
+    {
+        for (guint i = 0; i < paths->len; i++)
+        {
+            gchar *path = g_strdup(g_ptr_array_index(paths, i));
+
+            watch_strip_slashes(path);
+            g_ptr_array_add(pending_refreshes, path);
+        }
+        if (!request_source && paths->len > 0)
+            request_source = g_idle_add(watch_add_pending, NULL);
+    }
+    g_mutex_unlock(&requests_mutex);
+}
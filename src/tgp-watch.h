@@ -0,0 +1,48 @@
+/*
+ * Thunar Git Plugin - Worktree Watches
+ * Copyright (C) 2025 MiniMax Agent
+ */
+
+#ifndef __TGP_WATCH_H__
+#define __TGP_WATCH_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Delay between a change on disk and the emblem refresh it causes */
+#define TGP_WATCH_REFRESH_DELAY_MS 250
+
+/* Under load the delay doubles per busy window, up to this */
+#define TGP_WATCH_MAX_DELAY_MS     4000
+
+/* Events per second making a window busy, and a repository's storm */
+#define TGP_WATCH_BUSY_RATE        20
+#define TGP_WATCH_STORM_RATE       500
+
+/* Directories below shown ones whose mtime is polled per PollInterval */
+#define TGP_WATCH_SUBTREE_POLL_MAX 1024
+
+/* Initialize/cleanup */
+void     tgp_watch_init(void);
+void     tgp_watch_shutdown(void);
+
+/*
+ * Watch a directory whose emblems are shown, its ancestors up to the top
+ * of the worktree, and the gitdir of its repository. Changes mark the
+ * directory dirty in the status cache and refresh its emblems. Beyond the
+ * configured number of watches the least recently shown directories are
+ * polled instead. May be called from any thread.
+ */
+void     tgp_watch_directory(const gchar *workdir, const gchar *gitdir, const gchar *path);
+
+/*
+ * Queue an emblem update of those of paths (absolute directories) that
+ * are shown. The others get no scan and no watch; they are redrawn once
+ * they are shown. May be called from any thread.
+ */
+void     tgp_watch_refresh_shown(GPtrArray *paths);
+
+G_END_DECLS
+
+#endif /* __TGP_WATCH_H__ */
@@ -0,0 +1,240 @@
+/*
+ * Thunar Git Plugin - Emblem Hot Path Benchmark
+ * Copyright (C) 2025 MiniMax Agent
+ *
+ * Times the per-file work of an emblem refresh once the status table is
+ * built: the table lookup, the mapping from status to flags, emblem and
+ * text, and the emblem write of a file whose emblem is already known.
+ * malloc() and friends are counted while that loop runs (with glibc);
+ * a single allocation per file fails the benchmark. A second loop times
+ * writes that change every emblem, which go to the metadata store.
+ *
+ * Skipped (77) where the metadata store doesn't keep what is written,
+ * since then there is no known emblem to measure.
+ */
+
+#include "tgp-status-table.h"
+#include "tgp-emblem-provider.h"
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_DIRS   20
+#define BENCH_FILES  100     /* Per directory */
+#define BENCH_ROUNDS 50
+#define BENCH_WRITE_ROUNDS 2
+
+static gsize n_allocs = 0;
+static gboolean counting = FALSE;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void*
+malloc(size_t size)
+{
+    if (counting)
+        n_allocs++;
+    return __libc_malloc(size);
+}
+
+void*
+calloc(size_t n, size_t size)
+{
+    if (counting)
+        n_allocs++;
+    return __libc_calloc(n, size);
+}
+
+void*
+realloc(void *ptr, size_t size)
+{
+    if (counting)
+        n_allocs++;
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+/* Failed first writes are reported once, after the read back */
+static void
+bench_quiet(const gchar *log_domain, GLogLevelFlags log_level, const gchar *message,
+            gpointer user_data)
+{
+    (void)log_domain;
+    (void)log_level;
+    (void)message;
+    (void)user_data;
+}
+
+/* Cycles through the states a worktree mixes, one in five files clean */
+static unsigned int
+bench_status_of(guint i)
+{
+    static const unsigned int statuses[] = {
+        GIT_STATUS_WT_MODIFIED,
+        GIT_STATUS_INDEX_NEW,
+        GIT_STATUS_WT_NEW,
+        0,
+        GIT_STATUS_IGNORED
+    };
+
+    return statuses[i % G_N_ELEMENTS(statuses)];
+}
+
+static TgpStatusFlags
+bench_flags_of(guint i)
+{
+    TgpPackedStatus status = tgp_status_pack(bench_status_of(i));
+
+    return status ? tgp_status_to_flags(status) : TGP_STATUS_CLEAN;
+}
+
+/* Whether the emblem of file_path reads back as the one for flags */
+static gboolean
+bench_written(const gchar *file_path, TgpStatusFlags flags)
+{
+    GFile *file = g_file_new_for_path(file_path);
+    TgpStatusFlags known = tgp_emblem_get_git_status_attribute(file);
+
+    g_object_unref(file);
+    return g_strcmp0(tgp_emblem_get_icon_name(known), tgp_emblem_get_icon_name(flags)) == 0;
+}
+
+static gsize
+bench_file(TgpStatusTable *table, const gchar *relative_path, const gchar *file_path)
+{
+    TgpPackedStatus status;
+    TgpStatusFlags flags;
+
+    if (!tgp_status_table_lookup(table, relative_path, &status))
+        status = 0;
+
+    flags = status ? tgp_status_to_flags(status) : TGP_STATUS_CLEAN;
+    tgp_emblem_set_git_status_on_file(file_path, flags);
+
+    return strlen(tgp_emblem_get_icon_name(flags)) + strlen(tgp_emblem_get_status_text(flags));
+}
+
+int
+main(int argc, char **argv)
+{
+    TgpStatusTableBuilder *builder;
+    TgpStatusTable *table;
+    GPtrArray *relative_paths;
+    GPtrArray *file_paths;
+    gchar *workdir;
+    gsize sink = 0;
+    gint64 start, elapsed;
+    guint n_files;
+    gdouble per_file;
+    gboolean written = TRUE;
+
+    (void)argc;
+    (void)argv;
+
+    workdir = g_dir_make_tmp("tgp-bench-XXXXXX", NULL);
+    g_assert(workdir != NULL);
+
+    tgp_emblem_init();
+
+    builder = tgp_status_table_builder_new();
+    relative_paths = g_ptr_array_new_with_free_func(g_free);
+    file_paths = g_ptr_array_new_with_free_func(g_free);
+
+    for (guint d = 0; d < BENCH_DIRS; d++)
+    {
+        gchar *dir = g_strdup_printf("%s/dir%02u", workdir, d);
+
+        g_assert(g_mkdir(dir, 0755) == 0);
+
+        for (guint f = 0; f < BENCH_FILES; f++)
+        {
+            gchar *relative_path = g_strdup_printf("dir%02u/file%03u.c", d, f);
+            gchar *file_path = g_build_filename(workdir, relative_path, NULL);
+            unsigned int status = bench_status_of(relative_paths->len);
+
+            g_assert(g_file_set_contents(file_path, "", 0, NULL));
+            if (status)
+                tgp_status_table_builder_add(builder, relative_path, status);
+
+            g_ptr_array_add(relative_paths, relative_path);
+            g_ptr_array_add(file_paths, file_path);
+        }
+        g_free(dir);
+    }
+
+    table = tgp_status_table_builder_finish(builder);
+    n_files = relative_paths->len;
+
+    /* The first pass writes every emblem; the measured ones find them known */
+    g_log_set_handler(G_LOG_DOMAIN, G_LOG_LEVEL_WARNING, bench_quiet, NULL);
+    for (guint i = 0; i < n_files; i++)
+        sink += bench_file(table, g_ptr_array_index(relative_paths, i),
+                           g_ptr_array_index(file_paths, i));
+
+    for (guint i = 0; i < n_files && written; i++)
+        written = bench_written(g_ptr_array_index(file_paths, i), bench_flags_of(i));
+    if (!written)
+    {
+        g_print("Emblems are not kept by the metadata store here, skipping\n");
+        goto out;
+    }
+
+    start = g_get_monotonic_time();
+    counting = TRUE;
+    for (guint round = 0; round < BENCH_ROUNDS; round++)
+    {
+        for (guint i = 0; i < n_files; i++)
+            sink += bench_file(table, g_ptr_array_index(relative_paths, i),
+                               g_ptr_array_index(file_paths, i));
+    }
+    counting = FALSE;
+    elapsed = g_get_monotonic_time() - start;
+
+    per_file = (gdouble)elapsed * 1000.0 / ((gdouble)n_files * BENCH_ROUNDS);
+    g_print("%u files x %u rounds: %.1f ns and %.3f allocations per file (%" G_GSIZE_FORMAT ")\n",
+            n_files, BENCH_ROUNDS, per_file,
+            (gdouble)n_allocs / ((gdouble)n_files * BENCH_ROUNDS), sink);
+#ifndef __GLIBC__
+    g_print("Allocations are only counted with glibc\n");
+#endif
+
+    /* Every round changes every emblem, so each write misses the cache */
+    start = g_get_monotonic_time();
+    for (guint round = 0; round < BENCH_WRITE_ROUNDS; round++)
+    {
+        for (guint i = 0; i < n_files; i++)
+            tgp_emblem_set_git_status_on_file(g_ptr_array_index(file_paths, i),
+                                              bench_flags_of(i + round + 1));
+    }
+    elapsed = g_get_monotonic_time() - start;
+
+    per_file = (gdouble)elapsed * 1000.0 / ((gdouble)n_files * BENCH_WRITE_ROUNDS);
+    g_print("%u files x %u rounds of changed emblems: %.1f ns per file\n",
+            n_files, BENCH_WRITE_ROUNDS, per_file);
+
+out:
+
+    for (guint i = 0; i < n_files; i++)
+        g_unlink(g_ptr_array_index(file_paths, i));
+    for (guint d = 0; d < BENCH_DIRS; d++)
+    {
+        gchar *dir = g_strdup_printf("%s/dir%02u", workdir, d);
+        g_rmdir(dir);
+        g_free(dir);
+    }
+    g_rmdir(workdir);
+
+    tgp_emblem_shutdown();
+    tgp_status_table_unref(table);
+    g_ptr_array_unref(file_paths);
+    g_ptr_array_unref(relative_paths);
+    g_free(workdir);
+
+    if (!written)
+        return 77;
+
+    return n_allocs == 0 ? 0 : 1;
+}
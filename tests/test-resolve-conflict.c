@@ -0,0 +1,216 @@
+/*
+ * Thunar Git Plugin - Conflict Resolution Tests
+ * Copyright (C) 2025 MiniMax Agent
+ *
+ * Builds a modify/delete conflict in a scratch repository (ancestor and
+ * ours present, theirs deleted) and checks both ways of resolving it.
+ */
+
+#include "tgp-git-utils.h"
+#include "tgp-index-session.h"
+#include <glib/gstdio.h>
+#include <string.h>
+
+#define CONFLICT_PATH "file.txt"
+
+typedef struct {
+    gchar          *workdir;
+    git_repository *repo;
+    TgpConflict     conflict;
+} Fixture;
+
+static void
+remove_tree(const gchar *path)
+{
+    GDir *dir = g_dir_open(path, 0, NULL);
+    const gchar *name;
+
+    if (dir)
+    {
+        while ((name = g_dir_read_name(dir)) != NULL)
+        {
+            gchar *child = g_build_filename(path, name, NULL);
+            remove_tree(child);
+            g_free(child);
+        }
+        g_dir_close(dir);
+        g_rmdir(path);
+    }
+    else
+    {
+        g_unlink(path);
+    }
+}
+
+static void
+write_file(const gchar *workdir, const gchar *contents)
+{
+    gchar *path = g_build_filename(workdir, CONFLICT_PATH, NULL);
+
+    g_assert_true(g_file_set_contents(path, contents, -1, NULL));
+    g_free(path);
+}
+
+static void
+fixture_set_up(Fixture *fixture, gconstpointer data)
+{
+    git_index *index;
+    git_index_entry ancestor = { 0 };
+    git_index_entry ours = { 0 };
+
+    (void)data;
+
+    fixture->workdir = g_dir_make_tmp("tgp-test-XXXXXX", NULL);
+    g_assert_nonnull(fixture->workdir);
+    g_assert_cmpint(git_repository_init(&fixture->repo, fixture->workdir, 0), ==, 0);
+
+    g_assert_cmpint(git_blob_create_from_buffer(&ancestor.id, fixture->repo, "base\n", 5), ==, 0);
+    g_assert_cmpint(git_blob_create_from_buffer(&ours.id, fixture->repo, "ours\n", 5), ==, 0);
+    ancestor.mode = ours.mode = GIT_FILEMODE_BLOB;
+    ancestor.path = ours.path = CONFLICT_PATH;
+
+    g_assert_cmpint(git_repository_index(&index, fixture->repo), ==, 0);
+    g_assert_cmpint(git_index_conflict_add(index, &ancestor, &ours, NULL), ==, 0);
+    g_assert_cmpint(git_index_write(index), ==, 0);
+    git_index_free(index);
+
+    write_file(fixture->workdir, "ours\n");
+
+    fixture->conflict.path = g_strdup(CONFLICT_PATH);
+    git_oid_cpy(&fixture->conflict.ancestor, &ancestor.id);
+    git_oid_cpy(&fixture->conflict.ours, &ours.id);
+    fixture->conflict.mode = GIT_FILEMODE_BLOB;
+    fixture->conflict.has_ancestor = TRUE;
+    fixture->conflict.has_ours = TRUE;
+    fixture->conflict.has_theirs = FALSE;
+}
+
+static void
+fixture_tear_down(Fixture *fixture, gconstpointer data)
+{
+    (void)data;
+
+    /* Drops the session of this repository along with any others */
+    tgp_index_session_shutdown();
+
+    g_free(fixture->conflict.path);
+    git_repository_free(fixture->repo);
+    remove_tree(fixture->workdir);
+    g_free(fixture->workdir);
+}
+
+/* The index as written to disk, after the session flushed */
+static git_index*
+read_index(Fixture *fixture)
+{
+    git_index *index;
+    GError *error = NULL;
+
+    g_assert_true(tgp_index_session_flush(fixture->repo, &error));
+    g_assert_no_error(error);
+
+    g_assert_cmpint(git_repository_index(&index, fixture->repo), ==, 0);
+    g_assert_cmpint(git_index_read(index, TRUE), ==, 0);
+    return index;
+}
+
+static void
+test_merge_favoring_deletion(Fixture *fixture, gconstpointer data)
+{
+    TgpMergeResult *result;
+    GError *error = NULL;
+
+    (void)data;
+
+    result = tgp_git_merge_conflict(fixture->repo, &fixture->conflict,
+                                    GIT_MERGE_FILE_FAVOR_THEIRS, &error);
+    g_assert_no_error(error);
+    g_assert_nonnull(result);
+    g_assert_true(result->deleted);
+    g_assert_cmpuint(result->length, ==, 0);
+    tgp_merge_result_free(result);
+
+    result = tgp_git_merge_conflict(fixture->repo, &fixture->conflict,
+                                    GIT_MERGE_FILE_FAVOR_OURS, &error);
+    g_assert_no_error(error);
+    g_assert_nonnull(result);
+    g_assert_false(result->deleted);
+    g_assert_cmpstr(result->content, ==, "ours\n");
+    tgp_merge_result_free(result);
+}
+
+static void
+test_resolve_by_deletion(Fixture *fixture, gconstpointer data)
+{
+    GPtrArray *touched = g_ptr_array_new_with_free_func(g_free);
+    gchar *path = g_build_filename(fixture->workdir, CONFLICT_PATH, NULL);
+    GError *error = NULL;
+    git_index *index;
+
+    (void)data;
+
+    g_assert_true(tgp_git_resolve_conflict_by_deletion(fixture->repo, CONFLICT_PATH,
+                                                       touched, &error));
+    g_assert_no_error(error);
+    g_assert_false(g_file_test(path, G_FILE_TEST_EXISTS));
+    g_assert_cmpuint(touched->len, ==, 1);
+    g_assert_cmpstr(g_ptr_array_index(touched, 0), ==, CONFLICT_PATH);
+
+    index = read_index(fixture);
+    g_assert_false(git_index_has_conflicts(index));
+    g_assert_null(git_index_get_bypath(index, CONFLICT_PATH, 0));
+    git_index_free(index);
+
+    g_ptr_array_unref(touched);
+    g_free(path);
+}
+
+static void
+test_resolve_with_content(Fixture *fixture, gconstpointer data)
+{
+    const gchar *merged = "merged\n";
+    const git_index_entry *entry;
+    GError *error = NULL;
+    gchar *contents = NULL;
+    gchar *path = g_build_filename(fixture->workdir, CONFLICT_PATH, NULL);
+    git_index *index;
+
+    (void)data;
+
+    g_assert_true(tgp_git_resolve_conflict(fixture->repo, CONFLICT_PATH, merged,
+                                           strlen(merged), NULL, &error));
+    g_assert_no_error(error);
+
+    g_assert_true(g_file_get_contents(path, &contents, NULL, NULL));
+    g_assert_cmpstr(contents, ==, merged);
+
+    index = read_index(fixture);
+    g_assert_false(git_index_has_conflicts(index));
+    entry = git_index_get_bypath(index, CONFLICT_PATH, 0);
+    g_assert_nonnull(entry);
+    git_index_free(index);
+
+    g_free(contents);
+    g_free(path);
+}
+
+int
+main(int argc, char **argv)
+{
+    int result;
+
+    g_test_init(&argc, &argv, NULL);
+    git_libgit2_init();
+
+    g_test_add("/conflict/merge-favoring-deletion", Fixture, NULL,
+               fixture_set_up, test_merge_favoring_deletion, fixture_tear_down);
+    g_test_add("/conflict/resolve-by-deletion", Fixture, NULL,
+               fixture_set_up, test_resolve_by_deletion, fixture_tear_down);
+    g_test_add("/conflict/resolve-with-content", Fixture, NULL,
+               fixture_set_up, test_resolve_with_content, fixture_tear_down);
+
+    result = g_test_run();
+
+    git_libgit2_shutdown();
+    return result;
+}
@@ -0,0 +1,184 @@
+/*
+ * Thunar Git Plugin - Status Table Tests
+ * Copyright (C) 2025 MiniMax Agent
+ *
+ * Checks how folders aggregate the records below them in a scratch
+ * repository: a tracked folder holding ignored build output stays tracked,
+ * folders with nothing but ignored files in them are ignored.
+ */
+
+#include "tgp-status-table.h"
+#include "tgp-index-session.h"
+#include "tgp-index-snapshot.h"
+#include <glib/gstdio.h>
+#include <string.h>
+
+typedef struct {
+    gchar          *workdir;
+    git_repository *repo;
+} Fixture;
+
+static void
+remove_tree(const gchar *path)
+{
+    GDir *dir = g_dir_open(path, 0, NULL);
+    const gchar *name;
+
+    if (dir)
+    {
+        while ((name = g_dir_read_name(dir)) != NULL)
+        {
+            gchar *child = g_build_filename(path, name, NULL);
+            remove_tree(child);
+            g_free(child);
+        }
+        g_dir_close(dir);
+        g_rmdir(path);
+    }
+    else
+    {
+        g_unlink(path);
+    }
+}
+
+static void
+write_file(const gchar *workdir, const gchar *relative, const gchar *contents)
+{
+    gchar *path = g_build_filename(workdir, relative, NULL);
+    gchar *parent = g_path_get_dirname(path);
+
+    g_assert_cmpint(g_mkdir_with_parents(parent, 0755), ==, 0);
+    g_assert_true(g_file_set_contents(path, contents, -1, NULL));
+    g_free(parent);
+    g_free(path);
+}
+
+/* .gitignore and src/main.c committed; object files and build/ ignored */
+static void
+fixture_set_up(Fixture *fixture, gconstpointer data)
+{
+    git_index *index;
+    git_signature *signature;
+    git_tree *tree;
+    git_oid tree_id, commit_id;
+
+    (void)data;
+
+    fixture->workdir = g_dir_make_tmp("tgp-test-XXXXXX", NULL);
+    g_assert_nonnull(fixture->workdir);
+    g_assert_cmpint(git_repository_init(&fixture->repo, fixture->workdir, 0), ==, 0);
+
+    write_file(fixture->workdir, ".gitignore", "*.o\nbuild/\n");
+    write_file(fixture->workdir, "src/main.c", "int main(void) { return 0; }\n");
+
+    g_assert_cmpint(git_repository_index(&index, fixture->repo), ==, 0);
+    g_assert_cmpint(git_index_add_bypath(index, ".gitignore"), ==, 0);
+    g_assert_cmpint(git_index_add_bypath(index, "src/main.c"), ==, 0);
+    g_assert_cmpint(git_index_write(index), ==, 0);
+    g_assert_cmpint(git_index_write_tree(&tree_id, index), ==, 0);
+    git_index_free(index);
+
+    g_assert_cmpint(git_tree_lookup(&tree, fixture->repo, &tree_id), ==, 0);
+    g_assert_cmpint(git_signature_now(&signature, "Test", "test@example.com"), ==, 0);
+    g_assert_cmpint(git_commit_create_v(&commit_id, fixture->repo, "HEAD", signature, signature,
+                                        NULL, "Initial commit", tree, 0), ==, 0);
+    git_signature_free(signature);
+    git_tree_free(tree);
+
+    write_file(fixture->workdir, "src/main.o", "object\n");
+    write_file(fixture->workdir, "build/out.bin", "binary\n");
+}
+
+static void
+fixture_tear_down(Fixture *fixture, gconstpointer data)
+{
+    (void)data;
+
+    tgp_index_session_shutdown();
+
+    git_repository_free(fixture->repo);
+    remove_tree(fixture->workdir);
+    g_free(fixture->workdir);
+}
+
+static gboolean
+is_ignored(TgpPackedStatus status)
+{
+    return (tgp_status_unpack(status) & GIT_STATUS_IGNORED) != 0;
+}
+
+static void
+test_tracked_folder_with_ignored_file(Fixture *fixture, gconstpointer data)
+{
+    TgpIndexSnapshot *snapshot;
+    TgpStatusTable *table;
+    TgpPackedStatus status;
+
+    (void)data;
+
+    table = tgp_status_table_new_for_directory(fixture->repo, "", TRUE);
+    g_assert_nonnull(table);
+    snapshot = tgp_index_snapshot_get(fixture->repo);
+    g_assert_nonnull(snapshot);
+
+    g_assert_true(tgp_status_table_lookup(table, "src/main.o", &status));
+    g_assert_true(is_ignored(status));
+
+    /* Clean apart from the ignored file, with or without the index to ask */
+    g_assert_cmpuint(tgp_status_table_aggregate(table, "src", snapshot), ==, 0);
+    g_assert_cmpuint(tgp_status_table_aggregate(table, "src", NULL), ==, 0);
+
+    /* Nothing in build/ is tracked */
+    g_assert_true(is_ignored(tgp_status_table_aggregate(table, "build", snapshot)));
+
+    tgp_index_snapshot_unref(snapshot);
+    tgp_status_table_unref(table);
+}
+
+static void
+test_folder_of_ignored_files(Fixture *fixture, gconstpointer data)
+{
+    TgpStatusTableBuilder *builder;
+    TgpIndexSnapshot *snapshot;
+    TgpStatusTable *table;
+
+    (void)data;
+
+    /* What a walk descending into ignored folders reports */
+    builder = tgp_status_table_builder_new();
+    tgp_status_table_builder_add(builder, "obj/a.o", GIT_STATUS_IGNORED);
+    tgp_status_table_builder_add(builder, "obj/b.o", GIT_STATUS_IGNORED);
+    tgp_status_table_builder_add(builder, "src/main.o", GIT_STATUS_IGNORED);
+    table = tgp_status_table_builder_finish(builder);
+    snapshot = tgp_index_snapshot_get(fixture->repo);
+    g_assert_nonnull(snapshot);
+
+    g_assert_true(is_ignored(tgp_status_table_aggregate(table, "obj", snapshot)));
+    g_assert_false(is_ignored(tgp_status_table_aggregate(table, "src", snapshot)));
+    g_assert_false(is_ignored(tgp_status_table_aggregate(table, "", snapshot)));
+
+    /* Without the index a tracked folder can't be told apart, don't guess */
+    g_assert_false(is_ignored(tgp_status_table_aggregate(table, "obj", NULL)));
+
+    tgp_index_snapshot_unref(snapshot);
+    tgp_status_table_unref(table);
+}
+
+int
+main(int argc, char **argv)
+{
+    int result;
+
+    g_test_init(&argc, &argv, NULL);
+    git_libgit2_init();
+
+    g_test_add("/status-table/tracked-folder-with-ignored-file", Fixture, NULL,
+               fixture_set_up, test_tracked_folder_with_ignored_file, fixture_tear_down);
+    g_test_add("/status-table/folder-of-ignored-files", Fixture, NULL,
+               fixture_set_up, test_folder_of_ignored_files, fixture_tear_down);
+
+    result = g_test_run();
+
+    git_libgit2_shutdown();
+    return result;
+}